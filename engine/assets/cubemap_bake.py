@@ -0,0 +1,84 @@
+import argparse
+import struct
+
+import numpy as np
+from PIL import Image
+
+# Converts an equirectangular image to the six faces of a cubemap, so the engine doesn't have to at startup.
+# The output is a 16 byte header (see BakedCubemapHeader in graphics/cubemap.hpp) followed by the faces
+# as RGBA8 in Vulkan layer order: +X, -X, +Y, -Y, +Z, -Z.
+# This must produce the same result as equirect_to_cubemap_reference() in graphics/cubemap.cpp.
+
+parser = argparse.ArgumentParser(prog='cubemap_bake')
+parser.add_argument('input') # equirectangular image
+parser.add_argument('-o', '--output') # baked cubemap output
+args = parser.parse_args()
+
+MAGIC = b'CUBE'
+VERSION = 1
+FORMAT_RGBA8_SRGB = 0
+
+
+def face_direction(face, u, v):
+    one = np.ones_like(u)
+    return [
+        (one, -v, -u),  # +X
+        (-one, -v, u),  # -X
+        (u, one, v),    # +Y
+        (u, -one, -v),  # -Y
+        (u, -v, one),   # +Z
+        (-u, -v, -one), # -Z
+    ][face]
+
+
+def bake_face(image, face, face_size):
+    height, width = image.shape[:2]
+
+    # Texel coordinates in [-1, 1). No half texel offset, to match the engine.
+    coords = 2 * (np.arange(face_size, dtype=np.float32) / face_size) - 1
+    u, v = np.meshgrid(coords, coords)
+
+    x, y, z = face_direction(face, u, v)
+    length = np.sqrt(x * x + y * y + z * z)
+    x, y, z = x / length, y / length, z / length
+
+    theta = np.arccos(np.clip(y, -1, 1))
+    phi = np.arctan2(z, x)
+
+    # phi ranges from [-pi, pi] so correct it after dividing.
+    su = phi / (2 * np.pi)
+    su = np.where(su < 0, su + 1, su)
+    sv = theta / np.pi
+
+    su = np.clip(su * width, 0, width - 1).astype(np.float32)
+    sv = np.clip(sv * height, 0, height - 1).astype(np.float32)
+
+    # Bilinear interpolation
+    u1 = np.floor(su).astype(np.int64)
+    v1 = np.floor(sv).astype(np.int64)
+    u2 = np.minimum(u1 + 1, width - 1)
+    v2 = np.minimum(v1 + 1, height - 1)
+
+    s = (su - u1)[..., None]
+    t = (sv - v1)[..., None]
+
+    tl = image[v1, u1]
+    tr = image[v1, u2]
+    bl = image[v2, u1]
+    br = image[v2, u2]
+
+    top = tl + (tr - tl) * s
+    bottom = bl + (br - bl) * s
+    color = top + (bottom - top) * t
+
+    # Truncate like the C++ conversion does.
+    return color.astype(np.uint8)
+
+
+image = np.asarray(Image.open(args.input).convert('RGBA'), dtype=np.float32)
+face_size = image.shape[0]
+
+with open(args.output, 'wb') as out:
+    out.write(struct.pack('<4sIII', MAGIC, VERSION, face_size, FORMAT_RGBA8_SRGB))
+    for face in range(6):
+        out.write(bake_face(image, face, face_size).tobytes())
@@ -0,0 +1,245 @@
+import argparse
+import struct
+
+import numpy as np
+from PIL import Image
+
+# Block compresses an sRGB image with a full mip chain and writes it as a KTX2 file, so the engine can upload it
+# without decoding anything. See graphics/ktx2.hpp for what the engine accepts.
+#  bc1: RGB, 8 bytes per 4x4 block. Alpha is dropped.
+#  bc7: RGBA, 16 bytes per 4x4 block. Only mode 6 (one subset, 4-bit indices) is used.
+
+parser = argparse.ArgumentParser(prog='texture_compress')
+parser.add_argument('input') # source image
+parser.add_argument('-o', '--output') # .ktx2 output
+parser.add_argument('-f', '--format', choices=['bc1', 'bc7'], default='bc7')
+args = parser.parse_args()
+
+KTX2_IDENTIFIER = b'\xabKTX 20\xbb\r\n\x1a\n'
+
+# VkFormat values
+VK_FORMAT_BC1_RGB_SRGB_BLOCK = 132
+VK_FORMAT_BC7_SRGB_BLOCK = 146
+
+# Data format descriptor values, from the Khronos Data Format specification.
+KHR_DF_MODEL_BC1A = 128
+KHR_DF_MODEL_BC7 = 135
+KHR_DF_PRIMARIES_BT709 = 1
+KHR_DF_TRANSFER_SRGB = 2
+
+# Blocks are encoded this many at a time to keep the palette distance arrays small.
+CHUNK_SIZE = 4096
+
+
+def srgb_to_linear(c):
+    return np.where(c <= 0.04045, c / 12.92, ((c + 0.055) / 1.055) ** 2.4)
+
+
+def linear_to_srgb(c):
+    c = np.clip(c, 0, 1)
+    return np.where(c <= 0.0031308, c * 12.92, 1.055 * c ** (1 / 2.4) - 0.055)
+
+
+def downsample(image):
+    # 2x2 box filter, in linear space. An odd last row or column is dropped, like the blit chain in the engine.
+    height, width = image.shape[:2]
+    if height > 1:
+        image = image[:height // 2 * 2]
+        image = (image[0::2] + image[1::2]) / 2
+    if width > 1:
+        image = image[:, :width // 2 * 2]
+        image = (image[:, 0::2] + image[:, 1::2]) / 2
+    return image
+
+
+def to_blocks(image):
+    # Pads to a multiple of 4 by repeating the edge and splits into (block count, 16 texels, channels), row by row.
+    height, width, channels = image.shape
+    image = np.pad(image, ((0, -height % 4), (0, -width % 4), (0, 0)), mode='edge')
+    blocks_y, blocks_x = image.shape[0] // 4, image.shape[1] // 4
+    blocks = image.reshape(blocks_y, 4, blocks_x, 4, channels).transpose(0, 2, 1, 3, 4)
+    return blocks.reshape(blocks_y * blocks_x, 16, channels)
+
+
+def fit_endpoints(blocks):
+    # Endpoints at the extremes of each block's principal axis.
+    mean = blocks.mean(axis=1, keepdims=True)
+    centered = blocks - mean
+    covariance = np.einsum('nki,nkj->nij', centered, centered)
+
+    axis = blocks.max(axis=1) - blocks.min(axis=1)
+    for _ in range(8):
+        axis = np.einsum('nij,nj->ni', covariance, axis)
+        axis /= np.linalg.norm(axis, axis=1, keepdims=True) + 1e-9
+
+    projection = np.einsum('nkc,nc->nk', centered, axis)
+    low = mean[:, 0] + axis * projection.min(axis=1, keepdims=True)
+    high = mean[:, 0] + axis * projection.max(axis=1, keepdims=True)
+    return np.clip(low, 0, 255), np.clip(high, 0, 255)
+
+
+def nearest_index(blocks, palette):
+    # blocks: (n, 16, c), palette: (n, entries, c)
+    distance = ((blocks[:, :, None, :] - palette[:, None, :, :]) ** 2).sum(axis=-1)
+    return distance.argmin(axis=-1)
+
+
+def encode_bc1(blocks):
+    rgb = blocks[:, :, :3]
+    low, high = fit_endpoints(rgb)
+
+    def quantize(c):
+        q = np.round(c * [31 / 255, 63 / 255, 31 / 255]).astype(np.uint32)
+        return (q[:, 0] << 11) | (q[:, 1] << 5) | q[:, 2]
+
+    def expand(v):
+        r, g, b = (v >> 11) & 31, (v >> 5) & 63, v & 31
+        return np.stack([(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)], axis=-1).astype(np.float32)
+
+    # color0 > color1 selects the four color mode.
+    color0, color1 = quantize(high), quantize(low)
+    swap = color0 < color1
+    color0, color1 = np.where(swap, color1, color0), np.where(swap, color0, color1)
+
+    c0, c1 = expand(color0), expand(color1)
+    palette = np.stack([c0, c1, (2 * c0 + c1) / 3, (c0 + 2 * c1) / 3], axis=1)
+
+    indices = nearest_index(rgb, palette).astype(np.uint32)
+    # Equal endpoints would be the three color mode, where index 3 is black.
+    indices[color0 == color1] = 0
+
+    out = np.empty(len(blocks), dtype=[('color0', '<u2'), ('color1', '<u2'), ('indices', '<u4')])
+    out['color0'] = color0
+    out['color1'] = color1
+    out['indices'] = (indices << (2 * np.arange(16, dtype=np.uint32))).sum(axis=1, dtype=np.uint32)
+    return out.tobytes()
+
+
+BC7_WEIGHTS4 = np.array([0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64], dtype=np.int64)
+
+
+def encode_bc7(blocks):
+    low, high = fit_endpoints(blocks)
+
+    def quantize(e):
+        # 7 bits per channel plus a p-bit shared by the endpoint's channels. Pick the p-bit that fits best.
+        best_q, best_p, best_error = None, None, None
+        for p in (0, 1):
+            q = np.clip(np.round((e - p) / 2), 0, 127).astype(np.int64)
+            error = ((q * 2 + p - e) ** 2).sum(axis=1)
+            if best_error is None:
+                best_q, best_p, best_error = q, np.zeros(len(e), dtype=np.int64), error
+            else:
+                better = error < best_error
+                best_q = np.where(better[:, None], q, best_q)
+                best_p = np.where(better, 1, best_p)
+                best_error = np.minimum(error, best_error)
+        return best_q, best_p
+
+    q0, p0 = quantize(low)
+    q1, p1 = quantize(high)
+
+    e0 = q0 * 2 + p0[:, None]
+    e1 = q1 * 2 + p1[:, None]
+    w = BC7_WEIGHTS4[None, :, None]
+    palette = ((64 - w) * e0[:, None, :] + w * e1[:, None, :] + 32) >> 6
+
+    indices = nearest_index(blocks, palette.astype(np.float32))
+
+    # The first index only has 3 bits, so its top bit must be 0. Swapping the endpoints flips every index.
+    flip = indices[:, 0] >= 8
+    q0, q1 = np.where(flip[:, None], q1, q0), np.where(flip[:, None], q0, q1)
+    p0, p1 = np.where(flip, p1, p0), np.where(flip, p0, p1)
+    indices = np.where(flip[:, None], 15 - indices, indices)
+
+    lo = np.zeros(len(blocks), dtype=np.uint64)
+    hi = np.zeros(len(blocks), dtype=np.uint64)
+    position = 0
+
+    def put(values, bits):
+        nonlocal lo, hi, position
+        values = np.asarray(values).astype(np.uint64)
+        if position < 64:
+            lo |= values << np.uint64(position)
+            if position + bits > 64:
+                hi |= values >> np.uint64(64 - position)
+        else:
+            hi |= values << np.uint64(position - 64)
+        position += bits
+
+    put(np.full(len(blocks), 1 << 6), 7) # mode 6
+    for channel in range(4):
+        put(q0[:, channel], 7)
+        put(q1[:, channel], 7)
+    put(p0, 1)
+    put(p1, 1)
+    put(indices[:, 0], 3)
+    for texel in range(1, 16):
+        put(indices[:, texel], 4)
+    assert position == 128
+
+    return np.stack([lo, hi], axis=1).astype('<u8').tobytes()
+
+
+def encode_level(image, encode):
+    blocks = to_blocks(linear_to_srgb(image) * 255).astype(np.float32)
+    return b''.join(encode(blocks[i:i + CHUNK_SIZE]) for i in range(0, len(blocks), CHUNK_SIZE))
+
+
+def data_format_descriptor(color_model, block_bytes):
+    # A basic descriptor block with a single sample covering the whole compressed block.
+    sample = struct.pack('<HBB4BII', 0, block_bytes * 8 - 1, 0, 0, 0, 0, 0, 0, 0xFFFFFFFF)
+    block = struct.pack(
+        '<IHH4B4B8B',
+        0, 2, 24 + len(sample),
+        color_model, KHR_DF_PRIMARIES_BT709, KHR_DF_TRANSFER_SRGB, 0,
+        3, 3, 0, 0,
+        block_bytes, 0, 0, 0, 0, 0, 0, 0
+    ) + sample
+    return struct.pack('<I', 4 + len(block)) + block
+
+
+def align(value, alignment):
+    return (value + alignment - 1) // alignment * alignment
+
+
+if args.format == 'bc1':
+    vk_format, color_model, block_bytes, encode = VK_FORMAT_BC1_RGB_SRGB_BLOCK, KHR_DF_MODEL_BC1A, 8, encode_bc1
+else:
+    vk_format, color_model, block_bytes, encode = VK_FORMAT_BC7_SRGB_BLOCK, KHR_DF_MODEL_BC7, 16, encode_bc7
+
+image = srgb_to_linear(np.asarray(Image.open(args.input).convert('RGBA'), dtype=np.float32) / 255)
+height, width = image.shape[:2]
+
+levels = [encode_level(image, encode)]
+while image.shape[0] > 1 or image.shape[1] > 1:
+    image = downsample(image)
+    levels.append(encode_level(image, encode))
+
+dfd = data_format_descriptor(color_model, block_bytes)
+
+header_size = 80
+level_index_size = 24 * len(levels)
+dfd_offset = header_size + level_index_size
+
+# Levels are stored smallest first, each aligned to the block size.
+level_offsets = [0] * len(levels)
+offset = dfd_offset + len(dfd)
+for level in reversed(range(len(levels))):
+    offset = align(offset, block_bytes)
+    level_offsets[level] = offset
+    offset += len(levels[level])
+
+with open(args.output, 'wb') as out:
+    out.write(struct.pack(
+        '<12s9I',
+        KTX2_IDENTIFIER, vk_format, 1, width, height, 0, 0, 1, len(levels), 0
+    ))
+    out.write(struct.pack('<4I2Q', dfd_offset, len(dfd), 0, 0, 0, 0))
+    for level in range(len(levels)):
+        out.write(struct.pack('<3Q', level_offsets[level], len(levels[level]), len(levels[level])))
+    out.write(dfd)
+
+    for level in reversed(range(len(levels))):
+        out.write(b'\0' * (level_offsets[level] - out.tell()))
+        out.write(levels[level])
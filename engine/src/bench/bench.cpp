@@ -0,0 +1,33 @@
+#include "bench.hpp"
+
+// Function local so benchmarks registering during static initialization don't depend on initialization order.
+static std::vector<Benchmark>& registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+bool register_benchmark(const Benchmark& benchmark) {
+    auto& benchmarks = registry();
+    auto it = std::ranges::upper_bound(benchmarks, benchmark.name, {}, &Benchmark::name);
+    benchmarks.insert(it, benchmark);
+    return true;
+}
+
+std::span<const Benchmark> benchmarks() {
+    return registry();
+}
+
+bool run_benchmark(std::string_view name) {
+    bool found = false;
+
+    for (const auto& benchmark : registry()) {
+        if (name != "all" && benchmark.name != name)
+            continue;
+
+        spdlog::info("running benchmark {}: {}", benchmark.name, benchmark.description);
+        benchmark.run();
+        found = true;
+    }
+
+    return found;
+}
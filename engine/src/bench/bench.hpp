@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <span>
+
+/// A micro-benchmark that can be run with `engine-main --bench <name>`.
+struct Benchmark {
+    std::string_view name;
+    std::string_view description;
+    void (*run)();
+};
+
+/// Adds a benchmark to the registry. Use ENGINE_BENCHMARK instead of calling this directly.
+bool register_benchmark(const Benchmark& benchmark);
+
+/// Every registered benchmark, sorted by name.
+std::span<const Benchmark> benchmarks();
+
+/// Runs the benchmark called `name`, or all of them for "all". Returns false if there is no such benchmark.
+bool run_benchmark(std::string_view name);
+
+/// Keeps the compiler from optimizing away the computation of `value`.
+template <class T>
+inline void bench_do_not_optimize(const T& value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    static volatile const T* sink;
+    sink = &value;
+#else
+    asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+/// Calls `fn` until `min_time` has passed (and at least `min_iterations` times), returning the fastest call.
+template <class Fn>
+std::chrono::duration<f64, std::milli> bench_measure(Fn&& fn, std::chrono::milliseconds min_time = 200ms, usize min_iterations = 3) {
+    using clock = std::chrono::steady_clock;
+
+    auto best = clock::duration::max();
+    auto start = clock::now();
+    for (usize i = 0; i < min_iterations || clock::now() - start < min_time; i++) {
+        auto call_start = clock::now();
+        fn();
+        best = std::min(best, clock::now() - call_start);
+    }
+
+    return best;
+}
+
+/// Defines a benchmark function and registers it under NAME.
+#define ENGINE_BENCHMARK(NAME, DESCRIPTION) \
+    static void bench_##NAME(); \
+    [[maybe_unused]] static const bool bench_##NAME##_registered = register_benchmark({ #NAME, DESCRIPTION, &bench_##NAME }); \
+    static void bench_##NAME()
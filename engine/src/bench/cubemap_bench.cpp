@@ -0,0 +1,61 @@
+#include "bench.hpp"
+
+#include "../graphics/cubemap.hpp"
+#include "../job_system.hpp"
+
+ENGINE_BENCHMARK(cubemap, "equirectangular to cubemap conversion, reference vs. multithreaded") {
+    std::mt19937 rng(1234);
+    JobSystem jobs;
+
+    for (u32 width : { 2048u, 4096u, 8192u }) {
+        const u32 height = width / 2;
+
+        // Smooth gradients with some noise, so filtering has something to do.
+        std::vector<u8> image((usize) width * height * 4);
+        std::uniform_int_distribution<u32> noise(0, 31);
+        for (u32 y = 0; y < height; y++) {
+            for (u32 x = 0; x < width; x++) {
+                u8* pixel = &image[((usize) y * width + x) * 4];
+                pixel[0] = (u8) (x * 255 / width) ^ noise(rng);
+                pixel[1] = (u8) (y * 255 / height) ^ noise(rng);
+                pixel[2] = (u8) ((x + y) * 127 / height);
+                pixel[3] = 255;
+            }
+        }
+
+        CubemapFaces reference;
+        auto reference_time = bench_measure([&] {
+            reference = equirect_to_cubemap_reference(image.data(), width, height);
+        }, 0ms, 1);
+
+        CubemapFaces single_threaded;
+        auto single_threaded_time = bench_measure([&] {
+            single_threaded = equirect_to_cubemap(image.data(), width, height);
+        }, 0ms, 2);
+
+        CubemapFaces faces;
+        auto time = bench_measure([&] {
+            faces = equirect_to_cubemap(image.data(), width, height, &jobs);
+        }, 0ms, 3);
+
+        // The fast path uses an approximate atan2 (off by about a hundredth of a texel at 8K) and 16 bit fixed point
+        // filter weights. Both results are truncated, so a channel sitting right on a boundary can come out one lower or
+        // higher than the reference. Anything off by more than 1 is a bug, so `off_texels` should stay at 0.
+        u32 max_error = 0;
+        usize off_texels = 0;
+        for (usize i = 0; i < faces.data.size(); i++) {
+            u32 error = (u32) std::abs((i32) faces.data[i] - (i32) reference.data[i]);
+            max_error = std::max(max_error, error);
+            off_texels += error > 1;
+        }
+
+        spdlog::info(
+            "{}x{}: reference {:.1f} ms, 1 thread {:.1f} ms ({:.1f}x), {} threads {:.1f} ms ({:.1f}x), max error {} ({} channels off by more than 1)",
+            width, height,
+            reference_time.count(),
+            single_threaded_time.count(), reference_time / single_threaded_time,
+            jobs.thread_count(), time.count(), reference_time / time,
+            max_error, off_texels
+        );
+    }
+}
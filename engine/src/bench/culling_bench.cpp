@@ -0,0 +1,62 @@
+#include "bench.hpp"
+
+#include "../camera.hpp"
+#include "../graphics/culling.hpp"
+
+ENGINE_BENCHMARK(culling, "CPU frustum culling throughput for each SIMD backend") {
+    Camera camera({ 0, 0, 0 }, 10, 30, 70);
+    camera.set_aspect_ratio(16.f / 9.f);
+    camera.update_rot();
+    camera.update_matrices();
+
+    const auto frustum = Frustum::from_matrix(camera.proj_mtx() * camera.view_mtx());
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<f32> pos_dist(-500, 500);
+    std::uniform_real_distribution<f32> size_dist(0.5, 4);
+
+    for (usize object_count : { 1'000uz, 100'000uz, 1'000'000uz }) {
+        std::vector<f32> x(object_count), y(object_count), z(object_count), radius(object_count);
+        std::vector<f32> max_x(object_count), max_y(object_count), max_z(object_count);
+
+        for (usize i = 0; i < object_count; i++) {
+            x[i] = pos_dist(rng);
+            y[i] = pos_dist(rng);
+            z[i] = pos_dist(rng);
+            radius[i] = size_dist(rng);
+
+            // Boxes share the spheres' data: min is the sphere center and max is offset by the radius.
+            max_x[i] = x[i] + radius[i];
+            max_y[i] = y[i] + radius[i];
+            max_z[i] = z[i] + radius[i];
+        }
+
+        CullSpheres spheres{ x, y, z, radius };
+        CullAabbs aabbs{ x, y, z, max_x, max_y, max_z };
+        std::vector<u32> visible(object_count);
+
+        for (auto backend : { CullBackend::Scalar, CullBackend::Sse, CullBackend::Avx2 }) {
+            if (!cull_backend_supported(backend))
+                continue;
+
+            usize visible_spheres = 0;
+            auto sphere_time = bench_measure([&] {
+                visible_spheres = cull_spheres(frustum, spheres, visible.data(), backend);
+                bench_do_not_optimize(visible.data());
+            });
+
+            usize visible_aabbs = 0;
+            auto aabb_time = bench_measure([&] {
+                visible_aabbs = cull_aabbs(frustum, aabbs, visible.data(), backend);
+                bench_do_not_optimize(visible.data());
+            });
+
+            spdlog::info(
+                "{:>8} objects {:>6}: spheres {:>10.0f} objects/ms ({} visible), AABBs {:>10.0f} objects/ms ({} visible)",
+                object_count, cull_backend_name(backend),
+                object_count / sphere_time.count(), visible_spheres,
+                object_count / aabb_time.count(), visible_aabbs
+            );
+        }
+    }
+}
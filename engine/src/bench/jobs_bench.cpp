@@ -0,0 +1,130 @@
+#include "bench.hpp"
+
+#include "../job_system.hpp"
+
+ENGINE_BENCHMARK(jobs, "job system scheduling overhead per job") {
+    JobSystem jobs;
+    spdlog::info("{} threads", jobs.thread_count());
+
+    constexpr usize JOB_COUNT = 100'000;
+
+    // Empty jobs, so all that's measured is scheduling, stealing and finishing them.
+    {
+        auto time = bench_measure([&] {
+            std::vector<JobHandle> handles;
+            handles.reserve(JOB_COUNT);
+            for (usize i = 0; i < JOB_COUNT; i++)
+                handles.push_back(jobs.schedule([] {}));
+            for (const auto& handle : handles)
+                jobs.wait(handle);
+        });
+
+        spdlog::info("independent jobs:     {:>8.1f} ns per job", time.count() * 1e6 / JOB_COUNT);
+    }
+
+    // One job per index, the worst case for a parallel for.
+    {
+        std::atomic<usize> sum = 0;
+        auto time = bench_measure([&] {
+            jobs.parallel_for(JOB_COUNT, 1, [&](usize first, usize last) {
+                sum.fetch_add(last - first, std::memory_order_relaxed);
+            });
+        });
+        bench_do_not_optimize(sum.load());
+
+        spdlog::info("parallel for chunks:  {:>8.1f} ns per chunk", time.count() * 1e6 / JOB_COUNT);
+    }
+
+    // Every job depends on the one before it, so nothing can run in parallel and each one has to wake the next.
+    {
+        auto time = bench_measure([&] {
+            JobHandle last;
+            for (usize i = 0; i < JOB_COUNT; i++)
+                last = jobs.schedule([] {}, { &last, 1 });
+            jobs.wait(last);
+        });
+
+        spdlog::info("dependency chain:     {:>8.1f} ns per job", time.count() * 1e6 / JOB_COUNT);
+    }
+
+    // For scale: doing the same with a thread per job.
+    {
+        constexpr usize THREAD_COUNT = 1'000;
+        auto time = bench_measure([&] {
+            for (usize i = 0; i < THREAD_COUNT; i++)
+                std::jthread([] {});
+        });
+
+        spdlog::info("thread per job:       {:>8.1f} ns per thread", time.count() * 1e6 / THREAD_COUNT);
+    }
+}
+
+ENGINE_BENCHMARK(jobs_stress, "job system stress test, random dependency graphs checked for ordering") {
+    std::mt19937 rng(1234);
+
+    for (u32 round = 0; round < 20; round++) {
+        // A fresh JobSystem every round so startup and shutdown get exercised too.
+        // At least a few threads even on small machines, being oversubscribed only makes for more interleavings.
+        JobSystem jobs(round % 4 == 0 ? 2 : std::max(std::thread::hardware_concurrency(), 4u));
+
+        constexpr usize JOB_COUNT = 20'000;
+        std::vector<JobHandle> handles(JOB_COUNT);
+        std::vector<std::atomic<u32>> run_count(JOB_COUNT);
+        std::vector<std::vector<usize>> dependencies(JOB_COUNT);
+        std::atomic<usize> failures = 0;
+        std::atomic<usize> children_run = 0;
+        std::atomic<usize> wrong_thread = 0;
+
+        for (usize i = 0; i < JOB_COUNT; i++) {
+            // Depend on up to 3 earlier jobs.
+            std::vector<JobHandle> job_dependencies;
+            if (i > 0) {
+                std::uniform_int_distribution<usize> dependency_dist(0, i - 1);
+                for (usize d = rng() % 4; d > 0; d--) {
+                    dependencies[i].push_back(dependency_dist(rng));
+                    job_dependencies.push_back(handles[dependencies[i].back()]);
+                }
+            }
+
+            const auto affinity = rng() % 16 == 0 ? JobAffinity::MainThread : JobAffinity::Any;
+            const bool spawn_child = rng() % 8 == 0;
+
+            handles[i] = jobs.schedule([&, i, affinity, spawn_child] {
+                for (usize dependency : dependencies[i]) {
+                    if (run_count[dependency].load() != 1)
+                        failures++;
+                }
+                if (affinity == JobAffinity::MainThread && jobs.current_thread() != 0)
+                    wrong_thread++;
+
+                // Jobs scheduling and waiting on jobs of their own.
+                if (spawn_child) {
+                    auto child = jobs.schedule([&] { children_run++; });
+                    jobs.wait(child);
+                }
+
+                run_count[i]++;
+            }, job_dependencies, affinity);
+        }
+
+        for (const auto& handle : handles)
+            jobs.wait(handle);
+
+        // A parallel for that throws.
+        bool caught = false;
+        try {
+            jobs.parallel_for(1000, 7, [](usize first, usize) {
+                if (first == 994)
+                    throw std::runtime_error("expected");
+            });
+        } catch (const std::runtime_error&) {
+            caught = true;
+        }
+
+        usize not_run_once = std::ranges::count_if(run_count, [](const auto& count) { return count.load() != 1; });
+        if (failures > 0 || not_run_once > 0 || wrong_thread > 0 || !caught)
+            throw std::runtime_error("job system stress test failed");
+
+        spdlog::info("round {}: {} threads, {} jobs and {} children ran in order", round, jobs.thread_count(), JOB_COUNT, children_run.load());
+    }
+}
@@ -0,0 +1,133 @@
+#include "bench.hpp"
+
+#include "../scene.hpp"
+
+namespace {
+
+// What a scene object used to look like: transform, cached matrix and render data all in one struct.
+struct AosObject {
+    glm::vec3 pos;
+    glm::quat rot;
+    glm::mat4x4 model;
+    RenderProxy proxy;
+    ObjectMobility mobility;
+    bool dirty;
+};
+
+}
+
+ENGINE_BENCHMARK(scene, "Scene transform updates, structure-of-arrays vs one struct per object") {
+    constexpr usize OBJECT_COUNT = 1'000'000;
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<f32> pos_dist(-500, 500);
+    std::uniform_real_distribution<f32> angle_dist(0, 2 * std::numbers::pi_v<f32>);
+
+    Scene scene;
+    scene.reserve(OBJECT_COUNT);
+    std::vector<AosObject> aos_objects;
+    aos_objects.reserve(OBJECT_COUNT);
+
+    for (usize i = 0; i < OBJECT_COUNT; i++) {
+        glm::vec3 pos{ pos_dist(rng), pos_dist(rng), pos_dist(rng) };
+        auto rot = glm::angleAxis(angle_dist(rng), glm::vec3{ 0, 1, 0 });
+        RenderProxy proxy{ .bounds = { 0, 0, 0, 0.8660254f } };
+
+        scene.add(pos, rot, ObjectMobility::Dynamic, proxy);
+        aos_objects.push_back({ .pos = pos, .rot = rot, .model = model_matrix(pos, rot), .proxy = proxy, .mobility = ObjectMobility::Dynamic, .dirty = false });
+    }
+    scene.update_matrices();
+    scene.clear_dirty();
+
+    spdlog::info("{} objects, {} bytes per object in one struct", OBJECT_COUNT, sizeof(AosObject));
+
+    // Reading every position, like rebuilding culling bounds does.
+    {
+        auto aos_time = bench_measure([&] {
+            glm::vec3 sum{};
+            for (const auto& object : aos_objects)
+                sum += object.pos;
+            bench_do_not_optimize(sum);
+        });
+
+        auto soa_time = bench_measure([&] {
+            glm::vec3 sum{};
+            for (const auto& pos : scene.positions())
+                sum += pos;
+            bench_do_not_optimize(sum);
+        });
+
+        spdlog::info("position sweep:   one struct {:>8.3f} ms, SoA {:>8.3f} ms", aos_time.count(), soa_time.count());
+    }
+
+    // Rebuilding every model matrix.
+    {
+        auto aos_time = bench_measure([&] {
+            for (auto& object : aos_objects)
+                object.model = model_matrix(object.pos, object.rot);
+            bench_do_not_optimize(aos_objects.data());
+        });
+
+        std::vector<glm::mat4x4> matrices(OBJECT_COUNT);
+        auto soa_time = bench_measure([&] {
+            compute_model_matrices(scene.positions(), scene.rotations(), matrices);
+            bench_do_not_optimize(matrices.data());
+        });
+
+        spdlog::info("matrix rebuild:   one struct {:>8.3f} ms, SoA {:>8.3f} ms", aos_time.count(), soa_time.count());
+    }
+
+    // Moving a fraction of the objects through their handles, then updating only what changed.
+    for (usize moved_count : { 1'000uz, 100'000uz, OBJECT_COUNT }) {
+        const auto spin = glm::angleAxis(0.01f, glm::vec3{ 0, 1, 0 });
+
+        auto aos_time = bench_measure([&] {
+            for (usize i = 0; i < moved_count; i++) {
+                auto& object = aos_objects[i * (OBJECT_COUNT / moved_count)];
+                object.rot = spin * object.rot;
+                object.dirty = true;
+            }
+            for (auto& object : aos_objects) {
+                if (object.dirty) {
+                    object.model = model_matrix(object.pos, object.rot);
+                    object.dirty = false;
+                }
+            }
+            bench_do_not_optimize(aos_objects.data());
+        });
+
+        auto soa_time = bench_measure([&] {
+            for (usize i = 0; i < moved_count; i++) {
+                auto handle = scene.handle_of((u32) (i * (OBJECT_COUNT / moved_count)));
+                const u32 index = scene.index_of(handle);
+                scene.set_transform(handle, scene.positions()[index], spin * scene.rotations()[index]);
+            }
+            scene.update_matrices();
+            scene.clear_dirty();
+            bench_do_not_optimize(scene.matrices().data());
+        });
+
+        spdlog::info("{:>7} moved:    one struct {:>8.3f} ms, SoA {:>8.3f} ms", moved_count, aos_time.count(), soa_time.count());
+    }
+
+    // Handle churn: removing and re-adding objects.
+    {
+        constexpr usize CHURN_COUNT = 100'000;
+
+        auto time = bench_measure([&] {
+            for (usize i = 0; i < CHURN_COUNT; i++) {
+                auto handle = scene.handle_of((u32) (rng() % scene.size()));
+                const u32 index = scene.index_of(handle);
+                const auto pos = scene.positions()[index];
+                const auto rot = scene.rotations()[index];
+                const auto proxy = scene.proxies()[index];
+
+                scene.remove(handle);
+                scene.add(pos, rot, ObjectMobility::Static, proxy);
+            }
+            scene.clear_dirty();
+        });
+
+        spdlog::info("remove + add:     {:>8.0f} objects/ms", CHURN_COUNT / time.count());
+    }
+}
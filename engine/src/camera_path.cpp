@@ -0,0 +1,34 @@
+#include "camera_path.hpp"
+
+#include <cmath>
+
+CameraPath::CameraPath(std::vector<glm::vec3> points, f32 duration) :
+    m_points(std::move(points)), m_duration(duration) {
+    if (m_points.size() < 2)
+        throw std::runtime_error("a camera path needs at least 2 points");
+}
+
+glm::vec3 CameraPath::position(f64 time) const {
+    const usize count = m_points.size();
+
+    // Which segment we're on and how far along it, with the loop wrapped around.
+    const f64 loops = time / m_duration;
+    const f64 t = (loops - std::floor(loops)) * count;
+    const auto segment = std::min((usize) t, count - 1);
+    const auto u = (f32) (t - segment);
+
+    const auto& p0 = m_points[(segment + count - 1) % count];
+    const auto& p1 = m_points[segment];
+    const auto& p2 = m_points[(segment + 1) % count];
+    const auto& p3 = m_points[(segment + 2) % count];
+
+    // Uniform Catmull-Rom: passes through p1 at u = 0 and p2 at u = 1, with tangents from the neighbouring points.
+    const f32 u2 = u * u;
+    const f32 u3 = u2 * u;
+    return 0.5f * (
+        2.f * p1 +
+        (p2 - p0) * u +
+        (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * u2 +
+        (3.f * p1 - p0 - 3.f * p2 + p3) * u3
+    );
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+/// A closed Catmull-Rom spline through a loop of points, for flying the camera along a scripted route.
+/// It goes through every point and takes the same time from each one to the next.
+class CameraPath {
+public:
+    CameraPath() = default;
+    /// Takes `duration` seconds to go all the way around. Needs at least 2 points.
+    CameraPath(std::vector<glm::vec3> points, f32 duration);
+
+    /// Where the path is `time` seconds in, wrapping around after duration().
+    [[nodiscard]] glm::vec3 position(f64 time) const;
+
+public:     // Getters
+    [[nodiscard]] bool empty() const { return m_points.empty(); }
+    [[nodiscard]] f32 duration() const { return m_duration; }
+    [[nodiscard]] const auto& points() const { return m_points; }
+
+private:
+    std::vector<glm::vec3> m_points;
+    f32 m_duration = 0;
+};
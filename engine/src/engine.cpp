@@ -2,12 +2,28 @@
 
 #include "assets.hpp"
 
+#include "graphics/cubemap.hpp"
+
 #include "util/imgui.hpp"
+#include "util/paths.hpp"
+#include "util/profiler.hpp"
+#include "util/stats.hpp"
 #include "util/stb.hpp"
 
 #include <imgui_impl_sdl3.h>
 #include <imgui_impl_vulkan.h>
 
+#include <bit>
+
+// Size in bytes of the first `mip_levels` levels of an RGBA8 image.
+static u64 mip_chain_size(u32 width, u32 height, u32 mip_levels) {
+    u64 size = 0;
+    for (u32 level = 0; level < mip_levels; level++) {
+        size += (u64) std::max(width >> level, 1u) * std::max(height >> level, 1u) * 4;
+    }
+    return size;
+}
+
 struct Vertex {
     glm::vec3 pos;
     glm::vec2 tex_coord;
@@ -137,114 +153,430 @@ struct CameraUBO {
     glm::mat4x4 proj;
 };
 
-struct CubeUBO {
-    glm::mat4x4 model;
+// The unit cube's bounding sphere.
+constexpr glm::vec4 CUBE_BOUNDS = { 0, 0, 0, 0.8660254f };
+
+struct CullPushConstants {
+    glm::mat4x4 view_proj;
+    u32 object_count;
 };
 
+static glm::quat random_rotation(std::mt19937& mt) {
+    std::uniform_real_distribution<f32> rot_dist(0, 1);
+
+    // Generates a uniformly distributed quaternion. Not gonna pretend like I have the slightest idea as to how the hell this works
+    // https://stackoverflow.com/a/44031492
+    constexpr auto PI = std::numbers::pi_v<f32>;
+    f32 u = rot_dist(mt);
+    f32 v = rot_dist(mt);
+    f32 w = rot_dist(mt);
+    return {
+        std::sqrtf(1 - u) * sinf(2 * PI * v),
+        std::sqrtf(1 - u) * cosf(2 * PI * v),
+        std::sqrtf(u) * sinf(2 * PI * w),
+        std::sqrtf(u) * cosf(2 * PI * w)
+    };
+}
+
+// `str` as a JSON string literal.
+static std::string json_string(std::string_view str) {
+    std::string out = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    out += '"';
+    return out;
+}
+
 #ifdef DEBUG_BUILD
 constexpr bool ENABLE_VALIDATION_LAYERS = true;
 #else
 constexpr bool ENABLE_VALIDATION_LAYERS = false;
 #endif
 
-void Engine::start() {
+void Engine::start(const EngineConfig& config) {
+    PROFILE_SCOPE("start");
+
     spdlog::info("starting engine");
 
     const auto start = std::chrono::steady_clock::now();
 
-    if (!sdl3_init())
-        throw std::runtime_error("Failed to initialize SDL");
+    m_config = config;
+
+    // Benchmarks measure how fast we can render, not the display's refresh rate.
+    if (m_config.benchmark)
+        m_settings.vsync = false;
+
+    // Headless there's no window, so SDL isn't needed at all and no display server has to be around.
+    if (m_config.headless) {
+        m_window_width = m_config.width;
+        m_window_height = m_config.height;
+    } else {
+        if (!sdl3_init())
+            throw std::runtime_error("Failed to initialize SDL");
+
+        init_window();
+    }
 
-    init_window();
     init_graphics();
-    init_imgui();
+    if (!m_config.headless)
+        init_imgui();
     init_scene();
 
-    SDL_ShowWindow(m_window);
-    SDL_SetWindowRelativeMouseMode(m_window, true);
+    if (!m_config.headless) {
+        SDL_ShowWindow(m_window);
+        SDL_SetWindowRelativeMouseMode(m_window, true);
+    }
 
     // Calculate initialization time.
     const auto end = std::chrono::steady_clock::now();
     f32 ms = std::chrono::duration_cast<std::chrono::duration<f32, std::milli>>(end - start).count();
     spdlog::info("startup complete ({:.3f} ms)", ms);
+
+    // Don't make the first frame catch up on the time spent starting up.
+    m_last_update = end;
 }
 
 void Engine::run() {
+    PROFILE_SCOPE("run");
+
+    m_last_frame_end = std::chrono::steady_clock::now();
+    m_last_frame_start = m_last_frame_end;
+    m_render_thread = std::jthread([this] { render_loop(); });
+
+    const auto run_start = std::chrono::steady_clock::now();
+
+    // Benchmarks render their warm-up frames on top of the measured ones.
+    const u64 total_frames = m_config.frame_count + (m_config.benchmark ? m_config.warmup_frames : 0);
+
+    try {
+        bool should_quit = false;
+
+        while (!should_quit) {
+            profiler_mark_frame();
+            PROFILE_SCOPE("frame");
+
+            const auto frame_start = std::chrono::steady_clock::now();
+            m_frame_time = frame_start - m_last_frame_start;
+            m_last_frame_start = frame_start;
+
+            if (!m_config.headless)
+                should_quit = poll_events();
+
+            // Whatever jobs left for the main thread since last time.
+            m_jobs.run_main_thread_jobs();
+
+            auto start = std::chrono::steady_clock::now();
+            update();
+            m_update_time = std::chrono::steady_clock::now() - start;
+
+            if (m_config.benchmark && m_frames_submitted >= m_config.warmup_frames)
+                m_benchmark_samples.update.push_back(m_update_time.count());
+
+            // Waits for the render thread only if it's still on the frame before last.
+            submit_frame_packet();
+
+            if (m_config.frame_count > 0 && m_frames_submitted >= total_frames)
+                should_quit = true;
+
+            if (m_render_failed.load(std::memory_order_acquire))
+                std::rethrow_exception(m_render_error);
+        }
+    } catch (...) {
+        // The render thread has to be stopped before anything it uses is torn down.
+        stop_render_thread();
+        throw;
+    }
+
+    stop_render_thread();
+
+    if (m_config.frame_count > 0) {
+        // Every frame has to be finished on the GPU for the time to mean anything.
+        vkDeviceWaitIdle(device());
+
+        const std::chrono::duration<f64> total = std::chrono::steady_clock::now() - run_start;
+        spdlog::info("rendered {} frames in {:.3f} s: {:.3f} ms per frame ({:.1f} FPS)",
+            m_frames_submitted, total.count(), total.count() * 1000.0 / m_frames_submitted, m_frames_submitted / total.count());
+    }
+
+    if (m_config.benchmark) {
+        // The last frames' timestamps were never read, their slots didn't come around again.
+        for (usize frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+            read_gpu_times(frame);
+
+        write_benchmark_results();
+    }
+
+    quit();
+}
+
+bool Engine::poll_events() {
+    PROFILE_SCOPE("poll_events");
+
     bool should_quit = false;
 
-    while (!should_quit) {
-        // Poll window events before rendering. (why is this not bound to the window?)
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            // Pass the event to imgui to handle IO
-            ImGui_ImplSDL3_ProcessEvent(&event);
+    // Poll window events before rendering. (why is this not bound to the window?)
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        // Pass the event to imgui to handle IO
+        ImGui_ImplSDL3_ProcessEvent(&event);
+
+        switch (event.type) {
+        case SDL_EVENT_QUIT:
+        case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
+            should_quit = true;
+            break;
+        case SDL_EVENT_KEY_DOWN: {
+            auto& key_event = event.key;
 
-            switch (event.type) {
-            case SDL_EVENT_QUIT:
-            case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
+            switch (key_event.key) {
+            case SDLK_Q:
                 should_quit = true;
                 break;
-            case SDL_EVENT_KEY_DOWN: {
-                auto& key_event = event.key;
+            case SDLK_ESCAPE:
+                m_grab_mouse = !m_grab_mouse;
+                SDL_SetWindowRelativeMouseMode(m_window, m_grab_mouse);
+                break;
+            case SDLK_F9:
+                write_trace();
+                break;
+            }
+        } break;
+        case SDL_EVENT_MOUSE_MOTION: {
+            auto& motion_event = event.motion;
 
-                switch (key_event.key) {
-                case SDLK_Q:
-                    should_quit = true;
-                    break;
-                case SDLK_ESCAPE:
-                    m_grab_mouse = !m_grab_mouse;
-                    SDL_SetWindowRelativeMouseMode(m_window, m_grab_mouse);
-                    break;
-                }
-            } break;
-            case SDL_EVENT_MOUSE_MOTION: {
-                auto& motion_event = event.motion;
+            // If mouse is grabbed, do camera look
+            if (m_grab_mouse) {
+                f32 x_rel = motion_event.xrel;
+                f32 y_rel = motion_event.yrel;
+
+                f32 x_degrees = x_rel * 0.1;
+                f32 y_degrees = y_rel * -0.1; // y_rel goes downwards in window space
+
+                m_camera.set_yaw(m_camera.yaw() + x_degrees);
+
+                // Clamp the pitch so the camera doesn't go upside down.
+                f32 new_pitch = m_camera.pitch() + y_degrees;
+                new_pitch = std::clamp(new_pitch, -90.f, 90.f);
+                m_camera.set_pitch(new_pitch);
+
+                m_camera.update_rot();
+            }
+        } break;
+        case SDL_EVENT_WINDOW_RESIZED: {
+            auto& window_event = event.window;
+
+            m_window_width = (u32) window_event.data1;
+            m_window_height = (u32) window_event.data2;
+            m_window_resized = true;
+        } break;
+        default:
+            break;
+        }
+    }
+
+    return should_quit;
+}
+
+void Engine::submit_frame_packet() {
+    PROFILE_SCOPE("submit_frame_packet");
+
+    auto& packet = [&]() -> FramePacket& {
+        // Only takes time when the render thread is behind.
+        PROFILE_SCOPE("wait for render thread");
+        return m_frame_packets.begin_write();
+    }();
+
+    // The render thread is done with this packet, so its stats are the latest finished frame's.
+    m_render_stats = packet.stats;
+
+    // Each finished frame's times are only taken once. The first packets haven't been rendered yet.
+    if (packet.stats.rendered) {
+        const auto& stats = packet.stats;
+        m_frame_stats.push({
+            .frame = (f32) m_frame_time.count(),
+            .update = (f32) m_update_time.count(),
+            .record = (f32) stats.record_time.count(),
+            .fence_wait = (f32) stats.fence_wait_time.count(),
+            .acquire = (f32) stats.acquire_time.count(),
+            .submit = (f32) stats.submit_time.count(),
+            .present = (f32) stats.present_time.count(),
+            .gpu = (f32) stats.gpu_time.count(),
+        });
+        packet.stats.rendered = false;
+    }
+
+    if (m_window_resized) {
+        // We update window size in the SDL resize event, but let's double check
+        // that it's correct in case the state somehow gets out of sync
+        int width, height;
+        SDL_GetWindowSizeInPixels(m_window, &width, &height);
+        m_window_width = (u32) width;
+        m_window_height = (u32) height;
+    }
+
+    // Headless there's no UI to build, the packet's draw data is never looked at.
+    if (!m_config.headless)
+        build_imgui(packet);
+
+    packet.quit = false;
+    packet.window_width = m_window_width;
+    packet.window_height = m_window_height;
+    packet.window_resized = m_window_resized;
+    // Looking around isn't ticked, only the position lags behind by up to a tick.
+    packet.camera = m_camera;
+    packet.camera.set_pos(glm::mix(m_previous_camera_pos, m_camera.pos(), m_tick_alpha));
+    packet.settings = m_settings;
+    packet.start_record_benchmark = m_start_record_benchmark;
+    m_window_resized = false;
+    m_start_record_benchmark = false;
+
+    // This also sorts the dirty objects, so the render thread can coalesce neighbours into a single copy.
+    m_scene.update_matrices(&m_jobs);
+
+    const auto dirty_objects = m_scene.dirty_objects();
+    const auto matrices = m_scene.matrices();
+    const auto proxies = m_scene.proxies();
+
+    packet.object_count = m_scene.size();
+    packet.dirty_objects.assign(dirty_objects.begin(), dirty_objects.end());
+    packet.dirty_object_data.resize(dirty_objects.size());
+    for (usize i = 0; i < dirty_objects.size(); i++) {
+        const u32 index = dirty_objects[i];
+        packet.dirty_object_data[i] = {
+            .model = matrices[index],
+            .bounds = proxies[index].bounds
+        };
+    }
 
-                // If mouse is grabbed, do camera look
-                if (m_grab_mouse) {
-                    f32 x_rel = motion_event.xrel;
-                    f32 y_rel = motion_event.yrel;
+    m_scene.clear_dirty();
 
-                    f32 x_degrees = x_rel * 0.1;
-                    f32 y_degrees = y_rel * -0.1; // y_rel goes downwards in window space
+    m_frame_packets.end_write();
+    m_frames_submitted++;
+}
+
+void Engine::stop_render_thread() {
+    if (!m_render_thread.joinable())
+        return;
+
+    auto& packet = m_frame_packets.begin_write();
+    packet.quit = true;
+    m_frame_packets.end_write();
 
-                    m_camera.set_yaw(m_camera.yaw() + x_degrees);
+    m_render_thread.join();
+}
+
+void Engine::render_loop() {
+    profiler_set_thread_name("render");
 
-                    // Clamp the pitch so the camera doesn't go upside down.
-                    f32 new_pitch = m_camera.pitch() + y_degrees;
-                    new_pitch = std::clamp(new_pitch, -90.f, 90.f);
-                    m_camera.set_pitch(new_pitch);
+    while (true) {
+        auto& packet = m_frame_packets.begin_read();
+        if (packet.quit) {
+            m_frame_packets.end_read();
+            return;
+        }
 
-                    m_camera.update_rot();
+        // After an error, packets are only handed back until the main thread notices and sends the quit packet.
+        if (!m_render_failed.load(std::memory_order_relaxed)) {
+            try {
+                PROFILE_SCOPE("render thread frame");
+                auto start = std::chrono::steady_clock::now();
+
+                m_frame_packet = &packet;
+                apply_frame_packet();
+                update_graphics();
+                m_frame_packet = nullptr;
+
+                auto& stats = packet.stats;
+                stats.visible_objects = m_visible_objects;
+                stats.transforms_written = m_transforms_written;
+                stats.draw_items = scene_draw_items();
+                stats.cpu_cull_time = m_cpu_cull_time;
+                stats.record_time = m_record_time;
+
+                const auto end = std::chrono::steady_clock::now();
+                stats.render_time = end - start;
+                const auto gpu_times = m_gpu_profiler->averages();
+                stats.gpu_times.assign(gpu_times.begin(), gpu_times.end());
+                stats.fence_wait_time = m_fence_wait_time;
+                stats.acquire_time = m_acquire_time;
+                stats.submit_time = m_submit_time;
+                stats.present_time = m_present_time;
+                stats.gpu_time = std::chrono::duration<f64, std::milli>(m_gpu_profiler->last_time("frame").value_or(0));
+                stats.rendered = true;
+                stats.heaps = m_allocator->heap_stats();
+                stats.frame_allocator_used = m_frame_allocator->used();
+                stats.frame_allocator_capacity = m_frame_allocator->capacity(m_frame_allocator->current_frame());
+                stats.descriptor_pools = m_descriptor_allocator->pool_count();
+                stats.record_benchmark_running = m_record_benchmark.running;
+                stats.record_benchmark_results = m_record_benchmark.results;
+
+                if (m_config.benchmark && m_frames_rendered >= m_config.warmup_frames) {
+                    const std::chrono::duration<f64, std::milli> frame_time = end - m_last_frame_end;
+                    m_benchmark_samples.frame.push_back(frame_time.count());
+                    m_benchmark_samples.render.push_back((stats.render_time - m_fence_wait_time).count());
                 }
-            } break;
-            case SDL_EVENT_WINDOW_RESIZED: {
-                auto& window_event = event.window;
-
-                m_window_width = (u32) window_event.data1;
-                m_window_height = (u32) window_event.data2;
-                m_window_resized = true;
-            } break;
-            default:
-                break;
+
+                m_last_frame_end = end;
+                m_frames_rendered++;
+            } catch (...) {
+                m_render_error = std::current_exception();
+                m_render_failed.store(true, std::memory_order_release);
             }
         }
 
-        update();
-        update_graphics();
+        m_frame_packets.end_read();
     }
+}
 
-    quit();
+void Engine::apply_frame_packet() {
+    PROFILE_SCOPE("apply_frame_packet");
+
+    const auto& packet = *m_frame_packet;
+
+    m_render_camera = packet.camera;
+    m_render_settings = packet.settings;
+
+    m_render_objects.resize(packet.object_count);
+    for (usize i = 0; i < packet.dirty_objects.size(); i++)
+        m_render_objects[packet.dirty_objects[i]] = packet.dirty_object_data[i];
+
+    update_cull_bounds();
+
+    auto& bench = m_record_benchmark;
+    if (packet.start_record_benchmark && !bench.running) {
+        bench = RecordBenchmark{ .running = true };
+        for (u32 thread_count = 1; thread_count < m_recorder->max_chunks(); thread_count *= 2)
+            bench.thread_counts.push_back(thread_count);
+        bench.thread_counts.push_back(m_recorder->max_chunks());
+    }
+
+    // The benchmark picks the thread count while it runs.
+    if (bench.running) {
+        m_render_settings.parallel_recording = true;
+        m_render_settings.record_thread_count = (int) bench.thread_counts[bench.step];
+    }
+}
+
+ObjectHandle Engine::spawn_object(const glm::vec3& pos, const glm::quat& rot, ObjectMobility mobility) {
+    // New objects start out dirty, which is the only time static ones get uploaded.
+    // The object buffer grows in render_frame if the scene outgrew it.
+    return m_scene.add(pos, rot, mobility, { .bounds = CUBE_BOUNDS });
+}
+
+void Engine::despawn_object(ObjectHandle handle) {
+    m_scene.remove(handle);
 }
 
 void Engine::init_window() {
-    constexpr u32 DEFAULT_WIDTH = 960;
-    constexpr u32 DEFAULT_HEIGHT = 640;
+    PROFILE_SCOPE("init_window");
 
     // Hide the window until we are done initializing GPU resources.
     // Maybe in the future we want to show some kind of splash screen when the loading process takes longer,
     // but for now this is fine.
-    if ((m_window = SDL_CreateWindow("brampling3D", DEFAULT_WIDTH, DEFAULT_HEIGHT, SDL_WINDOW_VULKAN | SDL_WINDOW_HIDDEN)) == nullptr) {
+    if ((m_window = SDL_CreateWindow("brampling3D", (int) m_config.width, (int) m_config.height, SDL_WINDOW_VULKAN | SDL_WINDOW_HIDDEN)) == nullptr) {
         sdl3_perror("Failed to create window");
         throw std::runtime_error("Window initialization failed");
     }
@@ -261,12 +593,19 @@ void Engine::init_window() {
 }
 
 void Engine::quit() {
+    PROFILE_SCOPE("quit");
+
     spdlog::info("quitting");
 
     // Make sure the GPU isn't doing anything with the resources we are about to destroy.
     vkDeviceWaitIdle(device());
 
-    ImGui_ImplVulkan_Shutdown();
+    // Runs the cleanup of any uploads still waiting for it.
+    m_uploader.reset();
+    m_frame_allocator.reset();
+
+    if (!m_config.headless)
+        ImGui_ImplVulkan_Shutdown();
 
     for (const auto fence : m_in_flight_fences) {
         vkDestroyFence(device(), fence, nullptr);
@@ -274,91 +613,118 @@ void Engine::quit() {
     for (const auto semaphore : m_image_available_semaphores) {
         vkDestroySemaphore(device(), semaphore, nullptr);
     }
+    m_gpu_profiler.reset();
     
     vkFreeCommandBuffers(device(), m_command_pool, m_command_buffers.size(), m_command_buffers.data());
     vkDestroyCommandPool(device(), m_command_pool, nullptr);
-    vkDestroyCommandPool(device(), m_transient_command_pool, nullptr);
+    m_recorder.reset();
 
-    for (const auto& object : m_scene_objects) {
-        for (const auto ubo : object.m_ubos) {
-            vkDestroyBuffer(device(), ubo, nullptr);
-        }
-        for (const auto mem : object.m_ubo_memory) {
-            vkUnmapMemory(device(), mem);
-            vkFreeMemory(device(), mem, nullptr);
-        }
-        vkFreeDescriptorSets(device(), m_descriptor_pool, object.m_descriptor_sets.size(), object.m_descriptor_sets.data());
+    for (auto& frame : m_cull_frames) {
+        m_allocator->destroy_buffer(frame.m_draw_commands, frame.m_draw_commands_memory);
+        m_allocator->destroy_buffer(frame.m_draw_count, frame.m_draw_count_memory);
+        m_allocator->destroy_buffer(frame.m_readback, frame.m_readback_memory);
     }
 
-    vkFreeDescriptorSets(device(), m_descriptor_pool, m_descriptor_sets.size(), m_descriptor_sets.data());
-    vkDestroyDescriptorPool(device(), m_descriptor_pool, nullptr);
-
-    for (const auto mem : m_camera_ubo_memory) {
-        vkUnmapMemory(device(), mem);
-        vkFreeMemory(device(), mem, nullptr);
-    }
-    for (const auto ubo : m_camera_ubos) {
-        vkDestroyBuffer(device(), ubo, nullptr);
+    m_allocator->destroy_buffer(m_object_buffer, m_object_buffer_memory);
+    for (auto& retired : m_retired_object_buffers) {
+        for (auto& [buffer, memory] : retired)
+            m_allocator->destroy_buffer(buffer, memory);
     }
 
+    // Frees every descriptor set along with the pools.
+    m_descriptor_allocator.reset();
+
     vkDestroySampler(device(), m_cubemap_sampler, nullptr);
+    vkDestroySampler(device(), m_cubemap_sampler_no_mips, nullptr);
     vkDestroyImageView(device(), m_cubemap_image_view, nullptr);
-    vkDestroyImage(device(), m_cubemap_image, nullptr);
-    vkFreeMemory(device(), m_cubemap_memory, nullptr);
+    m_allocator->destroy_image(m_cubemap_image, m_cubemap_memory);
 
     vkDestroySampler(device(), m_texture_sampler, nullptr);
+    vkDestroySampler(device(), m_texture_sampler_no_mips, nullptr);
     vkDestroyImageView(device(), m_texture_image_view, nullptr);
-    vkFreeMemory(device(), m_texture_image_memory, nullptr);
-    vkDestroyImage(device(), m_texture_image, nullptr);
+    m_allocator->destroy_image(m_texture_image, m_texture_image_memory);
 
     vkDestroyImageView(device(), m_depth_image_view, nullptr);
-    vkDestroyImage(device(), m_depth_image, nullptr);
-    vkFreeMemory(device(), m_depth_image_memory, nullptr);
+    m_allocator->destroy_image(m_depth_image, m_depth_image_memory);
 
-    vkFreeMemory(device(), m_cubemap_vertex_buffer_memory, nullptr);
-    vkFreeMemory(device(), m_cubemap_index_buffer_memory, nullptr);
-    vkDestroyBuffer(device(), m_cubemap_vertex_buffer, nullptr);
-    vkDestroyBuffer(device(), m_cubemap_index_buffer, nullptr);
+    m_allocator->destroy_buffer(m_cubemap_vertex_buffer, m_cubemap_vertex_buffer_memory);
+    m_allocator->destroy_buffer(m_cubemap_index_buffer, m_cubemap_index_buffer_memory);
 
-    vkFreeMemory(device(), m_index_buffer_memory, nullptr);
-    vkFreeMemory(device(), m_vertex_buffer_memory, nullptr);
-    vkDestroyBuffer(device(), m_index_buffer, nullptr);
-    vkDestroyBuffer(device(), m_vertex_buffer, nullptr);
+    m_allocator->destroy_buffer(m_index_buffer, m_index_buffer_memory);
+    m_allocator->destroy_buffer(m_vertex_buffer, m_vertex_buffer_memory);
 
+    vkDestroyPipeline(device(), m_cull_pipeline, nullptr);
+    vkDestroyPipelineLayout(device(), m_cull_pipeline_layout, nullptr);
     vkDestroyPipeline(device(), m_cubemap_pipeline, nullptr);
     vkDestroyPipelineLayout(device(), m_cubemap_pipeline_layout, nullptr);
     vkDestroyPipeline(device(), m_pipeline, nullptr);
+    vkDestroyPipeline(device(), m_unculled_pipeline, nullptr);
     vkDestroyPipelineLayout(device(), m_pipeline_layout, nullptr);
 
     vkDestroyDescriptorSetLayout(device(), m_descriptor_set_layout, nullptr);
     vkDestroyDescriptorSetLayout(device(), m_scene_object_descriptor_set_layout, nullptr);
+    vkDestroyDescriptorSetLayout(device(), m_cull_descriptor_set_layout, nullptr);
 
     vkDeviceWaitIdle(device());
 
+    // Save the pipeline cache so the next launch doesn't have to compile every pipeline again.
+    m_pipeline_cache->save();
+    m_pipeline_cache.reset();
+
     m_swapchain.reset();
+    m_offscreen_target.reset();
+    m_allocator.reset();
     m_device.reset();
 
-    SDL_Vulkan_DestroySurface(m_instance, m_window_surface, nullptr);
+    if (m_window_surface != VK_NULL_HANDLE)
+        SDL_Vulkan_DestroySurface(m_instance, m_window_surface, nullptr);
 
     vkDestroyInstance(m_instance, nullptr);
 
-    SDL_DestroyWindow(m_window);
+    if (m_window)
+        SDL_DestroyWindow(m_window);
     SDL_Quit();
 
     spdlog::info("Goodbye!");
 }
 
 void Engine::init_graphics() {
+    PROFILE_SCOPE("init_graphics");
+
     create_instance();
 
-    create_window_surface();
+    if (!m_config.headless)
+        create_window_surface();
     
-    m_device = std::make_unique<VulkanDevice>(m_instance, m_window_surface);
-    m_swapchain = std::make_unique<VulkanSwapchain>(physical_device(), device(), m_window_surface);
+    m_device = std::make_unique<VulkanDevice>(m_instance, m_window_surface, m_config.software_device);
+    spdlog::info("using {}{}", m_device->device_name(), m_config.headless ? ", headless" : "");
+    m_allocator = std::make_unique<VulkanAllocator>(physical_device(), device());
+    m_uploader = std::make_unique<VulkanUploader>(device(), *m_allocator, VulkanUploadQueues{
+        .transfer_queue = m_device->transfer_queue(),
+        .transfer_family = m_device->transfer_family(),
+        .graphics_queue = graphics_queue(),
+        .graphics_family = m_device->graphics_family()
+    });
+    spdlog::info("uploading through the {} queue", m_uploader->dedicated_transfer() ? "dedicated transfer" : "graphics");
+    m_frame_allocator = std::make_unique<VulkanFrameAllocator>(*m_allocator, m_device->physical_device_properties().limits, MAX_FRAMES_IN_FLIGHT);
+
+    auto cache_dir = user_cache_dir();
+    m_pipeline_cache = std::make_unique<VulkanPipelineCache>(
+        device(),
+        m_device->physical_device_properties(),
+        cache_dir.empty() ? cache_dir : cache_dir / "pipeline_cache.bin"
+    );
+    if (m_config.headless) {
+        // The same format a swapchain would most likely have, so the pipelines are the same either way.
+        m_offscreen_target = std::make_unique<VulkanOffscreenTarget>(device(), *m_allocator, VK_FORMAT_B8G8R8A8_SRGB, MAX_FRAMES_IN_FLIGHT);
+        m_offscreen_target->create(m_window_width, m_window_height);
+    } else {
+        m_swapchain = std::make_unique<VulkanSwapchain>(physical_device(), device(), m_window_surface);
 
-    // Do things that depend on surface_format...
+        // Do things that depend on surface_format...
 
-    m_swapchain->create(m_window_width, m_window_height);
+        m_swapchain->create(m_window_width, m_window_height);
+    }
 
     create_command_pools();
 
@@ -374,12 +740,18 @@ void Engine::init_graphics() {
 
     create_descriptor_set_layouts();
 
-    create_graphics_pipeline();
-    create_cubemap_pipeline();
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        create_graphics_pipeline();
+        create_cubemap_pipeline();
+        create_cull_pipeline();
 
-    create_camera_ubos();
+        std::chrono::duration<f64, std::milli> pipeline_time = std::chrono::steady_clock::now() - start;
+        spdlog::info("created pipelines in {:.2f} ms ({} pipeline cache)", pipeline_time.count(), m_pipeline_cache->loaded() ? "warm" : "cold");
+    }
 
-    create_descriptor_pool();
+    create_descriptor_allocator();
 
     create_descriptor_sets();
 
@@ -389,15 +761,30 @@ void Engine::init_graphics() {
     create_cubemap_buffers();
 
     create_scene_objects();
+    create_object_buffers();
+    create_cull_resources();
 
     create_command_buffers();
+    m_recorder = std::make_unique<VulkanParallelRecorder>(device(), m_device->graphics_family(), MAX_FRAMES_IN_FLIGHT, m_jobs);
+    spdlog::info("recording with up to {} threads", m_recorder->max_chunks());
 
     create_sync_objects();
 
+    if (m_device->timestamp_valid_bits() == 0)
+        spdlog::warn("the graphics queue can't write timestamps, there will be no GPU times");
+    m_gpu_profiler = std::make_unique<VulkanGpuProfiler>(device(), m_device->timestamp_valid_bits(),
+        m_device->physical_device_properties().limits.timestampPeriod, MAX_FRAMES_IN_FLIGHT);
+
+    // All the uploads above go out in a single batch. With a dedicated transfer queue the graphics half (mips, the skybox
+    // conversion) is only submitted once the copies are done, and the first frame needs all of it.
+    m_uploader->wait(m_uploader->flush());
+
     spdlog::info("Vulkan initialized");
 }
 
 void Engine::init_imgui() {
+    PROFILE_SCOPE("init_imgui");
+
     // Make sure imgui was linked correctly
     IMGUI_CHECKVERSION();
 
@@ -415,7 +802,7 @@ void Engine::init_imgui() {
     // Setup backends
     ImGui_ImplSDL3_InitForVulkan(m_window);
     
-    const auto color_attachment_formats = std::to_array({ m_swapchain->surface_format().format });
+    const auto color_attachment_formats = std::to_array({ target_format() });
     ImGui_ImplVulkan_InitInfo init_info{
         .ApiVersion = ENGINE_VULKAN_API_VERSION,
         .Instance = m_instance,
@@ -426,6 +813,7 @@ void Engine::init_imgui() {
         .DescriptorPoolSize = IMGUI_IMPL_VULKAN_MINIMUM_IMAGE_SAMPLER_POOL_SIZE,
         .MinImageCount = m_swapchain->min_image_count(),
         .ImageCount = (u32) m_swapchain->image_count(),
+        .PipelineCache = m_pipeline_cache->cache(),
         .PipelineInfoMain = {
             .Subpass = 0,
             .PipelineRenderingCreateInfo = {
@@ -442,6 +830,8 @@ void Engine::init_imgui() {
 }
 
 void Engine::init_scene() {
+    PROFILE_SCOPE("init_scene");
+
     // Setup camera.
     m_camera.set_pos({ 0, 0, 10 });
     m_camera.set_pitch(0);
@@ -449,22 +839,45 @@ void Engine::init_scene() {
     m_camera.set_fov(45);
 
     m_camera.update_rot();
+
+    if (m_config.benchmark) {
+        // A loop around the scene that dips into it once, so how much is culled changes along the way.
+        // Starts where the camera would be anyway.
+        const f32 s = m_scene_extent;
+        m_camera_path = CameraPath({
+            { 0, 0, 2 * s },
+            { 1.5f * s, 0.5f * s, 1.2f * s },
+            { 1.6f * s, -0.3f * s, -1.2f * s },
+            { 0.3f * s, 0.2f * s, -0.6f * s },
+            { -1.4f * s, 0.8f * s, -1.4f * s },
+            { -1.8f * s, -0.4f * s, 0.6f * s },
+        }, 20);
+        follow_camera_path(0);
+    }
+
+    m_previous_camera_pos = m_camera.pos();
 }
 
 void Engine::create_instance() {
-    // Get instance extensions needed for vkCreateInstance
-    u32 extension_count;
-    auto* extensions = SDL_Vulkan_GetInstanceExtensions(&extension_count);
-    if (!extensions) {
-        sdl3_perror("Failed to get vulkan instance extensions");
-        throw std::runtime_error("Vulkan initialization failed");
-    }
+    PROFILE_SCOPE("create_instance");
+
+    std::vector<const char*> enable_extensions;
+
+    // Get instance extensions needed for vkCreateInstance. Headless nothing is presented, so there are none.
+    if (!m_config.headless) {
+        u32 extension_count;
+        auto* extensions = SDL_Vulkan_GetInstanceExtensions(&extension_count);
+        if (!extensions) {
+            sdl3_perror("Failed to get vulkan instance extensions");
+            throw std::runtime_error("Vulkan initialization failed");
+        }
 
-    std::vector enable_extensions(extensions, extensions + extension_count);
+        enable_extensions.assign(extensions, extensions + extension_count);
+    }
 
     u32 supported_extension_count;
     vkEnumerateInstanceExtensionProperties(nullptr, &supported_extension_count, nullptr);
-    std::vector<VkExtensionProperties> supported_extensions;
+    std::vector<VkExtensionProperties> supported_extensions(supported_extension_count);
     vkEnumerateInstanceExtensionProperties(nullptr, &supported_extension_count, supported_extensions.data());
 
     // Try to enable VK_KHR_portability_enumeration for MoltenVK support.
@@ -529,8 +942,8 @@ void Engine::create_instance() {
         .pApplicationInfo = &app_info,
         .enabledLayerCount = (u32) enabled_layers.size(),
         .ppEnabledLayerNames = enabled_layers.data(),
-        .enabledExtensionCount = extension_count,
-        .ppEnabledExtensionNames = extensions,
+        .enabledExtensionCount = (u32) enable_extensions.size(),
+        .ppEnabledExtensionNames = enable_extensions.data(),
     };
 
     vulkan_check_res(
@@ -540,6 +953,8 @@ void Engine::create_instance() {
 }
 
 void Engine::create_window_surface() {
+    PROFILE_SCOPE("create_window_surface");
+
     if (!SDL_Vulkan_CreateSurface(m_window, m_instance, nullptr, &m_window_surface)) {
         sdl3_perror("Failed to create vulkan surface");
         throw std::runtime_error("Vulkan initialization failed");
@@ -547,6 +962,8 @@ void Engine::create_window_surface() {
 }
 
 void Engine::create_command_pools() {
+    PROFILE_SCOPE("create_command_pools");
+
     VkCommandPoolCreateInfo pool_info{
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
@@ -556,26 +973,16 @@ void Engine::create_command_pools() {
         vkCreateCommandPool(device(), &pool_info, nullptr, &m_command_pool),
         "failed to create command pool"
     );
-
-    // Create a separate command pool for transient (single time) command buffers.
-    // Per the Vulkan spec this can allow the driver to optimize for this use case.
-    // (In practice, all the open source vulkan drivers I've seen don't do anything with that flag :()
-    VkCommandPoolCreateInfo transient_pool_info{
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
-        .queueFamilyIndex = m_device->graphics_family()
-    };
-    vulkan_check_res(
-        vkCreateCommandPool(device(), &transient_pool_info, nullptr, &m_transient_command_pool),
-        "failed to create command pool"
-    );
 }
 
 void Engine::create_descriptor_set_layouts() {
+    PROFILE_SCOPE("create_descriptor_set_layouts");
+
     {
+        // The camera constants are allocated from the frame allocator every frame.
         VkDescriptorSetLayoutBinding ubo_binding{
             .binding = 0,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
             .descriptorCount = 1,
             .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
             .pImmutableSamplers = nullptr
@@ -612,15 +1019,24 @@ void Engine::create_descriptor_set_layouts() {
     }
 
     {
-        VkDescriptorSetLayoutBinding ubo_binding{
+        VkDescriptorSetLayoutBinding objects_binding{
             .binding = 0,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
             .descriptorCount = 1,
             .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
             .pImmutableSamplers = nullptr
         }; 
 
-        const auto bindings = std::to_array({ ubo_binding });
+        // So are the instance indices.
+        VkDescriptorSetLayoutBinding instances_binding{
+            .binding = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            .pImmutableSamplers = nullptr
+        };
+
+        const auto bindings = std::to_array({ objects_binding, instances_binding });
 
         VkDescriptorSetLayoutCreateInfo layout_create_info{
             .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
@@ -633,9 +1049,36 @@ void Engine::create_descriptor_set_layouts() {
             "failed to create scene object descriptor set layout"
         );
     }
+
+    {
+        // objects, instances, draw commands, draw count
+        std::array<VkDescriptorSetLayoutBinding, 4> bindings;
+        for (u32 i = 0; i < bindings.size(); i++) {
+            bindings[i] = {
+                .binding = i,
+                .descriptorType = i == 1 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .pImmutableSamplers = nullptr
+            };
+        }
+
+        VkDescriptorSetLayoutCreateInfo layout_create_info{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .flags = 0,
+            .bindingCount = bindings.size(),
+            .pBindings = bindings.data()
+        };
+        vulkan_check_res(
+            vkCreateDescriptorSetLayout(device(), &layout_create_info, nullptr, &m_cull_descriptor_set_layout),
+            "failed to create cull descriptor set layout"
+        );
+    }
 }
 
 void Engine::create_graphics_pipeline() {
+    PROFILE_SCOPE("create_graphics_pipeline");
+
     std::vector<u8> vert_shader(std::from_range, get_asset<"shaders/soggycube.vertex.spv">());
     std::vector<u8> frag_shader(std::from_range, get_asset<"shaders/soggycube.fragment.spv">());
 
@@ -770,7 +1213,7 @@ void Engine::create_graphics_pipeline() {
         "failed to create pipeline layout"
     );
 
-    const auto color_attachment_formats = std::to_array({ m_swapchain->surface_format().format });
+    const auto color_attachment_formats = std::to_array({ target_format() });
 
     VkPipelineRenderingCreateInfo pipeline_rendering_info{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
@@ -799,15 +1242,37 @@ void Engine::create_graphics_pipeline() {
     };
 
     vulkan_check_res(
-        vkCreateGraphicsPipelines(device(), VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &m_pipeline),
+        vkCreateGraphicsPipelines(device(), m_pipeline_cache->cache(), 1, &pipeline_info, nullptr, &m_pipeline),
         "failed to create graphics pipeline"
     );
 
+    // The same pipeline for drawing without culling, which doesn't need instance indices.
+    const VkBool32 use_instances = VK_FALSE;
+    VkSpecializationMapEntry specialization_entry{
+        .constantID = 0,
+        .offset = 0,
+        .size = sizeof(VkBool32),
+    };
+    VkSpecializationInfo specialization_info{
+        .mapEntryCount = 1,
+        .pMapEntries = &specialization_entry,
+        .dataSize = sizeof(VkBool32),
+        .pData = &use_instances,
+    };
+    shader_stages[0].pSpecializationInfo = &specialization_info;
+
+    vulkan_check_res(
+        vkCreateGraphicsPipelines(device(), m_pipeline_cache->cache(), 1, &pipeline_info, nullptr, &m_unculled_pipeline),
+        "failed to create unculled graphics pipeline"
+    );
+
     vkDestroyShaderModule(device(), frag_shader_module, nullptr);
     vkDestroyShaderModule(device(), vert_shader_module, nullptr);
 }
 
 void Engine::create_cubemap_pipeline() {
+    PROFILE_SCOPE("create_cubemap_pipeline");
+
     std::vector<u8> vert_shader(std::from_range, get_asset<"shaders/skybox.vertex.spv">());
     std::vector<u8> frag_shader(std::from_range, get_asset<"shaders/skybox.fragment.spv">());
 
@@ -943,7 +1408,7 @@ void Engine::create_cubemap_pipeline() {
         "failed to create pipeline layout"
     );
 
-    const auto color_attachment_formats = std::to_array({ m_swapchain->surface_format().format });
+    const auto color_attachment_formats = std::to_array({ target_format() });
 
     VkPipelineRenderingCreateInfo pipeline_rendering_info{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
@@ -972,7 +1437,7 @@ void Engine::create_cubemap_pipeline() {
     };
 
     vulkan_check_res(
-        vkCreateGraphicsPipelines(device(), VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &m_cubemap_pipeline),
+        vkCreateGraphicsPipelines(device(), m_pipeline_cache->cache(), 1, &pipeline_info, nullptr, &m_cubemap_pipeline),
         "failed to create graphics pipeline"
     );
 
@@ -980,15 +1445,73 @@ void Engine::create_cubemap_pipeline() {
     vkDestroyShaderModule(device(), vert_shader_module, nullptr);
 }
 
+void Engine::create_cull_pipeline() {
+    PROFILE_SCOPE("create_cull_pipeline");
+
+    std::vector<u8> shader(std::from_range, get_asset<"shaders/cull.compute.spv">());
+
+    VkShaderModuleCreateInfo module_info{
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = shader.size(),
+        .pCode = reinterpret_cast<const u32*>(shader.data())
+    };
+
+    VkShaderModule shader_module;
+    vulkan_check_res(
+        vkCreateShaderModule(device(), &module_info, nullptr, &shader_module),
+        "failed to create cull compute shader"
+    );
+
+    VkPushConstantRange push_constant_range{
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(CullPushConstants)
+    };
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &m_cull_descriptor_set_layout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_constant_range
+    };
+
+    vulkan_check_res(
+        vkCreatePipelineLayout(device(), &pipeline_layout_info, nullptr, &m_cull_pipeline_layout),
+        "failed to create cull pipeline layout"
+    );
+
+    VkComputePipelineCreateInfo pipeline_info{
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shader_module,
+            .pName = "main"
+        },
+        .layout = m_cull_pipeline_layout
+    };
+
+    vulkan_check_res(
+        vkCreateComputePipelines(device(), m_pipeline_cache->cache(), 1, &pipeline_info, nullptr, &m_cull_pipeline),
+        "failed to create cull pipeline"
+    );
+
+    vkDestroyShaderModule(device(), shader_module, nullptr);
+}
+
 void Engine::create_depth_image() {
+    PROFILE_SCOPE("create_depth_image");
+
     // TODO: Test for allowed formats
     const auto depth_format = VK_FORMAT_D32_SFLOAT;
-    u32 width = m_swapchain->extent().width;
-    u32 height = m_swapchain->extent().height;
+    u32 width = target_extent().width;
+    u32 height = target_extent().height;
 
     create_image_2d(
         width,
         height,
+        1,
         depth_format,
         VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
@@ -1017,41 +1540,48 @@ void Engine::create_depth_image() {
 
 
 void Engine::create_texture_image() {
+    PROFILE_SCOPE("create_texture_image");
+
+#ifdef ENGINE_COMPRESSED_TEXTURES
+    // Block compressed textures are uploaded as is, mips included, when the GPU can sample them.
+    auto texture = Ktx2Texture::from_bytes(get_asset<"images/soggy.ktx2">());
+    if (!texture)
+        throw std::runtime_error("failed to load soggy.ktx2");
+
+    if (format_supported(texture->format, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+        upload_compressed_texture(*texture);
+        return;
+    }
+
+    spdlog::warn("{} can't be sampled, decoding soggy.png instead", string_VkFormat(texture->format));
+#endif
+
     auto image = stb::Image::from_bytes(get_asset<"images/soggy.png">(), 4);
     if (!image)
         throw std::runtime_error("failed to load soggy.png");
 
     VkDeviceSize image_size = image->width() * image->height() * 4;
 
-    // Create a staging buffer to upload our texture to.
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
-    create_buffer(
-        image_size, 
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-        staging_buffer, 
-        staging_buffer_memory
-    );
-
-    // Upload the texture.
-    void* data;
-    vkMapMemory(device(), staging_buffer_memory, 0, image_size, 0, &data);
-    memcpy(data, image->data(), (usize) image_size);
-    vkUnmapMemory(device(), staging_buffer_memory);
+    // Stage the texture for upload.
+    auto staging = m_uploader->stage(image->data(), image_size);
 
-    // Create the texture image.
+    // Create the texture image, with a full mip chain so it isn't sampled at full resolution far away.
+    m_texture_format = VK_FORMAT_R8G8B8A8_SRGB;
+    m_texture_mip_levels = std::bit_width(std::max(image->width(), image->height()));
+    m_texture_size = mip_chain_size(image->width(), image->height(), m_texture_mip_levels);
+    m_texture_top_level_size = mip_chain_size(image->width(), image->height(), 1);
     create_image_2d(
         image->width(), 
         image->height(), 
+        m_texture_mip_levels,
         VK_FORMAT_R8G8B8A8_SRGB, 
-        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
         m_texture_image, 
         m_texture_image_memory
     );
 
-    VkCommandBuffer command_buffer = begin_single_time_commands();
+    VkCommandBuffer command_buffer = m_uploader->transfer_command_buffer();
 
     transition_image_layout(
         command_buffer, 
@@ -1061,12 +1591,15 @@ void Engine::create_texture_image() {
         VK_IMAGE_LAYOUT_UNDEFINED, 
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 
-        VK_PIPELINE_STAGE_TRANSFER_BIT
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        1,
+        m_texture_mip_levels
     );
 
     // Copy the staging buffer.
     VkBufferImageCopy region{
-        .bufferOffset = 0,
+        .bufferOffset = staging.offset,
         .bufferRowLength = 0,
         .bufferImageHeight = 0,
         .imageSubresource = {
@@ -1080,42 +1613,123 @@ void Engine::create_texture_image() {
     };
     vkCmdCopyBufferToImage(
         command_buffer,
-        staging_buffer,
+        staging.buffer,
         m_texture_image,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         1,
         &region
     );
 
-    // Prepare the texture for shader use.
+    // Hand the texture over to the graphics queue to fill in the rest of the mip chain, which also prepares it for shader use.
+    const VkImageSubresourceRange range{
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = m_texture_mip_levels,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+    };
+    m_uploader->release_image(m_texture_image, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    generate_mipmaps(m_uploader->graphics_command_buffer(), m_texture_image, VK_FORMAT_R8G8B8A8_SRGB, image->width(), image->height(), m_texture_mip_levels);
+}
+
+void Engine::upload_compressed_texture(const Ktx2Texture& texture) {
+    PROFILE_SCOPE("upload_compressed_texture");
+
+    // Pack every level into one staging allocation, keeping the offsets aligned for the copies.
+    std::vector<VkBufferImageCopy> regions;
+    VkDeviceSize staging_size = 0;
+    for (u32 level = 0; level < texture.levels.size(); level++) {
+        const auto& level_data = texture.levels[level];
+
+        staging_size = (staging_size + 15) & ~(VkDeviceSize) 15;
+        regions.push_back({
+            .bufferOffset = staging_size,
+            .imageSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = level,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            },
+            .imageExtent = { .width = level_data.width, .height = level_data.height, .depth = 1 }
+        });
+        staging_size += level_data.data.size();
+    }
+
+    auto staging = m_uploader->stage(staging_size);
+
+    for (usize level = 0; level < texture.levels.size(); level++) {
+        const auto& data = texture.levels[level].data;
+        memcpy(staging.mapped + regions[level].bufferOffset, data.data(), data.size());
+        regions[level].bufferOffset += staging.offset;
+    }
+
+    m_texture_format = texture.format;
+    m_texture_mip_levels = texture.levels.size();
+    m_texture_size = 0;
+    for (const auto& level : texture.levels) {
+        m_texture_size += level.data.size();
+    }
+    m_texture_top_level_size = texture.levels[0].data.size();
+
+    create_image_2d(
+        texture.width,
+        texture.height,
+        m_texture_mip_levels,
+        m_texture_format,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        m_texture_image,
+        m_texture_image_memory
+    );
+
+    VkCommandBuffer command_buffer = m_uploader->transfer_command_buffer();
+
     transition_image_layout(
-        command_buffer, 
-        m_texture_image, 
-        VK_ACCESS_TRANSFER_WRITE_BIT, 
-        VK_ACCESS_SHADER_READ_BIT, 
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 
-        VK_PIPELINE_STAGE_TRANSFER_BIT, 
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+        command_buffer,
+        m_texture_image,
+        0,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        1,
+        m_texture_mip_levels
     );
 
-    end_single_time_commands(command_buffer);
+    vkCmdCopyBufferToImage(
+        command_buffer,
+        staging.buffer,
+        m_texture_image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        regions.size(),
+        regions.data()
+    );
 
-    // Cleanup staging buffer.
-    vkDestroyBuffer(device(), staging_buffer, nullptr);
-    vkFreeMemory(device(), staging_buffer_memory, nullptr);
+    const VkImageSubresourceRange range{
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = m_texture_mip_levels,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+    };
+    m_uploader->release_image(m_texture_image, range, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
 }
 
 void Engine::create_texture_image_view() {
+    PROFILE_SCOPE("create_texture_image_view");
+
     VkImageViewCreateInfo view_info{
         .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
         .image = m_texture_image,
         .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .format = VK_FORMAT_R8G8B8A8_SRGB,
+        .format = m_texture_format,
         .subresourceRange = {
             .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
             .baseMipLevel = 0,
-            .levelCount = 1,
+            .levelCount = m_texture_mip_levels,
             .baseArrayLayer = 0,
             .layerCount = 1,
         }
@@ -1127,221 +1741,474 @@ void Engine::create_texture_image_view() {
 }
 
 void Engine::create_texture_sampler() {
-    VkSamplerCreateInfo sampler_info{
-        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-        .magFilter = VK_FILTER_LINEAR,
-        .minFilter = VK_FILTER_LINEAR,
-        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
-        .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-        .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-        .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-        .mipLodBias = 0,
-        .anisotropyEnable = VK_TRUE,
-        .maxAnisotropy = m_device->physical_device_properties().limits.maxSamplerAnisotropy,
-        // TODO: what's this?
-        .compareEnable = VK_FALSE,
-        .compareOp = VK_COMPARE_OP_ALWAYS,
-        .minLod = 0,
-        .maxLod = 0,
-        .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
-        .unnormalizedCoordinates = VK_FALSE,
-    };
-    vulkan_check_res(
-        vkCreateSampler(device(), &sampler_info, nullptr, &m_texture_sampler),
-        "failed to create texture sampler"
-    );
+    PROFILE_SCOPE("create_texture_sampler");
+
+    // The second sampler is clamped to the top mip level, so the overlay can compare against not having mips.
+    for (auto [sampler, max_lod] : { std::pair{ &m_texture_sampler, VK_LOD_CLAMP_NONE }, std::pair{ &m_texture_sampler_no_mips, 0.f } }) {
+        VkSamplerCreateInfo sampler_info{
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .magFilter = VK_FILTER_LINEAR,
+            .minFilter = VK_FILTER_LINEAR,
+            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+            .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+            .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+            .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+            .mipLodBias = 0,
+            .anisotropyEnable = VK_TRUE,
+            .maxAnisotropy = m_device->physical_device_properties().limits.maxSamplerAnisotropy,
+            // TODO: what's this?
+            .compareEnable = VK_FALSE,
+            .compareOp = VK_COMPARE_OP_ALWAYS,
+            .minLod = 0,
+            .maxLod = max_lod,
+            .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
+            .unnormalizedCoordinates = VK_FALSE,
+        };
+        vulkan_check_res(
+            vkCreateSampler(device(), &sampler_info, nullptr, sampler),
+            "failed to create texture sampler"
+        );
+    }
 }
 
 void Engine::create_cubemap_image() {
+    PROFILE_SCOPE("create_cubemap_image");
+
+#ifdef ENGINE_BAKED_SKYBOX
+    // The skybox was converted to cubemap faces at build time, so it can be uploaded as is.
+    auto baked = BakedCubemap::from_bytes(get_asset<"images/skybox.cube">());
+    if (!baked)
+        throw std::runtime_error("failed to load skybox.cube");
+
+    upload_cubemap_faces(baked->face_size, baked->data);
+#else
     // Load the skybox image.
     auto skybox_image = stb::Image::from_bytes(get_asset<"images/skybox.png">(), 4);
     if (!skybox_image)
         throw std::runtime_error("Failed to load skybox.png");
 
-    // Convert from the equirectangular image to six cubemap faces.
-    const u32 face_size = skybox_image->height();
-    std::vector<std::vector<u8>> face_data;
-
-    face_data.resize(6);
-    for (auto& face : face_data) {
-        face.resize(face_size * face_size * 4);
-    }
-
-    auto get_direction = [](u8 face, f32 u, f32 v) -> glm::vec3 {
-        switch (face) {
-        case 0: return { 1, -v, -u };
-        case 1: return { -1, -v, u };
-        case 2: return { u, 1, v };
-        case 3: return { u, -1, -v };
-        case 4: return { u, -v, 1 };
-        case 5: return { -u, -v, -1 };
-        default: 
-            return {};
-        }
-    };
+    // The GPU conversion needs the whole image in a single texture, anything bigger is converted on the CPU.
+    const auto& limits = m_device->physical_device_properties().limits;
+    if (skybox_image->width() <= limits.maxImageDimension2D && skybox_image->height() <= limits.maxImageDimensionCube) {
+        convert_cubemap_on_gpu(*skybox_image);
+    } else {
+        auto faces = equirect_to_cubemap(skybox_image->data(), skybox_image->width(), skybox_image->height(), &m_jobs);
+        upload_cubemap_faces(faces.face_size, faces.data);
+    }
+#endif
+}
 
-    auto get_pixel = [&](u32 x, u32 y) -> glm::vec4 {
-        const u8* pixel = skybox_image->data() + (y * skybox_image->width() + x) * 4;
-        return {
-            pixel[0] * 255.f,
-            pixel[1] * 255.f,
-            pixel[2] * 255.f,
-            pixel[3] * 255.f
-        };
+void Engine::upload_cubemap_faces(u32 face_size, std::span<const u8> face_data) {
+    PROFILE_SCOPE("upload_cubemap_faces");
+
+    // Stage the faces for upload.
+    u64 image_layer_size = (u64) face_size * face_size * 4;
+    u64 image_size = image_layer_size * 6;
+
+    auto staging = m_uploader->stage(face_data.data(), image_size);
+
+    // Create the cubemap image.
+    m_cubemap_face_size = face_size;
+    m_cubemap_mip_levels = std::bit_width(face_size);
+    create_image_cube(
+        face_size, 
+        m_cubemap_mip_levels,
+        VK_FORMAT_R8G8B8A8_SRGB, 
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+        m_cubemap_image, 
+        m_cubemap_memory
+    );
+
+    VkCommandBuffer command_buffer = m_uploader->transfer_command_buffer();
+
+    transition_image_layout(
+        command_buffer,
+        m_cubemap_image,
+        0,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        6,
+        m_cubemap_mip_levels
+    );
+
+    // The faces are back to back, so all six layers go in one copy.
+    VkBufferImageCopy region{
+        .bufferOffset = staging.offset,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 6,
+        },
+        .imageOffset = { .x = 0, .y = 0, .z = 0 },
+        .imageExtent = { .width = face_size, .height = face_size, .depth = 1 }
     };
 
-    for (u8 face = 0; face < 6; face++) {
-        u8* data = face_data[face].data();
+    vkCmdCopyBufferToImage(
+        command_buffer,
+        staging.buffer,
+        m_cubemap_image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1,
+        &region
+    );
 
-        for (u32 y = 0; y < face_size; y++) {
-            for (u32 x = 0; x < face_size; x++) {
-                f32 face_u = 2 * ((f32) x / face_size) - 1;
-                f32 face_v = 2 * ((f32) y / face_size) - 1;
+    const VkImageSubresourceRange range{
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = m_cubemap_mip_levels,
+        .baseArrayLayer = 0,
+        .layerCount = 6
+    };
+    m_uploader->release_image(m_cubemap_image, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
 
-                auto dir = glm::normalize(get_direction(face, face_u, face_v));
+    generate_mipmaps(m_uploader->graphics_command_buffer(), m_cubemap_image, VK_FORMAT_R8G8B8A8_SRGB, face_size, face_size, m_cubemap_mip_levels, 6);
+}
 
-                f32 theta = std::acos(dir.y);
-                f32 phi = std::atan2(dir.z, dir.x);
+void Engine::convert_cubemap_on_gpu(const stb::Image& equirect) {
+    PROFILE_SCOPE("convert_cubemap_on_gpu");
 
-                f32 u = phi / (2 * std::numbers::pi_v<f32>);
-                f32 v = theta / std::numbers::pi_v<f32>;
+    const u32 face_size = equirect.height();
+    const VkDeviceSize equirect_size = (VkDeviceSize) equirect.width() * equirect.height() * 4;
 
-                // phi ranges from [-pi, pi] so correct it after dividing.
-                if (u < 0)
-                    u += 1;
+    // Upload the equirectangular image as is, it's a third of the size of the faces.
+    auto staging = m_uploader->stage(equirect.data(), equirect_size);
 
-                u = std::clamp(u * (f32) skybox_image->width(), 0.f, (f32) skybox_image->width() - 1);
-                v = std::clamp(v * (f32) skybox_image->height(), 0.f, (f32) skybox_image->height() - 1);
+    // Sampled as UNORM so filtering happens on the stored values, the same as the CPU conversion.
+    VkImage equirect_image;
+    VulkanAllocation equirect_memory;
+    create_image_2d(
+        equirect.width(),
+        equirect.height(),
+        1,
+        VK_FORMAT_R8G8B8A8_UNORM,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        equirect_image,
+        equirect_memory
+    );
 
-                // Bilinear interpolation...
-                u32 u1 = std::floor(u);
-                u32 v1 = std::floor(v);
-                u32 u2 = std::min(u1 + 1, skybox_image->width() - 1);
-                u32 v2 = std::min(v1 + 1, skybox_image->height() - 1);
+    VkImageViewCreateInfo equirect_view_info{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = equirect_image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        }
+    };
+    VkImageView equirect_view;
+    vulkan_check_res(
+        vkCreateImageView(device(), &equirect_view_info, nullptr, &equirect_view),
+        "failed to create equirectangular image view"
+    );
 
-                f32 s = u - u1;
-                f32 t = v - v1;
+    // Wrap around horizontally so the seam is filtered, but not over the poles.
+    VkSamplerCreateInfo sampler_info{
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_LINEAR,
+        .minFilter = VK_FILTER_LINEAR,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .maxLod = 0,
+    };
+    VkSampler equirect_sampler;
+    vulkan_check_res(
+        vkCreateSampler(device(), &sampler_info, nullptr, &equirect_sampler),
+        "failed to create equirectangular sampler"
+    );
 
-                glm::vec4 tl = get_pixel(u1, v1);
-                glm::vec4 tr = get_pixel(u2, v1);
-                glm::vec4 bl = get_pixel(u1, v2);
-                glm::vec4 br = get_pixel(u2, v2);
+    // The cubemap is sampled as sRGB but written through a UNORM view, since sRGB formats can't be storage images.
+    constexpr auto cubemap_formats = std::to_array({ VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_UNORM });
 
-                glm::vec4 color = glm::mix(glm::mix(tl, tr, s), glm::mix(bl, br, s), t);
+    m_cubemap_face_size = face_size;
+    m_cubemap_mip_levels = std::bit_width(face_size);
+    create_image_cube(
+        face_size,
+        m_cubemap_mip_levels,
+        VK_FORMAT_R8G8B8A8_SRGB,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        m_cubemap_image,
+        m_cubemap_memory,
+        cubemap_formats
+    );
 
-                // Write pixel value.
-                u8* dst = data + (y * face_size + x) * 4;
-                dst[0] = color[0] / 255.f;
-                dst[1] = color[1] / 255.f;
-                dst[2] = color[2] / 255.f;
-                dst[3] = color[3] / 255.f;
-            }
+    VkImageViewUsageCreateInfo storage_usage_info{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT
+    };
+    VkImageViewCreateInfo storage_view_info{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .pNext = &storage_usage_info,
+        .image = m_cubemap_image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 6,
         }
-    }
+    };
+    VkImageView storage_view;
+    vulkan_check_res(
+        vkCreateImageView(device(), &storage_view_info, nullptr, &storage_view),
+        "failed to create cubemap storage view"
+    );
 
-    // Create a staging buffer to upload our data to.
-    u64 image_layer_size = face_size * face_size * 4;
-    u64 image_size = image_layer_size * 6;
+    // Everything below is only needed once, so it's created here and thrown away once the upload batch is done.
+    auto bindings = std::to_array<VkDescriptorSetLayoutBinding>({
+        {
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        }
+    });
+    VkDescriptorSetLayoutCreateInfo set_layout_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = bindings.size(),
+        .pBindings = bindings.data()
+    };
+    VkDescriptorSetLayout set_layout;
+    vulkan_check_res(
+        vkCreateDescriptorSetLayout(device(), &set_layout_info, nullptr, &set_layout),
+        "failed to create cubemap conversion descriptor set layout"
+    );
 
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_mem;
+    auto pool_sizes = std::to_array<VkDescriptorPoolSize>({
+        { .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1 },
+        { .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = 1 }
+    });
+    VkDescriptorPoolCreateInfo pool_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = 1,
+        .poolSizeCount = pool_sizes.size(),
+        .pPoolSizes = pool_sizes.data()
+    };
+    VkDescriptorPool descriptor_pool;
+    vulkan_check_res(
+        vkCreateDescriptorPool(device(), &pool_info, nullptr, &descriptor_pool),
+        "failed to create cubemap conversion descriptor pool"
+    );
 
-    create_buffer(
-        image_size, 
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-        staging_buffer, 
-        staging_mem
+    VkDescriptorSetAllocateInfo alloc_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &set_layout
+    };
+    VkDescriptorSet descriptor_set;
+    vulkan_check_res(
+        vkAllocateDescriptorSets(device(), &alloc_info, &descriptor_set),
+        "failed to allocate cubemap conversion descriptor set"
     );
 
-    void* data;
-    vkMapMemory(device(), staging_mem, 0, image_size, 0, &data);
-    for (u8 i = 0; i < 6; i++) {
-        std::memcpy(static_cast<u8*>(data) + image_layer_size * i, face_data[i].data(), image_layer_size);
-    }
-    vkUnmapMemory(device(), staging_mem);
+    VkDescriptorImageInfo equirect_info{
+        .sampler = equirect_sampler,
+        .imageView = equirect_view,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    };
+    VkDescriptorImageInfo storage_info{
+        .imageView = storage_view,
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+    };
+    auto descriptor_writes = std::to_array<VkWriteDescriptorSet>({
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_set,
+            .dstBinding = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &equirect_info
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_set,
+            .dstBinding = 1,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .pImageInfo = &storage_info
+        }
+    });
+    vkUpdateDescriptorSets(device(), descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
 
-    // Create the cubemap image.
-    create_image_cube(
-        face_size, 
-        VK_FORMAT_R8G8B8A8_SRGB, 
-        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
-        m_cubemap_image, 
-        m_cubemap_memory
+    std::vector<u8> shader(std::from_range, get_asset<"shaders/equirect_to_cube.compute.spv">());
+    VkShaderModuleCreateInfo module_info{
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = shader.size(),
+        .pCode = reinterpret_cast<const u32*>(shader.data())
+    };
+    VkShaderModule shader_module;
+    vulkan_check_res(
+        vkCreateShaderModule(device(), &module_info, nullptr, &shader_module),
+        "failed to create cubemap conversion shader"
     );
 
-    VkCommandBuffer command_buffer = begin_single_time_commands();
+    VkPushConstantRange push_constant_range{
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(u32)
+    };
+    VkPipelineLayoutCreateInfo pipeline_layout_info{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &set_layout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_constant_range
+    };
+    VkPipelineLayout pipeline_layout;
+    vulkan_check_res(
+        vkCreatePipelineLayout(device(), &pipeline_layout_info, nullptr, &pipeline_layout),
+        "failed to create cubemap conversion pipeline layout"
+    );
+
+    VkComputePipelineCreateInfo pipeline_info{
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shader_module,
+            .pName = "main"
+        },
+        .layout = pipeline_layout
+    };
+    VkPipeline pipeline;
+    vulkan_check_res(
+        vkCreateComputePipelines(device(), m_pipeline_cache->cache(), 1, &pipeline_info, nullptr, &pipeline),
+        "failed to create cubemap conversion pipeline"
+    );
+    vkDestroyShaderModule(device(), shader_module, nullptr);
+
+    // Upload the equirectangular image.
+    VkCommandBuffer transfer_command_buffer = m_uploader->transfer_command_buffer();
 
     transition_image_layout(
-        command_buffer,
-        m_cubemap_image,
+        transfer_command_buffer,
+        equirect_image,
         0,
         VK_ACCESS_TRANSFER_WRITE_BIT,
         VK_IMAGE_LAYOUT_UNDEFINED,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_IMAGE_ASPECT_COLOR_BIT,
-        6
+        VK_PIPELINE_STAGE_TRANSFER_BIT
     );
 
-    std::array<VkBufferImageCopy, 6> regions;
-    for (u8 i = 0; i < 6; i++) {
-        regions[i] = {
-            .bufferOffset = image_layer_size * i,
-            .bufferRowLength = 0,
-            .bufferImageHeight = 0,
-            .imageSubresource = {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .mipLevel = 0,
-                .baseArrayLayer = i,
-                .layerCount = 1,
-            },
-            .imageOffset = { .x = 0, .y = 0, .z = 0 },
-            .imageExtent = { .width = face_size, .height = face_size, .depth = 1 }
-        };
-    }
+    VkBufferImageCopy region{
+        .bufferOffset = staging.offset,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+        .imageExtent = { .width = equirect.width(), .height = equirect.height(), .depth = 1 }
+    };
+    vkCmdCopyBufferToImage(transfer_command_buffer, staging.buffer, equirect_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 
-    vkCmdCopyBufferToImage(
+    const VkImageSubresourceRange equirect_range{
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+    };
+    m_uploader->release_image(equirect_image, equirect_range, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    // Write the top mip of every face, on the graphics queue once the upload is done.
+    VkCommandBuffer command_buffer = m_uploader->graphics_command_buffer();
+
+    transition_image_layout(
         command_buffer,
-        staging_buffer,
         m_cubemap_image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        regions.size(),
-        regions.data()
+        0,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        6,
+        m_cubemap_mip_levels
     );
 
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+    vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(u32), &face_size);
+
+    constexpr u32 WORKGROUP_SIZE = 8;
+    const u32 group_count = (face_size + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+    vkCmdDispatch(command_buffer, group_count, group_count, 6);
+
+    // Then blit the rest of the mip chain from it.
     transition_image_layout(
         command_buffer,
         m_cubemap_image,
-        VK_ACCESS_TRANSFER_WRITE_BIT,
-        VK_ACCESS_SHADER_READ_BIT,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
         VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
         VK_IMAGE_ASPECT_COLOR_BIT,
-        6
+        6,
+        m_cubemap_mip_levels
     );
 
-    end_single_time_commands(command_buffer);
-
-    // Cleanup staging buffer.
-    vkDestroyBuffer(device(), staging_buffer, nullptr);
-    vkFreeMemory(device(), staging_mem, nullptr);
+    generate_mipmaps(command_buffer, m_cubemap_image, VK_FORMAT_R8G8B8A8_SRGB, face_size, face_size, m_cubemap_mip_levels, 6);
+
+    m_uploader->defer([=, this]() mutable {
+        vkDestroyPipeline(device(), pipeline, nullptr);
+        vkDestroyPipelineLayout(device(), pipeline_layout, nullptr);
+        vkDestroyDescriptorPool(device(), descriptor_pool, nullptr);
+        vkDestroyDescriptorSetLayout(device(), set_layout, nullptr);
+        vkDestroyImageView(device(), storage_view, nullptr);
+        vkDestroySampler(device(), equirect_sampler, nullptr);
+        vkDestroyImageView(device(), equirect_view, nullptr);
+        m_allocator->destroy_image(equirect_image, equirect_memory);
+    });
 }
 
 void Engine::create_cubemap_image_view() {
+    PROFILE_SCOPE("create_cubemap_image_view");
+
+    // The image may also have been written as a storage image, which this sRGB view can't be used for.
+    VkImageViewUsageCreateInfo usage_info{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT
+    };
+
     VkImageViewCreateInfo view_info{
         .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .pNext = &usage_info,
         .image = m_cubemap_image,
         .viewType = VK_IMAGE_VIEW_TYPE_CUBE,
         .format = VK_FORMAT_R8G8B8A8_SRGB,
         .subresourceRange = {
             .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
             .baseMipLevel = 0,
-            .levelCount = 1,
+            .levelCount = m_cubemap_mip_levels,
             .baseArrayLayer = 0,
             .layerCount = 6,
         }
@@ -1353,295 +2220,278 @@ void Engine::create_cubemap_image_view() {
 }
 
 void Engine::create_cubemap_sampler() {
-    VkSamplerCreateInfo sampler_info{
-        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-        .magFilter = VK_FILTER_LINEAR,
-        .minFilter = VK_FILTER_LINEAR,
-        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
-        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-        .mipLodBias = 0,
-        .anisotropyEnable = VK_FALSE,
-        .compareEnable = VK_FALSE,
-        .compareOp = VK_COMPARE_OP_ALWAYS,
-        .minLod = 0,
-        .maxLod = 0,
-        .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
-        .unnormalizedCoordinates = VK_FALSE,
-    };
-    vulkan_check_res(
-        vkCreateSampler(device(), &sampler_info, nullptr, &m_cubemap_sampler),
-        "failed to create cubemap sampler"
-    );
-}
-
-void Engine::create_camera_ubos() {
-    for (usize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        create_buffer(
-            sizeof(CameraUBO),
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            m_camera_ubos[i],
-            m_camera_ubo_memory[i]
+    PROFILE_SCOPE("create_cubemap_sampler");
+
+    for (auto [sampler, max_lod] : { std::pair{ &m_cubemap_sampler, VK_LOD_CLAMP_NONE }, std::pair{ &m_cubemap_sampler_no_mips, 0.f } }) {
+        VkSamplerCreateInfo sampler_info{
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .magFilter = VK_FILTER_LINEAR,
+            .minFilter = VK_FILTER_LINEAR,
+            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+            .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .mipLodBias = 0,
+            .anisotropyEnable = VK_FALSE,
+            .compareEnable = VK_FALSE,
+            .compareOp = VK_COMPARE_OP_ALWAYS,
+            .minLod = 0,
+            .maxLod = max_lod,
+            .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
+            .unnormalizedCoordinates = VK_FALSE,
+        };
+        vulkan_check_res(
+            vkCreateSampler(device(), &sampler_info, nullptr, sampler),
+            "failed to create cubemap sampler"
         );
-
-        vkMapMemory(device(), m_camera_ubo_memory[i], 0, sizeof(CameraUBO), 0, &m_camera_ubo_data[i]);
     }
 }
 
-void Engine::create_descriptor_pool() {
-    constexpr u32 MAX_SETS = 1024;
-    
-    VkDescriptorPoolSize ubo_pool_size{
-        .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        .descriptorCount = MAX_SETS,
-    };
+void Engine::create_descriptor_allocator() {
+    PROFILE_SCOPE("create_descriptor_allocator");
 
-    VkDescriptorPoolSize sampler_pool_size{
-        .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-        .descriptorCount = MAX_SETS,
-    };
+    // Per set, roughly what the layouts above need. The allocator adds pools when these run out.
+    constexpr auto RATIOS = std::to_array<VulkanDescriptorRatio>({
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 },
+    });
 
-    const auto pool_sizes = std::to_array({ ubo_pool_size, sampler_pool_size });
-
-    VkDescriptorPoolCreateInfo pool_info{
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
-        .maxSets = MAX_SETS,
-        .poolSizeCount = pool_sizes.size(),
-        .pPoolSizes = pool_sizes.data()
-    };
-    VkResult res = vkCreateDescriptorPool(device(), &pool_info, nullptr, &m_descriptor_pool);
-    vulkan_check_res(res, "failed to create descriptor pool");
+    m_descriptor_allocator = std::make_unique<VulkanDescriptorAllocator>(device(), 64, RATIOS);
 }
 
 void Engine::create_descriptor_sets() {
+    PROFILE_SCOPE("create_descriptor_sets");
+
     std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> layouts;
     std::ranges::fill(layouts, m_descriptor_set_layout);
 
-    VkDescriptorSetAllocateInfo alloc_info{
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .descriptorPool = m_descriptor_pool,
-        .descriptorSetCount = (u32) layouts.size(),
-        .pSetLayouts = layouts.data()
-    };
-
-    vulkan_check_res(
-        vkAllocateDescriptorSets(device(), &alloc_info, m_descriptor_sets.data()), 
-        "failed to allocate descriptor sets"
-    );
+    m_descriptor_allocator->allocate(layouts, m_descriptor_sets);
 
     // Cube descriptor sets
     for (usize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        VkDescriptorBufferInfo buffer_info{
-            .buffer = m_camera_ubos[i],
-            .offset = 0,
-            .range = sizeof(CameraUBO),
-        };
+        update_camera_descriptor(i);
+        update_texture_descriptors(i);
+    }
+}
 
-        VkDescriptorImageInfo soggy_image_info{
-            .sampler = m_texture_sampler,
-            .imageView = m_texture_image_view,
-            .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        };
+void Engine::update_camera_descriptor(usize frame) {
+    VkDescriptorBufferInfo buffer_info{
+        .buffer = m_frame_allocator->buffer(frame),
+        .offset = 0,
+        .range = sizeof(CameraUBO),
+    };
 
-        VkDescriptorImageInfo skybox_image_info{
-            .sampler = m_cubemap_sampler,
-            .imageView = m_cubemap_image_view,
-            .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-        };
-        
-        auto descriptor_writes = std::to_array<VkWriteDescriptorSet>({
-            {
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .dstSet = m_descriptor_sets[i],
-                .dstBinding = 0,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                .pBufferInfo = &buffer_info
-            },
-            {
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .dstSet = m_descriptor_sets[i],
-                .dstBinding = 1,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                .pImageInfo = &soggy_image_info
-            },
-            {
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .dstSet = m_descriptor_sets[i],
-                .dstBinding = 2,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                .pImageInfo = &skybox_image_info
-            }
-        });
+    VkWriteDescriptorSet descriptor_write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = m_descriptor_sets[frame],
+        .dstBinding = 0,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .pBufferInfo = &buffer_info
+    };
+
+    vkUpdateDescriptorSets(device(), 1, &descriptor_write, 0, nullptr);
+}
+
+void Engine::update_texture_descriptors(usize frame) {
+    VkDescriptorImageInfo soggy_image_info{
+        .sampler = m_render_settings.use_mipmaps ? m_texture_sampler : m_texture_sampler_no_mips,
+        .imageView = m_texture_image_view,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    };
+
+    VkDescriptorImageInfo skybox_image_info{
+        .sampler = m_render_settings.use_mipmaps ? m_cubemap_sampler : m_cubemap_sampler_no_mips,
+        .imageView = m_cubemap_image_view,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    };
+
+    auto descriptor_writes = std::to_array<VkWriteDescriptorSet>({
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = m_descriptor_sets[frame],
+            .dstBinding = 1,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &soggy_image_info
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = m_descriptor_sets[frame],
+            .dstBinding = 2,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &skybox_image_info
+        }
+    });
 
-        vkUpdateDescriptorSets(device(), descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
-    }
+    vkUpdateDescriptorSets(device(), descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
+
+    m_descriptor_set_mipmaps[frame] = m_render_settings.use_mipmaps;
 }
 
 void Engine::create_vertex_buffer() {
-    usize size = sizeof(Vertex) * VERTICES.size();
+    PROFILE_SCOPE("create_vertex_buffer");
 
-    create_buffer(
-        size,
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        m_vertex_buffer,
-        m_vertex_buffer_memory
-    );
-
-    // Upload vertex data.
-    void* data;
-    vkMapMemory(device(), m_vertex_buffer_memory, 0, size, 0, &data);
-    memcpy(data, VERTICES.data(), size);
-    vkUnmapMemory(device(), m_vertex_buffer_memory);
+    create_device_local_buffer(VERTICES.data(), sizeof(Vertex) * VERTICES.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, m_vertex_buffer, m_vertex_buffer_memory);
 }
 
 void Engine::create_index_buffer() {
-    usize size = sizeof(u16) * INDICES.size();
-
-    create_buffer(
-        size,
-        VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        m_index_buffer,
-        m_index_buffer_memory
-    );
+    PROFILE_SCOPE("create_index_buffer");
 
-    // Upload index data.
-    void* data;
-    vkMapMemory(device(), m_index_buffer_memory, 0, size, 0, &data);
-    memcpy(data, INDICES.data(), size);
-    vkUnmapMemory(device(), m_index_buffer_memory);
+    create_device_local_buffer(INDICES.data(), sizeof(u16) * INDICES.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m_index_buffer, m_index_buffer_memory);
 }
 
 void Engine::create_cubemap_buffers() {
-    usize vertex_size = sizeof(Vertex) * CUBEMAP_VERTICES.size();
+    PROFILE_SCOPE("create_cubemap_buffers");
 
-    create_buffer(
-        vertex_size,
+    create_device_local_buffer(
+        CUBEMAP_VERTICES.data(),
+        sizeof(CubemapVertex) * CUBEMAP_VERTICES.size(),
         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
         m_cubemap_vertex_buffer,
         m_cubemap_vertex_buffer_memory
     );
-
-    // Upload vertex data.
-    void* vertex_data;
-    vkMapMemory(device(), m_cubemap_vertex_buffer_memory, 0, vertex_size, 0, &vertex_data);
-    memcpy(vertex_data, CUBEMAP_VERTICES.data(), vertex_size);
-    vkUnmapMemory(device(), m_cubemap_vertex_buffer_memory);
-
-
-    usize index_size = sizeof(u16) * CUBEMAP_INDICES.size();
-
-    create_buffer(
-        index_size,
+    create_device_local_buffer(
+        CUBEMAP_INDICES.data(),
+        sizeof(u16) * CUBEMAP_INDICES.size(),
         VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
         m_cubemap_index_buffer,
         m_cubemap_index_buffer_memory
     );
-
-    // Upload index data.
-    void* index_data;
-    vkMapMemory(device(), m_cubemap_index_buffer_memory, 0, index_size, 0, &index_data);
-    memcpy(index_data, CUBEMAP_INDICES.data(), index_size);
-    vkUnmapMemory(device(), m_cubemap_index_buffer_memory);
 }
 
 void Engine::create_scene_objects() {
-    std::random_device rd;
-    std::mt19937 mt{ rd() };
-    std::uniform_real_distribution<f32> pos_dist(-5, 5);
-    std::uniform_real_distribution<f32> rot_dist(0, 1);
+    PROFILE_SCOPE("create_scene_objects");
 
-    constexpr size_t NUM_CUBES = 60;
+    // Benchmarks need the same scene every run, otherwise log the seed so an interesting one can be run again.
+    m_scene_seed = m_config.seed.value_or(m_config.benchmark ? 0 : std::random_device{}());
+    spdlog::info("placing {} cubes with seed {}", m_config.object_count, m_scene_seed);
 
-    for (usize i = 0; i < NUM_CUBES; i++) {
+    std::mt19937 mt{ m_scene_seed };
+
+    // 60 cubes fill [-5, 5], more of them get a bigger volume with the same density.
+    m_scene_extent = 5 * std::cbrt(m_config.object_count / 60.f);
+    std::uniform_real_distribution<f32> pos_dist(-m_scene_extent, m_scene_extent);
+
+    const usize num_cubes = m_config.object_count;
+    // The last tenth of the cubes spin in place, the rest never move.
+    const usize num_dynamic_cubes = num_cubes / 10;
+
+    m_scene.reserve(num_cubes);
+
+    for (usize i = 0; i < num_cubes; i++) {
         glm::vec3 pos{
             pos_dist(mt),
             pos_dist(mt),
             pos_dist(mt),
         };
 
-        // Generates a uniformly distributed quaternion. Not gonna pretend like I have the slightest idea as to how the hell this works
-        // https://stackoverflow.com/a/44031492
-        constexpr auto PI = std::numbers::pi_v<f32>;
-        f32 u = rot_dist(mt);
-        f32 v = rot_dist(mt);
-        f32 w = rot_dist(mt);
-        glm::quat rot{
-            std::sqrtf(1 - u) * sinf(2 * PI * v),
-            std::sqrtf(1 - u) * cosf(2 * PI * v),
-            std::sqrtf(u) * sinf(2 * PI * w),
-            std::sqrtf(u) * cosf(2 * PI * w)
-        };
+        glm::quat rot = random_rotation(mt);
 
-        CubeObject cube{
-            .m_pos = pos,
-            .m_rot = rot
-        };
+        const bool dynamic = i >= num_cubes - num_dynamic_cubes;
 
-        for (usize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            create_buffer(
-                sizeof(CubeUBO),
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                cube.m_ubos[i],
-                cube.m_ubo_memory[i]
-            );
+        spawn_object(pos, rot, dynamic ? ObjectMobility::Dynamic : ObjectMobility::Static);
+    }
+}
 
-            vkMapMemory(device(), cube.m_ubo_memory[i], 0, sizeof(CubeUBO), 0, &cube.m_ubo_data[i]);
-        }
+void Engine::create_object_buffers() {
+    PROFILE_SCOPE("create_object_buffers");
 
-        std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> layouts;
-        std::ranges::fill(layouts, m_scene_object_descriptor_set_layout);
-        VkDescriptorSetAllocateInfo alloc_info{
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-            .descriptorPool = m_descriptor_pool,
-            .descriptorSetCount = (u32) layouts.size(),
-            .pSetLayouts = layouts.data()
-        };
+    std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> layouts;
+    std::ranges::fill(layouts, m_scene_object_descriptor_set_layout);
 
-        vulkan_check_res(
-            vkAllocateDescriptorSets(device(), &alloc_info, cube.m_descriptor_sets.data()),
-            "failed to allocate CubeObject descriptor sets"
+    m_descriptor_allocator->allocate(layouts, m_object_descriptor_sets);
+
+    reserve_object_buffer(m_scene.size());
+
+    for (usize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        begin_transient_frame(i);
+    }
+}
+
+void Engine::create_cull_resources() {
+    PROFILE_SCOPE("create_cull_resources");
+
+    for (usize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        auto& frame = m_cull_frames[i];
+
+        create_buffer(
+            sizeof(VkDrawIndexedIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            frame.m_draw_commands,
+            frame.m_draw_commands_memory
         );
 
-        for (usize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            VkDescriptorBufferInfo buffer_info{
-                .buffer = cube.m_ubos[i],
-                .offset = 0,
-                .range = sizeof(CubeUBO),
-            };
+        create_buffer(
+            sizeof(u32),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            frame.m_draw_count,
+            frame.m_draw_count_memory
+        );
 
-            auto descriptor_writes = std::to_array<VkWriteDescriptorSet>({
-                {
-                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                    .dstSet = cube.m_descriptor_sets[i],
-                    .dstBinding = 0,
-                    .dstArrayElement = 0,
-                    .descriptorCount = 1,
-                    .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                    .pBufferInfo = &buffer_info,
-                }
-            });
-            vkUpdateDescriptorSets(device(), descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
-        }
+        create_buffer(
+            sizeof(VkDrawIndexedIndirectCommand),
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            frame.m_readback,
+            frame.m_readback_memory
+        );
+        memset(frame.m_readback_memory.mapped, 0, sizeof(VkDrawIndexedIndirectCommand));
+
+        frame.m_descriptor_set = m_descriptor_allocator->allocate(m_cull_descriptor_set_layout);
+
+        VkDescriptorBufferInfo draw_commands_info{
+            .buffer = frame.m_draw_commands,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE,
+        };
+
+        VkDescriptorBufferInfo draw_count_info{
+            .buffer = frame.m_draw_count,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE,
+        };
+
+        auto descriptor_writes = std::to_array<VkWriteDescriptorSet>({
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = frame.m_descriptor_set,
+                .dstBinding = 2,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &draw_commands_info
+            },
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = frame.m_descriptor_set,
+                .dstBinding = 3,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &draw_count_info
+            }
+        });
+        vkUpdateDescriptorSets(device(), descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
 
-        m_scene_objects.push_back(cube);
+        // The object buffers already exist, so point the cull set at them too.
+        // From here on render_frame keeps them up to date.
+        update_object_descriptor_sets(i);
     }
 }
 
 void Engine::create_command_buffers() {
+    PROFILE_SCOPE("create_command_buffers");
+
     // Allocate a command buffer for each swapchain image.
     VkCommandBufferAllocateInfo alloc_info_cmd{
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
@@ -1657,6 +2507,8 @@ void Engine::create_command_buffers() {
 }
 
 void Engine::create_sync_objects() {
+    PROFILE_SCOPE("create_sync_objects");
+
     VkSemaphoreCreateInfo semaphore_info{
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
     };
@@ -1678,26 +2530,7 @@ void Engine::create_sync_objects() {
     }
 }
 
-u32 Engine::choose_memory_type(u32 memory_type_bits, VkMemoryPropertyFlags mem_flags) {
-    VkPhysicalDeviceMemoryProperties mem_properties;
-    vkGetPhysicalDeviceMemoryProperties(physical_device(), &mem_properties);
-
-    u32 memory_type_index = UINT32_MAX;
-    for (u32 i = 0; i < mem_properties.memoryTypeCount; i++) {
-        if ((memory_type_bits & (1 << i)) &&
-            (mem_properties.memoryTypes[i].propertyFlags & mem_flags)) {
-            memory_type_index = i;
-            break;
-        }
-    }
-    if (memory_type_index == UINT32_MAX) {
-        throw std::runtime_error("failed to find suitable memory type for buffer");
-    }
-
-    return memory_type_index;
-}
-
-void Engine::create_buffer(usize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_flags, VkBuffer& buf, VkDeviceMemory& mem) {
+void Engine::create_buffer(usize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_flags, VkBuffer& buf, VulkanAllocation& mem, VulkanAllocationStrategy strategy) {
     VkBufferCreateInfo buffer_info{
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .size = size,
@@ -1705,39 +2538,22 @@ void Engine::create_buffer(usize size, VkBufferUsageFlags usage, VkMemoryPropert
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE
     };
 
-    vulkan_check_res(
-        vkCreateBuffer(device(), &buffer_info, nullptr, &buf),
-        "failed to create buffer"
-    );
-
-    // Find suitable memory type.
-    VkMemoryRequirements mem_requirements;
-    vkGetBufferMemoryRequirements(device(), buf, &mem_requirements);
-
-    u32 memory_type_index = choose_memory_type(mem_requirements.memoryTypeBits, mem_flags);
-
-    VkMemoryAllocateInfo alloc_info{
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = mem_requirements.size,
-        .memoryTypeIndex = memory_type_index
-    };
-
-    vulkan_check_res(
-        vkAllocateMemory(device(), &alloc_info, nullptr, &mem),
-        "failed to allocate buffer memory"
-    );
+    m_allocator->create_buffer(buffer_info, mem_flags, buf, mem, strategy);
+}
 
-    vkBindBufferMemory(device(), buf, mem, 0);
+void Engine::create_device_local_buffer(const void* data, usize size, VkBufferUsageFlags usage, VkBuffer& buf, VulkanAllocation& mem) {
+    create_buffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buf, mem);
+    m_uploader->upload_buffer(buf, 0, data, size);
 }
 
-void Engine::create_image_2d(u32 width, u32 height, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags mem_flags, VkImage& image, VkDeviceMemory& mem) {
+void Engine::create_image_2d(u32 width, u32 height, u32 mip_levels, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags mem_flags, VkImage& image, VulkanAllocation& mem) {
     VkImageCreateInfo image_info{
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
         .flags = 0,
         .imageType = VK_IMAGE_TYPE_2D,
         .format = format,
         .extent = { .width = width, .height = height, .depth = 1 },
-        .mipLevels = 1,
+        .mipLevels = mip_levels,
         .arrayLayers = 1,
         .samples = VK_SAMPLE_COUNT_1_BIT,
         .tiling = VK_IMAGE_TILING_OPTIMAL,
@@ -1745,36 +2561,31 @@ void Engine::create_image_2d(u32 width, u32 height, VkFormat format, VkImageUsag
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
     };
-    vulkan_check_res(
-        vkCreateImage(device(), &image_info, nullptr, &image),
-        "failed to create image"
-    );
 
-    // Allocate memory for the image.
-    VkMemoryRequirements mem_requirements;
-    vkGetImageMemoryRequirements(device(), image, &mem_requirements);
+    m_allocator->create_image(image_info, mem_flags, image, mem);
+}
 
-    VkMemoryAllocateInfo alloc_info{
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = mem_requirements.size,
-        .memoryTypeIndex = choose_memory_type(mem_requirements.memoryTypeBits, mem_flags),
+void Engine::create_image_cube(u32 size, u32 mip_levels, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags mem_flags, VkImage& image, VulkanAllocation& mem, std::span<const VkFormat> view_formats) {
+    VkImageFormatListCreateInfo format_list{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_LIST_CREATE_INFO,
+        .viewFormatCount = (u32) view_formats.size(),
+        .pViewFormats = view_formats.data()
     };
-    vulkan_check_res(
-        vkAllocateMemory(device(), &alloc_info, nullptr, &mem),
-        "failed to allocate image memory"
-    );
 
-    vkBindImageMemory(device(), image, mem, 0);
-}
+    VkImageCreateFlags flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+    if (!view_formats.empty()) {
+        // Extended usage lets the image have usages that only some of its view formats support.
+        flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+    }
 
-void Engine::create_image_cube(u32 size, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags mem_flags, VkImage& image, VkDeviceMemory& mem) {
     VkImageCreateInfo image_info{
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        .flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT,
+        .pNext = view_formats.empty() ? nullptr : &format_list,
+        .flags = flags,
         .imageType = VK_IMAGE_TYPE_2D,
         .format = format,
         .extent = { .width = size, .height = size, .depth = 1 },
-        .mipLevels = 1,
+        .mipLevels = mip_levels,
         .arrayLayers = 6,
         .samples = VK_SAMPLE_COUNT_1_BIT,
         .tiling = VK_IMAGE_TILING_OPTIMAL,
@@ -1782,74 +2593,290 @@ void Engine::create_image_cube(u32 size, VkFormat format, VkImageUsageFlags usag
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
     };
-    vulkan_check_res(
-        vkCreateImage(device(), &image_info, nullptr, &image),
-        "failed to create image"
-    );
 
-    // Allocate memory for the image.
-    VkMemoryRequirements mem_requirements;
-    vkGetImageMemoryRequirements(device(), image, &mem_requirements);
+    m_allocator->create_image(image_info, mem_flags, image, mem);
+}
 
-    VkMemoryAllocateInfo alloc_info{
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = mem_requirements.size,
-        .memoryTypeIndex = choose_memory_type(mem_requirements.memoryTypeBits, mem_flags),
-    };
-    vulkan_check_res(
-        vkAllocateMemory(device(), &alloc_info, nullptr, &mem),
-        "failed to allocate image memory"
+void Engine::reserve_object_buffer(usize object_count) {
+    if (object_count <= m_object_buffer_capacity && m_object_buffer != VK_NULL_HANDLE)
+        return;
+
+    // Grow geometrically so a steadily growing scene doesn't reallocate every frame.
+    usize capacity = std::max<usize>({ object_count, m_object_buffer_capacity * 2, 64 });
+
+    // Frames before this one may still be drawing with the old buffer.
+    if (m_object_buffer != VK_NULL_HANDLE) {
+        m_retired_object_buffers[m_current_frame].emplace_back(m_object_buffer, m_object_buffer_memory);
+        m_object_buffer = VK_NULL_HANDLE;
+        m_object_buffer_memory = {};
+    }
+
+    create_buffer(
+        capacity * sizeof(ObjectData),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        m_object_buffer,
+        m_object_buffer_memory
     );
 
-    vkBindImageMemory(device(), image, mem, 0);
+    m_object_buffer_capacity = capacity;
+
+    m_upload_all_objects = true;
 }
 
-VkCommandBuffer Engine::begin_single_time_commands() {
-    VkCommandBufferAllocateInfo alloc_info_cmd{
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = m_transient_command_pool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1 
+usize Engine::pending_upload_count() const {
+    if (m_upload_all_objects)
+        return m_render_objects.size();
+    return m_frame_packet ? m_frame_packet->dirty_objects.size() : 0;
+}
+
+void Engine::begin_transient_frame(usize frame) {
+    // The instance indices need room for as many objects as the descriptors cover.
+    const VkDeviceSize size =
+        m_frame_allocator->uniform_footprint(sizeof(CameraUBO)) +
+        m_frame_allocator->storage_footprint(m_object_buffer_capacity * sizeof(u32)) +
+        VulkanFrameAllocator::footprint(pending_upload_count() * sizeof(ObjectData), alignof(ObjectData));
+
+    // The instance descriptor's range follows the object buffer's capacity, so it can only be written once the frame
+    // allocator has grown to fit it.
+    const bool frame_buffer_changed = m_frame_allocator->begin_frame((u32) frame, size);
+    if (frame_buffer_changed)
+        update_camera_descriptor(frame);
+    if (frame_buffer_changed || m_object_descriptor_buffers[frame] != m_object_buffer)
+        update_object_descriptor_sets(frame);
+}
+
+void Engine::upload_dirty_objects(VkCommandBuffer command_buffer) {
+    const usize upload_count = pending_upload_count();
+
+    m_transforms_written = upload_count;
+    if (upload_count == 0) {
+        m_upload_all_objects = false;
+        return;
+    }
+
+    auto staging = m_frame_allocator->allocate(upload_count * sizeof(ObjectData), alignof(ObjectData));
+    auto* object_data = reinterpret_cast<ObjectData*>(staging.mapped);
+
+    std::vector<VkBufferCopy> regions;
+    if (m_upload_all_objects) {
+        // A new object buffer, everything goes out in one copy.
+        memcpy(object_data, m_render_objects.data(), upload_count * sizeof(ObjectData));
+        regions.push_back({
+            .srcOffset = staging.offset,
+            .dstOffset = 0,
+            .size = upload_count * sizeof(ObjectData)
+        });
+    } else {
+        // The dirty objects come sorted, so neighbours end up next to each other in the staging memory and share a copy.
+        const auto& dirty_objects = m_frame_packet->dirty_objects;
+        for (usize i = 0; i < dirty_objects.size(); i++) {
+            const u32 index = dirty_objects[i];
+
+            object_data[i] = m_render_objects[index];
+
+            if (i > 0 && dirty_objects[i - 1] + 1 == index) {
+                regions.back().size += sizeof(ObjectData);
+            } else {
+                regions.push_back({
+                    .srcOffset = staging.offset + i * sizeof(ObjectData),
+                    .dstOffset = index * sizeof(ObjectData),
+                    .size = sizeof(ObjectData)
+                });
+            }
+        }
+    }
+
+    m_upload_all_objects = false;
+
+    // Earlier frames may still be reading the transforms that are about to be overwritten.
+    VkMemoryBarrier read_barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT
     };
-    VkCommandBuffer command_buffer;
-    vulkan_check_res(
-        vkAllocateCommandBuffers(device(), &alloc_info_cmd, &command_buffer),
-        "failed to allocate transfer command buffer"
+    vkCmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1, &read_barrier,
+        0, nullptr,
+        0, nullptr
     );
 
-    VkCommandBufferBeginInfo begin_info{
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    vkCmdCopyBuffer(command_buffer, staging.buffer, m_object_buffer, regions.size(), regions.data());
+
+    // Make the new transforms visible to culling and the vertex shader.
+    VkMemoryBarrier write_barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT
     };
-    vulkan_check_res(
-        vkBeginCommandBuffer(command_buffer, &begin_info),
-        "failed to begin single time command buffer"
+    vkCmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &write_barrier,
+        0, nullptr,
+        0, nullptr
     );
+}
 
-    return command_buffer;
+void Engine::update_cull_bounds() {
+    const usize object_count = m_render_objects.size();
+    m_cull_bounds_x.resize(object_count);
+    m_cull_bounds_y.resize(object_count);
+    m_cull_bounds_z.resize(object_count);
+    m_cull_bounds_radius.resize(object_count);
+
+    // The same world space spheres cull.slang builds, so both culling modes agree.
+    // Only objects that changed need theirs moved, the rest are still right from earlier frames.
+    for (u32 index : m_frame_packet->dirty_objects) {
+        const auto& object = m_render_objects[index];
+        const glm::vec3 center(object.model * glm::vec4(glm::vec3(object.bounds), 1));
+
+        // Scale the radius by the largest axis scale of the model matrix.
+        const f32 scale = std::max({
+            glm::length(glm::vec3(object.model[0])),
+            glm::length(glm::vec3(object.model[1])),
+            glm::length(glm::vec3(object.model[2])),
+        });
+
+        m_cull_bounds_x[index] = center.x;
+        m_cull_bounds_y[index] = center.y;
+        m_cull_bounds_z[index] = center.z;
+        m_cull_bounds_radius[index] = object.bounds.w * scale;
+    }
 }
 
-void Engine::end_single_time_commands(VkCommandBuffer command_buffer) {
-    vulkan_check_res(
-        vkEndCommandBuffer(command_buffer),
-        "failed to end single time command buffer"
+void Engine::update_object_descriptor_sets(usize frame) {
+    VkDescriptorBufferInfo objects_info{
+        .buffer = m_object_buffer,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+
+    // The instance indices move around the frame allocator, so the descriptor covers as many as the object buffer can hold.
+    VkDescriptorBufferInfo instances_info{
+        .buffer = m_frame_allocator->buffer(frame),
+        .offset = 0,
+        .range = m_object_buffer_capacity * sizeof(u32),
+    };
+
+    std::vector<VkWriteDescriptorSet> descriptor_writes;
+    for (auto set : { m_object_descriptor_sets[frame], m_cull_frames[frame].m_descriptor_set }) {
+        if (set == VK_NULL_HANDLE)
+            continue;
+
+        descriptor_writes.push_back({
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = set,
+            .dstBinding = 0,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &objects_info,
+        });
+        descriptor_writes.push_back({
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = set,
+            .dstBinding = 1,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .pBufferInfo = &instances_info,
+        });
+    }
+    vkUpdateDescriptorSets(device(), descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
+
+    m_object_descriptor_buffers[frame] = m_object_buffer;
+}
+
+void Engine::record_gpu_culling(VkCommandBuffer command_buffer) {
+    auto& frame = m_cull_frames[m_current_frame];
+    const u32 object_count = (u32) m_render_objects.size();
+
+    // Reset the draw command and count. The culling shader fills in instance_count.
+    VkDrawIndexedIndirectCommand draw_command{
+        .indexCount = (u32) INDICES.size(),
+        .instanceCount = 0,
+        .firstIndex = 0,
+        .vertexOffset = 0,
+        .firstInstance = 0
+    };
+    vkCmdUpdateBuffer(command_buffer, frame.m_draw_commands, 0, sizeof(draw_command), &draw_command);
+    vkCmdFillBuffer(command_buffer, frame.m_draw_count, 0, sizeof(u32), 0);
+
+    VkMemoryBarrier reset_barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    };
+    vkCmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &reset_barrier,
+        0, nullptr,
+        0, nullptr
     );
 
-    VkSubmitInfo submit_info{
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &command_buffer
+    CullPushConstants push_constants{
+        .view_proj = m_render_camera.proj_mtx() * m_render_camera.view_mtx(),
+        .object_count = object_count
+    };
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cull_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cull_pipeline_layout, 0, 1, &frame.m_descriptor_set, 1, &m_instance_offset);
+    vkCmdPushConstants(command_buffer, m_cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    constexpr u32 WORKGROUP_SIZE = 64;
+    vkCmdDispatch(command_buffer, (object_count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    // Make the results visible to the indirect draw, the vertex shader and the readback copy.
+    VkMemoryBarrier cull_barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT
     };
+    vkCmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1, &cull_barrier,
+        0, nullptr,
+        0, nullptr
+    );
 
-    // TODO: Return a fence for the caller to wait on to allow less stalling 
-    // (lets us start single time tasks while others are already in flight and wait on all of them in one go... or just one since queues execute command buffers sequentially)
-    vkQueueSubmit(graphics_queue(), 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphics_queue());
+    VkBufferCopy readback_region{
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = sizeof(VkDrawIndexedIndirectCommand)
+    };
+    vkCmdCopyBuffer(command_buffer, frame.m_draw_commands, frame.m_readback, 1, &readback_region);
 
-    vkFreeCommandBuffers(device(), m_transient_command_pool, 1, &command_buffer);
+    // The fence alone doesn't make the copy visible to the host, render_frame reads it once this frame slot comes around again.
+    VkMemoryBarrier readback_barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT
+    };
+    vkCmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        1, &readback_barrier,
+        0, nullptr,
+        0, nullptr
+    );
 }
 
-void Engine::transition_image_layout(VkCommandBuffer command_buffer, VkImage image, VkAccessFlags src_access_mask, VkAccessFlags dst_access_mask, VkImageLayout src_layout, VkImageLayout dst_layout, VkPipelineStageFlags src_stage_mask, VkPipelineStageFlags dst_stage_mask, VkImageAspectFlags aspect_mask, u32 layer_count) {
+void Engine::transition_image_layout(VkCommandBuffer command_buffer, VkImage image, VkAccessFlags src_access_mask, VkAccessFlags dst_access_mask, VkImageLayout src_layout, VkImageLayout dst_layout, VkPipelineStageFlags src_stage_mask, VkPipelineStageFlags dst_stage_mask, VkImageAspectFlags aspect_mask, u32 layer_count, u32 level_count) {
     // TODO: Use vkCmdPipelineBarrier2 provided by Vulkan 1.3
     VkImageMemoryBarrier memory_barrier_1{
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
@@ -1861,7 +2888,7 @@ void Engine::transition_image_layout(VkCommandBuffer command_buffer, VkImage ima
         .subresourceRange = {
             .aspectMask = aspect_mask,
             .baseMipLevel = 0,
-            .levelCount = 1,
+            .levelCount = level_count,
             .baseArrayLayer = 0,
             .layerCount = layer_count,
         }
@@ -1880,64 +2907,199 @@ void Engine::transition_image_layout(VkCommandBuffer command_buffer, VkImage ima
     );
 }
 
+bool Engine::format_supported(VkFormat format, VkFormatFeatureFlags features) {
+    // Block compressed formats can report features even with the device feature disabled.
+    if (format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK && !m_device->texture_compression_bc())
+        return false;
+
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device(), format, &format_properties);
+    return (format_properties.optimalTilingFeatures & features) == features;
+}
+
+void Engine::generate_mipmaps(VkCommandBuffer command_buffer, VkImage image, VkFormat format, u32 width, u32 height, u32 mip_levels, u32 layer_count) {
+    if (!format_supported(format, VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+        throw std::runtime_error("image format doesn't support linear blitting");
+    }
+
+    auto barrier = [&](u32 level, VkAccessFlags src_access_mask, VkAccessFlags dst_access_mask, VkImageLayout src_layout, VkImageLayout dst_layout, VkPipelineStageFlags dst_stage_mask) {
+        VkImageMemoryBarrier memory_barrier{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = src_access_mask,
+            .dstAccessMask = dst_access_mask,
+            .oldLayout = src_layout,
+            .newLayout = dst_layout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = image,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = level,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = layer_count,
+            }
+        };
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage_mask, 0, 0, nullptr, 0, nullptr, 1, &memory_barrier);
+    };
+
+    i32 mip_width = (i32) width;
+    i32 mip_height = (i32) height;
+
+    for (u32 level = 1; level < mip_levels; level++) {
+        // The previous level is done being written, read from it for this one.
+        barrier(level - 1, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+        i32 next_width = std::max(mip_width / 2, 1);
+        i32 next_height = std::max(mip_height / 2, 1);
+
+        VkImageBlit blit{
+            .srcSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = level - 1,
+                .baseArrayLayer = 0,
+                .layerCount = layer_count,
+            },
+            .srcOffsets = { { 0, 0, 0 }, { mip_width, mip_height, 1 } },
+            .dstSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = level,
+                .baseArrayLayer = 0,
+                .layerCount = layer_count,
+            },
+            .dstOffsets = { { 0, 0, 0 }, { next_width, next_height, 1 } },
+        };
+        vkCmdBlitImage(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        barrier(level - 1, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+        mip_width = next_width;
+        mip_height = next_height;
+    }
+
+    // The last level was only ever written to.
+    barrier(mip_levels - 1, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
 void Engine::recreate_swapchain() {
     // Wait for the device to be idle before recreating the swapchain
     vkDeviceWaitIdle(device());
 
-    auto last_extent = m_swapchain->extent();
+    auto last_extent = m_swapchain->extent();
+
+    m_swapchain->reset();
+
+    // Do things that may depend on the surface format here...
+
+    m_swapchain->create(m_frame_packet->window_width, m_frame_packet->window_height);
+
+    auto extent = m_swapchain->extent();
+
+    if (last_extent.width != extent.width || last_extent.height != extent.height) {
+        // Size changed.
+        
+        // TODO: Re-use existing image/memory if possible (eg. the new extent is smaller than the old one)
+        vkDestroyImageView(device(), m_depth_image_view, nullptr);
+        m_allocator->destroy_image(m_depth_image, m_depth_image_memory);
+
+        create_depth_image();
+    }
+
+    // Update the ImGui backend
+    {
+        std::lock_guard lock(m_imgui_mutex);
+        ImGui_ImplVulkan_SetMinImageCount(m_swapchain->min_image_count());
+    }
+
+    spdlog::info("finished swapchain recreate");
+}
+
+VkExtent2D Engine::target_extent() const {
+    return m_swapchain ? m_swapchain->extent() : m_offscreen_target->extent();
+}
+
+VkFormat Engine::target_format() const {
+    return m_swapchain ? m_swapchain->surface_format().format : m_offscreen_target->format();
+}
+
+VkImage Engine::target_image(u32 index) const {
+    return m_swapchain ? m_swapchain->image(index) : m_offscreen_target->image(index);
+}
+
+VkImageView Engine::target_image_view(u32 index) const {
+    return m_swapchain ? m_swapchain->image_view(index) : m_offscreen_target->image_view(index);
+}
+
+void Engine::update() {
+    PROFILE_SCOPE("update");
+
+    const auto now = std::chrono::steady_clock::now();
+    const auto diff = now - m_last_update;
+    m_last_update = now;
+
+    const f64 tick_length = 1.0 / m_tick_rate;
 
-    m_swapchain->reset();
+    // Benchmarks always step one tick per frame and draw exactly that, whatever the frame took, so every run sees
+    // the same frames.
+    if (m_config.benchmark) {
+        m_scene.save_previous_transforms();
+        m_previous_camera_pos = m_camera.pos();
 
-    // Do things that may depend on the surface format here...
+        tick((f32) tick_length);
 
-    m_swapchain->create(m_window_width, m_window_height);
+        m_frame_ticks = 1;
+        m_tick_alpha = 1;
+        m_scene.interpolate(m_tick_alpha);
+        return;
+    }
 
-    auto extent = m_swapchain->extent();
+    m_tick_accumulator += std::chrono::duration_cast<std::chrono::duration<f64>>(diff).count();
 
-    if (last_extent.width != extent.width || last_extent.height != extent.height) {
-        // Size changed.
-        
-        // TODO: Re-use existing image/memory if possible (eg. the new extent is smaller than the old one)
-        vkDestroyImageView(device(), m_depth_image_view, nullptr);
-        vkDestroyImage(device(), m_depth_image, nullptr);
-        vkFreeMemory(device(), m_depth_image_memory, nullptr);
+    m_frame_ticks = 0;
+    while (m_tick_accumulator >= tick_length && m_frame_ticks < MAX_TICKS_PER_FRAME) {
+        m_scene.save_previous_transforms();
+        m_previous_camera_pos = m_camera.pos();
 
-        create_depth_image();
+        tick((f32) tick_length);
+
+        m_tick_accumulator -= tick_length;
+        m_frame_ticks++;
     }
 
-    // Update the ImGui backend
-    ImGui_ImplVulkan_SetMinImageCount(m_swapchain->min_image_count());
+    // Drop whatever we couldn't catch up on.
+    m_tick_accumulator = std::min(m_tick_accumulator, tick_length);
 
-    spdlog::info("finished swapchain recreate");
+    m_tick_alpha = (f32) (m_tick_accumulator / tick_length);
+    m_scene.interpolate(m_tick_alpha);
 }
 
-void Engine::update() {
-    const auto now = std::chrono::steady_clock::now();
-    const auto diff = now - m_last_update;
-    m_last_update = now;
-
-    const auto time_delta = std::chrono::duration_cast<std::chrono::duration<f32>>(diff).count();
+void Engine::tick(f32 time_delta) {
+    PROFILE_SCOPE("tick");
 
-    
     // Update camera position.
     f32 forward = 0;
     f32 right = 0;
     f32 up = 0;
 
-    const auto keyboard_state = SDL_GetKeyboardState(nullptr);
-    
-    if (keyboard_state[SDL_GetScancodeFromKey(SDLK_W, nullptr)])
-        forward += 1;
-    if (keyboard_state[SDL_GetScancodeFromKey(SDLK_S, nullptr)])
-        forward -= 1;
-    if (keyboard_state[SDL_GetScancodeFromKey(SDLK_A, nullptr)])
-        right -= 1;
-    if (keyboard_state[SDL_GetScancodeFromKey(SDLK_D, nullptr)])
-        right += 1;
-    if (keyboard_state[SDL_GetScancodeFromKey(SDLK_SPACE, nullptr)])
-        up += 1;
-    if (keyboard_state[SDL_GetScancodeFromKey(SDLK_LCTRL, nullptr)])
-        up -= 1;
+    // Headless there's no keyboard, the camera stays put. Benchmarks fly it along their path instead.
+    if (m_config.benchmark) {
+        follow_camera_path(time_delta);
+    } else if (!m_config.headless) {
+        const auto keyboard_state = SDL_GetKeyboardState(nullptr);
+
+        if (keyboard_state[SDL_GetScancodeFromKey(SDLK_W, nullptr)])
+            forward += 1;
+        if (keyboard_state[SDL_GetScancodeFromKey(SDLK_S, nullptr)])
+            forward -= 1;
+        if (keyboard_state[SDL_GetScancodeFromKey(SDLK_A, nullptr)])
+            right -= 1;
+        if (keyboard_state[SDL_GetScancodeFromKey(SDLK_D, nullptr)])
+            right += 1;
+        if (keyboard_state[SDL_GetScancodeFromKey(SDLK_SPACE, nullptr)])
+            up += 1;
+        if (keyboard_state[SDL_GetScancodeFromKey(SDLK_LCTRL, nullptr)])
+            up -= 1;
+    }
 
     glm::vec3 dir_xz = m_camera.dir_xz();
 
@@ -1950,19 +3112,78 @@ void Engine::update() {
 
     m_camera.set_pos(m_camera.pos() + move_dir);
     m_camera.update_rot();
+
+    // Spin the dynamic objects. Static ones are never touched after they're created.
+    if (m_animate_dynamic_objects) {
+        const auto spin = glm::angleAxis(time_delta, glm::vec3{ 0, 1, 0 });
+
+        for (auto handle : m_scene.dynamic_objects()) {
+            const u32 index = m_scene.index_of(handle);
+            m_scene.set_transform(handle, m_scene.positions()[index], spin * m_scene.rotations()[index]);
+        }
+    }
+
+    update_spawn_stress(time_delta);
+}
+
+void Engine::follow_camera_path(f32 time_delta) {
+    m_camera_path_time += time_delta;
+
+    const glm::vec3 pos = m_camera_path.position(m_camera_path_time);
+    m_camera.set_pos(pos);
+
+    // Yaw turns -Z towards +X and pitch turns it towards +Y, see Camera::update_rot().
+    const glm::vec3 to_center = -pos;
+    if (glm::length(to_center) > 0.001f) {
+        const glm::vec3 dir = glm::normalize(to_center);
+        m_camera.set_yaw(glm::degrees(std::atan2(dir.x, -dir.z)));
+        m_camera.set_pitch(glm::degrees(std::asin(dir.y)));
+    }
+
+    m_camera.update_rot();
+}
+
+void Engine::update_spawn_stress(f32 time_delta) {
+    if (!m_spawn_stress) {
+        for (const auto& spawned : m_spawned_objects) {
+            despawn_object(spawned.handle);
+        }
+        m_spawned_objects.clear();
+        m_spawn_debt = 0;
+        return;
+    }
+
+    m_spawn_clock += time_delta;
+
+    // Objects are despawned in the order they were spawned, so the oldest ones are always at the front.
+    while (!m_spawned_objects.empty() && m_spawned_objects.front().despawn_time <= m_spawn_clock) {
+        despawn_object(m_spawned_objects.front().handle);
+        m_spawned_objects.pop_front();
+    }
+
+    // Carry the fractional part over so low rates still spawn something.
+    m_spawn_debt += m_spawn_rate * time_delta;
+    const auto spawn_count = (usize) m_spawn_debt;
+    m_spawn_debt -= spawn_count;
+
+    std::uniform_real_distribution<f32> pos_dist(-20, 20);
+    for (usize i = 0; i < spawn_count; i++) {
+        glm::vec3 pos{ pos_dist(m_spawn_rng), pos_dist(m_spawn_rng), pos_dist(m_spawn_rng) };
+        auto handle = spawn_object(pos, random_rotation(m_spawn_rng), ObjectMobility::Static);
+        m_spawned_objects.push_back({ .handle = handle, .despawn_time = m_spawn_clock + m_spawn_lifetime });
+    }
 }
 
 void Engine::update_graphics() {
-    // Handle swapchain recreation before rendering a frame.
-    if (m_window_resized || m_need_swapchain_recreate) {
-        m_window_resized = m_need_swapchain_recreate = false;
+    if (m_swapchain && m_render_settings.vsync != m_swapchain->vsync()) {
+        // Update swapchain if vsync setting changed
+        m_swapchain->set_vsync(m_render_settings.vsync);
+        m_need_swapchain_recreate = true;
+    }
 
-        // We update window size in the SDL resize event, but let's double check 
-        // that it's correct in case the state somehow gets out of sync
-        int width, height;
-        SDL_GetWindowSizeInPixels(m_window, &width, &height);
-        m_window_width = (u32) width;
-        m_window_height = (u32) height;
+    // Handle swapchain recreation before rendering a frame.
+    if (m_frame_packet->window_resized || m_need_swapchain_recreate) {
+        m_need_swapchain_recreate = false;
 
         recreate_swapchain();
     }
@@ -1971,16 +3192,50 @@ void Engine::update_graphics() {
 }
 
 void Engine::render_frame() {
+    PROFILE_SCOPE("render_frame");
+
     VkSemaphore image_available_semaphore = m_image_available_semaphores[m_current_frame];
     VkFence in_flight_fence = m_in_flight_fences[m_current_frame];
 
-    vkWaitForFences(device(), 1, &in_flight_fence, VK_TRUE, UINT64_MAX);
+    // A frame that ends early doesn't get as far as some of these.
+    m_acquire_time = {};
+    m_submit_time = {};
+    m_present_time = {};
+
+    {
+        PROFILE_SCOPE("vkWaitForFences");
+        auto start = std::chrono::steady_clock::now();
+        vkWaitForFences(device(), 1, &in_flight_fence, VK_TRUE, UINT64_MAX);
+        m_fence_wait_time = std::chrono::steady_clock::now() - start;
+    }
     vkResetFences(device(), 1, &in_flight_fence);
 
-    VkResult acquire_result = m_swapchain->acquire(image_available_semaphore, m_image_index);
+    // The frame that last used this slot is done, so its timestamps are in without waiting.
+    read_gpu_times(m_current_frame);
+
+    // Uploads queued since the last frame go out ahead of it, the same queue keeps them in order.
+    {
+        PROFILE_SCOPE("flush uploads");
+        m_uploader->flush();
+    }
+
+    // Offscreen images are free as soon as the frame that last used them is, which the fence above already waited for.
+    VkResult acquire_result = VK_SUCCESS;
+    {
+        PROFILE_SCOPE("acquire");
+        auto start = std::chrono::steady_clock::now();
+        if (m_swapchain)
+            acquire_result = m_swapchain->acquire(image_available_semaphore, m_image_index);
+        else
+            m_image_index = m_offscreen_target->acquire();
+        m_acquire_time = std::chrono::steady_clock::now() - start;
+    }
 
     if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR) {
         m_need_swapchain_recreate = true;
+        // The packet's dirty objects are already in m_render_objects and won't come around again, so the next frame
+        // has to copy everything.
+        m_upload_all_objects = true;
         m_current_frame = (m_current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
         return;
     } else if (acquire_result == VK_SUBOPTIMAL_KHR) {
@@ -2001,38 +3256,80 @@ void Engine::render_frame() {
         "failed to begin recording command buffer"
     );
 
+    m_gpu_profiler->begin_frame(command_buffer, (u32) m_current_frame, m_frames_rendered);
+    const u32 frame_gpu_scope = m_gpu_profiler->begin_scope(command_buffer, "frame");
+
+    VulkanTransientSpan instance_span;
+
     {
-        auto extent = m_swapchain->extent();
+        auto extent = target_extent();
+
+        m_render_camera.set_aspect_ratio((f32) extent.width / extent.height);
+        m_render_camera.update_matrices();
+
+        // The frame isn't in flight anymore, so its samplers can be swapped if mipmapping was toggled.
+        if (m_descriptor_set_mipmaps[m_current_frame] != m_render_settings.use_mipmaps)
+            update_texture_descriptors(m_current_frame);
+
+        // Object buffers replaced before this frame slot was last used aren't needed by anything anymore.
+        for (auto& [buffer, memory] : m_retired_object_buffers[m_current_frame])
+            m_allocator->destroy_buffer(buffer, memory);
+        m_retired_object_buffers[m_current_frame].clear();
+
+        reserve_object_buffer(m_render_objects.size());
 
-        m_camera.set_aspect_ratio((f32) extent.width / extent.height);
-        m_camera.update_matrices();
+        // Everything this frame allocates from here on is gone by the time it comes around again.
+        // Also points the frame's object descriptors at the object buffer, if that was just replaced.
+        begin_transient_frame(m_current_frame);
 
         CameraUBO camera_ubo{
-            .view = m_camera.view_mtx(),
-            .proj = m_camera.proj_mtx()
+            .view = m_render_camera.view_mtx(),
+            .proj = m_render_camera.proj_mtx()
         };
 
-        // Write Camera UBO.
-        memcpy(m_camera_ubo_data[m_current_frame], &camera_ubo, sizeof(CameraUBO));
+        auto camera_span = m_frame_allocator->allocate_uniform(sizeof(CameraUBO));
+        memcpy(camera_span.mapped, &camera_ubo, sizeof(CameraUBO));
+        m_camera_offset = camera_span.offset;
 
-        for (const auto& object : m_scene_objects) {
-            auto id = glm::identity<glm::mat4x4>();
-            auto rotate = glm::mat4_cast(object.m_rot); // They could not have made this function any less obscure
-            auto translate = glm::translate(id, object.m_pos);
+        // Room for every object's instance index, written by culling below. Left alone when nothing is culled, but the
+        // descriptor still needs somewhere to point.
+        instance_span = m_frame_allocator->allocate_storage(m_object_buffer_capacity * sizeof(u32));
+        m_instance_offset = instance_span.offset;
 
-            CubeUBO cube_ubo{
-                .model = translate * rotate
-            };
+        // Only objects that were created or moved since the last frame get their transform copied.
+        upload_dirty_objects(command_buffer);
+    }
 
-            // Write Cube UBO.
-            memcpy(object.m_ubo_data[m_current_frame], &cube_ubo, sizeof(CubeUBO));
-        }
+    if (m_render_settings.cull_mode == CullMode::Gpu) {
+        // The readback copy was recorded the last time this frame slot was used and that work is done now.
+        const auto* last_command = static_cast<const VkDrawIndexedIndirectCommand*>(m_cull_frames[m_current_frame].m_readback_memory.mapped);
+        m_visible_objects = last_command->instanceCount;
+
+        const u32 cull_gpu_scope = m_gpu_profiler->begin_scope(command_buffer, "culling");
+        record_gpu_culling(command_buffer);
+        m_gpu_profiler->end_scope(command_buffer, cull_gpu_scope);
+    } else if (m_render_settings.cull_mode == CullMode::Cpu) {
+        PROFILE_SCOPE("cpu culling");
+        auto start = std::chrono::steady_clock::now();
+
+        // The bounds were kept up to date by apply_frame_packet().
+        CullSpheres spheres{ m_cull_bounds_x, m_cull_bounds_y, m_cull_bounds_z, m_cull_bounds_radius };
+        auto frustum = Frustum::from_matrix(m_render_camera.proj_mtx() * m_render_camera.view_mtx());
+
+        // Cull straight into the instance indices so only visible objects are drawn.
+        auto* instance_data = reinterpret_cast<u32*>(instance_span.mapped);
+        m_visible_objects = cull_spheres(frustum, spheres, instance_data, m_render_settings.cull_backend);
+
+        m_cpu_cull_time = std::chrono::steady_clock::now() - start;
+    } else {
+        // Without culling every object is drawn, in order, by m_unculled_pipeline which doesn't read the instance indices.
+        m_visible_objects = m_render_objects.size();
     }
 
     // Transition the swapchain image to be suitable for rendering.
     transition_image_layout(
         command_buffer,
-        m_swapchain->image(m_image_index),
+        target_image(m_image_index),
         0,
         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
         VK_IMAGE_LAYOUT_UNDEFINED,
@@ -2058,7 +3355,7 @@ void Engine::render_frame() {
 
     VkRenderingAttachmentInfo color_attachment{
         .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
-        .imageView = m_swapchain->image_view(m_image_index),
+        .imageView = target_image_view(m_image_index),
         .imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
         .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
         .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
@@ -2078,7 +3375,7 @@ void Engine::render_frame() {
         .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
         .renderArea = {
             .offset = { 0, 0 },
-            .extent = m_swapchain->extent()
+            .extent = target_extent()
         },
         .layerCount = 1,
         .colorAttachmentCount = 1,
@@ -2086,78 +3383,101 @@ void Engine::render_frame() {
         .pDepthAttachment = &depth_attachment,
     };
 
-    vkCmdBeginRendering(command_buffer, &rendering_info);
+    // With parallel recording, everything inside the rendering pass comes from secondary command buffers.
+    if (m_render_settings.parallel_recording)
+        rendering_info.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
 
-    // Set viewport and scissor, which are dynamic.
-    VkViewport viewport{
-        .x = 0,
-        .y = 0,
-        .width = (f32) m_swapchain->extent().width,
-        .height = (f32) m_swapchain->extent().height,
-        .minDepth = 0,
-        .maxDepth = 1
-    };
+    // Both are started by whatever records the skybox, see record_scene_draws().
+    m_skybox_gpu_scope = m_gpu_profiler->add_scope("skybox");
+    m_cubes_gpu_scope = m_gpu_profiler->add_scope("cubes");
 
-    VkRect2D scissor{
-        .offset = { 0, 0 },
-        .extent = m_swapchain->extent()
-    };
+    vkCmdBeginRendering(command_buffer, &rendering_info);
 
     {
-        VkBuffer vertex_bufs[] = { m_cubemap_vertex_buffer };
-        VkDeviceSize offsets[] = { 0 };
-
-        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_cubemap_pipeline);
-        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
-        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
-        vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_bufs, offsets);
-        vkCmdBindIndexBuffer(command_buffer, m_cubemap_index_buffer, 0, VK_INDEX_TYPE_UINT16);
-        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_cubemap_pipeline_layout, 0, 1, &m_descriptor_sets[m_current_frame], 0, nullptr);
-        vkCmdDrawIndexed(command_buffer, (u32) CUBEMAP_INDICES.size(), 1, 0, 0, 0);
-    }
+        PROFILE_SCOPE("record main pass");
+        auto start = std::chrono::steady_clock::now();
+        const usize item_count = scene_draw_items();
 
-    {
-        VkBuffer vertex_bufs[] = { m_vertex_buffer };
-        VkDeviceSize offsets[] = { 0 };
+        if (m_render_settings.parallel_recording) {
+            const auto color_attachment_formats = std::to_array({ target_format() });
 
-        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
-        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
-        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
-        vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_bufs, offsets);
-        vkCmdBindIndexBuffer(command_buffer, m_index_buffer, 0, VK_INDEX_TYPE_UINT16);
+            VkCommandBufferInheritanceRenderingInfo inheritance_rendering_info{
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+                .colorAttachmentCount = color_attachment_formats.size(),
+                .pColorAttachmentFormats = color_attachment_formats.data(),
+                .depthAttachmentFormat = VK_FORMAT_D32_SFLOAT,
+                .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+            };
 
-        for (const auto& object : m_scene_objects) {
-            // Bind the object's descriptor set.
-            const auto descriptor_sets = std::to_array({ m_descriptor_sets[m_current_frame], object.m_descriptor_sets[m_current_frame] });
-            vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, descriptor_sets.size(), descriptor_sets.data(), 0, nullptr);
+            VkCommandBufferInheritanceInfo inheritance_info{
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+                .pNext = &inheritance_rendering_info
+            };
 
-            // Draw the object.
-            vkCmdDrawIndexed(command_buffer, (u32) INDICES.size(), 1, 0, 0, 0);
+            auto secondaries = m_recorder->record((u32) m_current_frame, inheritance_info, (u32) m_render_settings.record_thread_count, item_count,
+                [&](VkCommandBuffer secondary, u32 chunk, usize first, usize count) {
+                    // The first chunk is executed first, so it draws the skybox.
+                    record_scene_draws(secondary, first, count, chunk == 0);
+                }
+            );
+            vkCmdExecuteCommands(command_buffer, (u32) secondaries.size(), secondaries.data());
+        } else {
+            record_scene_draws(command_buffer, 0, item_count, true);
         }
+
+        m_record_time = std::chrono::steady_clock::now() - start;
+        update_record_benchmark();
     }
 
     vkCmdEndRendering(command_buffer);
 
+    // Outside the rendering, with parallel recording the primary can't write timestamps inside it.
+    m_gpu_profiler->write_end(command_buffer, m_cubes_gpu_scope);
+
     // Render imgui.
-    render_imgui(command_buffer);
+    if (!m_config.headless) {
+        const u32 imgui_gpu_scope = m_gpu_profiler->begin_scope(command_buffer, "imgui");
+        render_imgui(command_buffer);
+        m_gpu_profiler->end_scope(command_buffer, imgui_gpu_scope);
+    }
 
-    // Transition the image back to be suitable for presenting.
+    // Transition the image back to be suitable for presenting, or for reading back when headless.
     transition_image_layout(
         command_buffer,
-        m_swapchain->image(m_image_index),
+        target_image(m_image_index),
         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
         0,
         VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        m_swapchain ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
     );
+
+    m_gpu_profiler->end_scope(command_buffer, frame_gpu_scope);
         
     vulkan_check_res(
         vkEndCommandBuffer(command_buffer),
         "failed to end command buffer"
     );
 
+    if (!m_swapchain) {
+        // Nothing to wait for or present, the fence is all that tells us the frame is done.
+        VkSubmitInfo submit_info{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &command_buffer
+        };
+
+        PROFILE_SCOPE("submit");
+        auto start = std::chrono::steady_clock::now();
+        VkResult submit_result = vkQueueSubmit(graphics_queue(), 1, &submit_info, in_flight_fence);
+        vulkan_check_res(submit_result, "failed to submit draw command buffer for {}", m_image_index);
+        m_submit_time = std::chrono::steady_clock::now() - start;
+
+        m_current_frame = (m_current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+        return;
+    }
+
     VkSemaphore wait_semaphores[] = { image_available_semaphore };
     VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
     auto signal_semaphores = std::to_array({ m_swapchain->submit_semaphore(m_image_index) });
@@ -2174,10 +3494,21 @@ void Engine::render_frame() {
         .pSignalSemaphores = signal_semaphores.data()
     };
 
-    VkResult submit_result = vkQueueSubmit(graphics_queue(), 1, &submit_info, in_flight_fence);
-    vulkan_check_res(submit_result, "failed to submit draw command buffer for {}", m_image_index);
+    {
+        PROFILE_SCOPE("submit");
+        auto start = std::chrono::steady_clock::now();
+        VkResult submit_result = vkQueueSubmit(graphics_queue(), 1, &submit_info, in_flight_fence);
+        vulkan_check_res(submit_result, "failed to submit draw command buffer for {}", m_image_index);
+        m_submit_time = std::chrono::steady_clock::now() - start;
+    }
 
-    VkResult present_result = m_swapchain->present(present_queue(), signal_semaphores, m_image_index);
+    VkResult present_result;
+    {
+        PROFILE_SCOPE("present");
+        auto start = std::chrono::steady_clock::now();
+        present_result = m_swapchain->present(present_queue(), signal_semaphores, m_image_index);
+        m_present_time = std::chrono::steady_clock::now() - start;
+    }
 
     if (present_result == VK_SUBOPTIMAL_KHR || present_result == VK_ERROR_OUT_OF_DATE_KHR) {
         // Recreate swapchain next frame. We usually get this right before SDL sends a resize event anyway
@@ -2189,10 +3520,119 @@ void Engine::render_frame() {
     m_current_frame = (m_current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
+void Engine::record_scene_draws(VkCommandBuffer command_buffer, usize first, usize count, bool draw_skybox) {
+    // Set viewport and scissor, which are dynamic.
+    VkViewport viewport{
+        .x = 0,
+        .y = 0,
+        .width = (f32) target_extent().width,
+        .height = (f32) target_extent().height,
+        .minDepth = 0,
+        .maxDepth = 1
+    };
+
+    VkRect2D scissor{
+        .offset = { 0, 0 },
+        .extent = target_extent()
+    };
+
+    if (draw_skybox) {
+        m_gpu_profiler->write_begin(command_buffer, m_skybox_gpu_scope);
+
+        VkBuffer vertex_bufs[] = { m_cubemap_vertex_buffer };
+        VkDeviceSize offsets[] = { 0 };
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_cubemap_pipeline);
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_bufs, offsets);
+        vkCmdBindIndexBuffer(command_buffer, m_cubemap_index_buffer, 0, VK_INDEX_TYPE_UINT16);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_cubemap_pipeline_layout, 0, 1, &m_descriptor_sets[m_current_frame], 1, &m_camera_offset);
+        vkCmdDrawIndexed(command_buffer, (u32) CUBEMAP_INDICES.size(), 1, 0, 0, 0);
+
+        // The cubes come right after, possibly from other command buffers.
+        m_gpu_profiler->write_end(command_buffer, m_skybox_gpu_scope);
+        m_gpu_profiler->write_begin(command_buffer, m_cubes_gpu_scope);
+    }
+
+    {
+        VkBuffer vertex_bufs[] = { m_vertex_buffer };
+        VkDeviceSize offsets[] = { 0 };
+
+        const auto pipeline = m_render_settings.cull_mode == CullMode::None ? m_unculled_pipeline : m_pipeline;
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_bufs, offsets);
+        vkCmdBindIndexBuffer(command_buffer, m_index_buffer, 0, VK_INDEX_TYPE_UINT16);
+
+        const auto descriptor_sets = std::to_array({ m_descriptor_sets[m_current_frame], m_object_descriptor_sets[m_current_frame] });
+        // In set then binding order: the camera, then the instances.
+        const auto dynamic_offsets = std::to_array({ m_camera_offset, m_instance_offset });
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, descriptor_sets.size(), descriptor_sets.data(), dynamic_offsets.size(), dynamic_offsets.data());
+
+        // Every scene object is a cube, so a chunk of them goes out in a single instanced draw.
+        // The instance index includes firstInstance, which is how a chunk picks out its objects.
+        if (m_render_settings.cull_mode == CullMode::Gpu) {
+            const auto& frame = m_cull_frames[m_current_frame];
+
+            // The indirect draw is the only item.
+            if (count == 0)
+                return;
+
+            if (m_device->draw_indirect_count()) {
+                vkCmdDrawIndexedIndirectCount(command_buffer, frame.m_draw_commands, 0, frame.m_draw_count, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+            } else {
+                // Without the count, a mesh with no visible instances is just an empty draw.
+                vkCmdDrawIndexedIndirect(command_buffer, frame.m_draw_commands, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+            }
+        } else if (m_render_settings.draw_per_object) {
+            for (usize i = first; i < first + count; i++)
+                vkCmdDrawIndexed(command_buffer, (u32) INDICES.size(), 1, 0, 0, (u32) i);
+        } else if (count > 0) {
+            vkCmdDrawIndexed(command_buffer, (u32) INDICES.size(), (u32) count, 0, 0, (u32) first);
+        }
+    }
+}
+
+usize Engine::scene_draw_items() const {
+    return m_render_settings.cull_mode == CullMode::Gpu ? 1 : m_visible_objects;
+}
+
+void Engine::update_record_benchmark() {
+    auto& bench = m_record_benchmark;
+    if (!bench.running)
+        return;
+
+    // The first few frames after switching thread counts are left out, they pay for the workers waking up.
+    constexpr u32 WARMUP_FRAMES = 10;
+    constexpr u32 MEASURED_FRAMES = 120;
+
+    bench.frames++;
+    if (bench.frames > WARMUP_FRAMES)
+        bench.total += m_record_time;
+    if (bench.frames < WARMUP_FRAMES + MEASURED_FRAMES)
+        return;
+
+    const u32 thread_count = bench.thread_counts[bench.step];
+    const f64 average = bench.total.count() / MEASURED_FRAMES;
+    bench.results.emplace_back(thread_count, average);
+
+    spdlog::info("recording {} draw items on {} threads: {:.3f} ms ({:.2f}x)", scene_draw_items(), thread_count, average, bench.results.front().second / average);
+
+    bench.step++;
+    bench.frames = 0;
+    bench.total = {};
+
+    // apply_frame_packet() switches to the next thread count.
+    if (bench.step == bench.thread_counts.size())
+        bench.running = false;
+}
+
 void Engine::render_imgui(VkCommandBuffer command_buffer) {
     VkRenderingAttachmentInfo color_attachment{
         .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
-        .imageView = m_swapchain->image_view(m_image_index),
+        .imageView = target_image_view(m_image_index),
         .imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
         .loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
         .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
@@ -2202,7 +3642,7 @@ void Engine::render_imgui(VkCommandBuffer command_buffer) {
         .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
         .renderArea = {
             .offset = { 0, 0 },
-            .extent = m_swapchain->extent()
+            .extent = target_extent()
         },
         .layerCount = 1,
         .colorAttachmentCount = 1,
@@ -2211,32 +3651,267 @@ void Engine::render_imgui(VkCommandBuffer command_buffer) {
 
     vkCmdBeginRendering(command_buffer, &rendering_info);
 
+    // The UI was built on the main thread, this only draws the copy of it in the frame packet.
+    {
+        std::lock_guard lock(m_imgui_mutex);
+        ImGui_ImplVulkan_RenderDrawData(m_frame_packet->imgui.draw_data(), command_buffer);
+    }
+
+    vkCmdEndRendering(command_buffer);
+}
+
+void Engine::read_gpu_times(usize frame) {
+    if (!m_gpu_profiler->read_results((u32) frame))
+        return;
+
+    if (!m_config.benchmark || m_gpu_profiler->last_frame_number() < m_config.warmup_frames)
+        return;
+
+    if (auto frame_time = m_gpu_profiler->last_time("frame"))
+        m_benchmark_samples.gpu.push_back(*frame_time);
+}
+
+void Engine::write_trace() {
+    // The first press only turns profiling on, there'd be nothing to write yet.
+    if (!profiler_enabled()) {
+        profiler_set_enabled(true);
+        spdlog::info("CPU profiling on, press F9 again to write a trace of the last {} frames", m_config.trace_frames);
+        return;
+    }
+
+    profiler_write_trace(m_config.trace_output.empty() ? "trace.json" : m_config.trace_output, m_config.trace_frames);
+}
+
+void Engine::build_frame_stats_ui() {
+    if (!ImGui::CollapsingHeader("Frame times"))
+        return;
+
+    const auto frame = m_frame_stats.summarize(&FrameSample::frame);
+    imgui_text("Last {} frames: p50 {:.2f} ms, p95 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms", frame.count, frame.p50, frame.p95, frame.p99, frame.max);
+    imgui_text("Stutters (over {}x the median): {}", FrameStats::STUTTER_FACTOR, m_frame_stats.stutter_count());
+
+    // Room for the usual spikes above a typical frame, anything longer is cut off.
+    const auto scale_max = (f32) std::max(frame.p99 * 1.5, 1000.0 / 60);
+
+    // The graph reads straight out of the ring, starting at the oldest sample.
+    const auto ring = m_frame_stats.ring();
+    if (!ring.empty()) {
+        ImGui::PlotLines("##frame_times", &ring[0].frame, (int) ring.size(), (int) m_frame_stats.oldest(),
+            fmt::format("frame time, 0 - {:.1f} ms", scale_max).c_str(), 0, scale_max, ImVec2(0, 80), sizeof(FrameSample));
+    }
+
+    std::array<f32, 50> buckets;
+    m_frame_stats.histogram(scale_max, buckets);
+    ImGui::PlotHistogram("##frame_time_histogram", buckets.data(), (int) buckets.size(), 0,
+        fmt::format("histogram, 0 - {:.1f} ms", scale_max).c_str(), 0, FLT_MAX, ImVec2(0, 80));
+
+    for (const auto& [name, member] : FRAME_SAMPLE_FIELDS) {
+        const auto summary = m_frame_stats.summarize(member);
+        imgui_text("{:<10} avg {:6.2f}  p95 {:6.2f}  p99 {:6.2f}  max {:6.2f} ms", name, summary.avg, summary.p95, summary.p99, summary.max);
+    }
+
+    if (ImGui::Button("Export CSV")) {
+        constexpr auto CSV_PATH = "frame_stats.csv";
+        if (m_frame_stats.write_csv(CSV_PATH))
+            spdlog::info("wrote {} frames to {}", m_frame_stats.size(), CSV_PATH);
+        else
+            spdlog::error("failed to write frame stats to {}", CSV_PATH);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear"))
+        m_frame_stats.clear();
+}
+
+void Engine::write_benchmark_results() {
+    auto out = fmt::memory_buffer();
+
+    auto write_summary = [&](std::string_view name, std::span<const f64> samples, bool last = false) {
+        const auto summary = summarize(samples);
+        spdlog::info("{:<14} min {:7.3f}  avg {:7.3f}  p50 {:7.3f}  p95 {:7.3f}  p99 {:7.3f}  max {:7.3f} ms",
+            name, summary.min, summary.avg, summary.p50, summary.p95, summary.p99, summary.max);
+
+        if (summary.count == 0) {
+            fmt::format_to(std::back_inserter(out), "  \"{}\": null{}\n", name, last ? "" : ",");
+            return;
+        }
+
+        fmt::format_to(std::back_inserter(out),
+            "  \"{}\": {{ \"count\": {}, \"min\": {:.4f}, \"avg\": {:.4f}, \"p50\": {:.4f}, \"p95\": {:.4f}, \"p99\": {:.4f}, \"max\": {:.4f} }}{}\n",
+            name, summary.count, summary.min, summary.avg, summary.p50, summary.p95, summary.p99, summary.max, last ? "" : ",");
+    };
+
+    const auto extent = target_extent();
+
+    fmt::format_to(std::back_inserter(out), "{{\n");
+    fmt::format_to(std::back_inserter(out), "  \"device\": {},\n", json_string(m_device->device_name()));
+    fmt::format_to(std::back_inserter(out), "  \"headless\": {},\n", m_config.headless);
+    fmt::format_to(std::back_inserter(out), "  \"width\": {},\n", extent.width);
+    fmt::format_to(std::back_inserter(out), "  \"height\": {},\n", extent.height);
+    fmt::format_to(std::back_inserter(out), "  \"seed\": {},\n", m_scene_seed);
+    fmt::format_to(std::back_inserter(out), "  \"object_count\": {},\n", m_config.object_count);
+    fmt::format_to(std::back_inserter(out), "  \"warmup_frames\": {},\n", m_config.warmup_frames);
+    fmt::format_to(std::back_inserter(out), "  \"measured_frames\": {},\n", m_config.frame_count);
+
+    write_summary("frame_ms", m_benchmark_samples.frame);
+    write_summary("cpu_update_ms", m_benchmark_samples.update);
+    write_summary("cpu_render_ms", m_benchmark_samples.render);
+    write_summary("gpu_ms", m_benchmark_samples.gpu, true);
+
+    fmt::format_to(std::back_inserter(out), "}}\n");
+
+    const auto& path = m_config.benchmark_output;
+    if (!write_file_atomic(path, std::span(reinterpret_cast<const u8*>(out.data()), out.size())))
+        throw std::runtime_error(fmt::format("failed to write benchmark results to {}", path.string()));
+
+    spdlog::info("wrote benchmark results to {}", path.string());
+}
+
+void Engine::build_imgui(FramePacket& packet) {
+    PROFILE_SCOPE("build_imgui");
+
+    std::lock_guard lock(m_imgui_mutex);
+
     ImGui_ImplVulkan_NewFrame();
     ImGui_ImplSDL3_NewFrame();
     ImGui::NewFrame();
 
     ImGui::Begin("Debug");
 
+    const auto& stats = m_render_stats;
+
     imgui_text("brampling3D ({} {}, {})", SDL_GetPlatform(), ENGINE_SYSTEM_PROCESSOR, SDL_GetCurrentVideoDriver());
     imgui_text("GPU: {}", m_device->device_name());
     auto& io = ImGui::GetIO();
     imgui_text("Frame time: {:.3f} ms ({:.1f} FPS)", 1000.0 / io.Framerate, io.Framerate);
+    imgui_text("Main thread: {:.3f} ms update, render thread: {:.3f} ms", m_update_time.count(), stats.render_time.count());
+
+    if (!stats.gpu_times.empty()) {
+        imgui_text("GPU time (rolling average):");
+        for (const auto& [name, ms] : stats.gpu_times)
+            imgui_text("  {:<8} {:.3f} ms", name, ms);
+    }
+    imgui_text("Tick rate: {} Hz, {} ticks this frame (alpha {:.2f})", m_tick_rate, m_frame_ticks, m_tick_alpha);
+    imgui_text("Objects: {} ({} dynamic, {} visible)", m_scene.size(), m_scene.dynamic_objects().size(), stats.visible_objects);
+    imgui_text("Transforms written: {}", stats.transforms_written);
+
+    ImGui::Separator();
+
+    build_frame_stats_ui();
+
+    if (ImGui::CollapsingHeader("GPU memory")) {
+        for (usize i = 0; i < stats.heaps.size(); i++) {
+            const auto& heap = stats.heaps[i];
+            constexpr f64 MIB = 1024.0 * 1024.0;
+
+            imgui_text("Heap {}{}: {:.1f} / {:.1f} MiB used in {} blocks, {} allocations (heap {:.0f} MiB)",
+                i,
+                (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "",
+                heap.used_bytes / MIB,
+                heap.block_bytes / MIB,
+                heap.block_count,
+                heap.allocation_count,
+                heap.heap_size / MIB
+            );
+        }
+
+        imgui_text("Frame allocator: {:.1f} / {:.1f} KiB used by the last frame",
+            stats.frame_allocator_used / 1024.0,
+            stats.frame_allocator_capacity / 1024.0
+        );
+    }
 
     ImGui::Separator();
 
     imgui_text("Settings");
-    ImGui::Checkbox("V-sync", &m_vsync);
+    ImGui::Checkbox("V-sync", &m_settings.vsync);
+
+    bool profiling = profiler_enabled();
+    if (ImGui::Checkbox("CPU profiling", &profiling))
+        profiler_set_enabled(profiling);
+    ImGui::SameLine();
+    if (ImGui::Button("Write trace (F9)"))
+        write_trace();
+    ImGui::Checkbox("Animate dynamic objects", &m_animate_dynamic_objects);
+
+    if (ImGui::BeginCombo("Tick rate", fmt::format("{} Hz", m_tick_rate).c_str())) {
+        for (u32 tick_rate : TICK_RATES) {
+            if (ImGui::Selectable(fmt::format("{} Hz", tick_rate).c_str(), tick_rate == m_tick_rate))
+                m_tick_rate = tick_rate;
+        }
+        ImGui::EndCombo();
+    }
 
-    if (m_vsync != m_swapchain->vsync()) {
-        // Update swapchain if vsync setting changed
-        m_swapchain->set_vsync(m_vsync);
-        m_need_swapchain_recreate = true;
+    constexpr auto CULL_MODE_NAMES = std::to_array({ "None", "CPU", "GPU" });
+    ImGui::Combo("Culling", (int*) &m_settings.cull_mode, CULL_MODE_NAMES.data(), CULL_MODE_NAMES.size());
+
+    if (m_settings.cull_mode == CullMode::Cpu) {
+        if (ImGui::BeginCombo("CPU culling backend", cull_backend_name(m_settings.cull_backend).data())) {
+            for (auto backend : { CullBackend::Scalar, CullBackend::Sse, CullBackend::Avx2 }) {
+                if (!cull_backend_supported(backend))
+                    continue;
+
+                if (ImGui::Selectable(cull_backend_name(backend).data(), backend == m_settings.cull_backend))
+                    m_settings.cull_backend = backend;
+            }
+            ImGui::EndCombo();
+        }
+
+        imgui_text("CPU cull time: {:.3f} ms", stats.cpu_cull_time.count());
+    }
+
+    if (ImGui::CollapsingHeader("Recording")) {
+        // The render thread overrides these while the benchmark runs.
+        ImGui::BeginDisabled(stats.record_benchmark_running);
+        ImGui::Checkbox("Parallel recording", &m_settings.parallel_recording);
+        ImGui::SliderInt("Recording threads", &m_settings.record_thread_count, 1, (int) m_recorder->max_chunks());
+        ImGui::Checkbox("Draw each object separately", &m_settings.draw_per_object);
+        ImGui::EndDisabled();
+
+        imgui_text("Recording time: {:.3f} ms for {} draw items", stats.record_time.count(), stats.draw_items);
+
+        // Mostly interesting with lots of objects drawn separately, e.g. with the spawn stress test running.
+        if (ImGui::Button("Run recording benchmark") && !stats.record_benchmark_running)
+            m_start_record_benchmark = true;
+
+        const auto& results = stats.record_benchmark_results;
+        for (const auto& [thread_count, time] : results)
+            imgui_text("{:>3} threads: {:.3f} ms ({:.2f}x)", thread_count, time, results.front().second / time);
+    }
+
+    if (ImGui::CollapsingHeader("Spawning")) {
+        ImGui::Checkbox("Spawn stress test", &m_spawn_stress);
+        ImGui::SliderFloat("Spawns per second", &m_spawn_rate, 0, 100'000, "%.0f", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderFloat("Lifetime (s)", &m_spawn_lifetime, 0.1f, 10);
+
+        imgui_text("Spawned objects alive: {}", m_spawned_objects.size());
+        imgui_text("Descriptor pools: {}", stats.descriptor_pools);
+    }
+
+    {
+        // Averaged separately for each setting every frame, even with the section collapsed, so toggling back and forth
+        // compares them.
+        auto& frame_time = m_mipmap_frame_time[m_settings.use_mipmaps];
+        const f64 delta_ms = io.DeltaTime * 1000.0;
+        frame_time = frame_time == 0 ? delta_ms : std::lerp(frame_time, delta_ms, 0.05);
+    }
+
+    if (ImGui::CollapsingHeader("Mipmaps")) {
+        ImGui::Checkbox("Use mipmaps", &m_settings.use_mipmaps);
+
+        // Only the sizes of the textures are known up front, the bandwidth saved shows up as frame time.
+        constexpr f64 KIB = 1024.0;
+        imgui_text("Texture memory: {:.1f} KiB with mips, {:.1f} KiB top level only",
+            (m_texture_size + 6 * mip_chain_size(m_cubemap_face_size, m_cubemap_face_size, m_cubemap_mip_levels)) / KIB,
+            (m_texture_top_level_size + 6 * mip_chain_size(m_cubemap_face_size, m_cubemap_face_size, 1)) / KIB
+        );
+
+        imgui_text("Average frame time: {:.3f} ms with mips, {:.3f} ms without", m_mipmap_frame_time[1], m_mipmap_frame_time[0]);
     }
 
     ImGui::End();
 
     ImGui::Render();
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), command_buffer);
 
-    vkCmdEndRendering(command_buffer);
+    // The next NewFrame() reuses ImGui's draw data while the render thread may still be drawing this frame's.
+    packet.imgui.capture(ImGui::GetDrawData());
 }
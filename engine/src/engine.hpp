@@ -1,26 +1,182 @@
 #pragma once
 
 #include "camera.hpp"
+#include "camera_path.hpp"
+#include "frame_stats.hpp"
+#include "job_system.hpp"
+#include "scene.hpp"
 
 #include "util/vulkan.hpp"
+#include "util/imgui.hpp"
 #include "util/sdl3.hpp"
+#include "util/spsc_ring.hpp"
+#include "util/stb.hpp"
 
+#include "graphics/culling.hpp"
+#include "graphics/ktx2.hpp"
+#include "graphics/vulkan/allocator.hpp"
+#include "graphics/vulkan/descriptor_allocator.hpp"
 #include "graphics/vulkan/device.hpp"
+#include "graphics/vulkan/frame_allocator.hpp"
+#include "graphics/vulkan/gpu_profiler.hpp"
+#include "graphics/vulkan/offscreen_target.hpp"
+#include "graphics/vulkan/parallel_recorder.hpp"
+#include "graphics/vulkan/pipeline_cache.hpp"
 #include "graphics/vulkan/swapchain.hpp"
+#include "graphics/vulkan/uploader.hpp"
+
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <thread>
 
 static constexpr auto ENGINE_VULKAN_API_VERSION = VK_API_VERSION_1_3;
 
+// Per-object data in the object storage buffer. Matches ObjectData in soggycube.slang and cull.slang.
+struct ObjectData {
+    glm::mat4x4 model;
+    // Object space bounding sphere (center, radius)
+    glm::vec4 bounds;
+};
+
+/// How the engine should run, usually from the command line.
+struct EngineConfig {
+    /// Render into offscreen images instead of a window. Needs no display server, and there's no UI or input.
+    bool headless = false;
+    /// Only consider CPU Vulkan implementations, like lavapipe.
+    bool software_device = false;
+    /// Size of the window, or of the offscreen images when headless.
+    u32 width = 960;
+    u32 height = 640;
+    /// Quit after this many frames and log how long they took. 0 runs until the window is closed.
+    /// When benchmarking, these are the measured frames, which come after the warm-up frames.
+    u32 frame_count = 0;
+
+    /// Seed for placing the scene's cubes. Unset picks a random one, except when benchmarking, which uses 0.
+    std::optional<u32> seed;
+    /// How many cubes the scene starts with. They're spread over more space the more there are, so the density stays the same.
+    u32 object_count = 60;
+
+    /// Benchmark mode: the camera flies a scripted path, the simulation advances exactly one tick per frame and vsync is
+    /// off, so every run renders the same frames. Frame time statistics are written to `benchmark_output` as JSON.
+    bool benchmark = false;
+    /// Frames rendered before measuring starts, so caches, allocators and clocks have settled.
+    u32 warmup_frames = 100;
+    std::filesystem::path benchmark_output = "benchmark.json";
+
+    /// Where Chrome traces of the CPU profiling scopes go, when F9 is pressed and on quitting. Profiling starts right
+    /// away if this is set, otherwise it's off until turned on from the UI or with F9, and traces go to trace.json.
+    std::filesystem::path trace_output;
+    /// How many of the last frames a trace covers.
+    u32 trace_frames = 120;
+};
+
 class Engine {
 public:
     /// Initialize SDL and Vulkan
-    void start();
+    void start(const EngineConfig& config = {});
 
-    /// Run the main event loop.
+    /// Run the main event loop. Rendering happens on a separate render thread, a frame behind the main thread.
     void run();
 
+    /// Adds a cube to the scene while running. Its transform goes out with the next frame's uploads.
+    ObjectHandle spawn_object(const glm::vec3& pos, const glm::quat& rot, ObjectMobility mobility);
+
+    /// Removes an object from the scene. Does nothing if it's already gone.
+    void despawn_object(ObjectHandle handle);
+
 private:
+    enum class CullMode : int {
+        None,
+        Cpu,
+        Gpu,
+    };
+
+    // Render settings from the UI. The main thread owns them and sends a copy along with every frame.
+    struct RenderSettings {
+        bool vsync = true;
+        // Whether the samplers use the mip chains.
+        bool use_mipmaps = true;
+        CullMode cull_mode = CullMode::Gpu;
+        CullBackend cull_backend = best_cull_backend();
+        // Records the main pass into secondary command buffers across threads.
+        bool parallel_recording = false;
+        int record_thread_count = 1;
+        // One draw per object instead of one instanced draw per chunk, to make recording expensive enough to measure.
+        bool draw_per_object = false;
+    };
+
+    // What the render thread reports back about a frame, for the UI.
+    struct RenderStats {
+        // Set by the render thread, cleared once the main thread has taken the frame's times.
+        bool rendered = false;
+        usize visible_objects = 0;
+        // How many transforms the frame copied.
+        usize transforms_written = 0;
+        usize draw_items = 0;
+        std::chrono::duration<f64, std::milli> cpu_cull_time{};
+        std::chrono::duration<f64, std::milli> record_time{};
+        // The render thread's time for the whole frame, including waiting for the GPU.
+        std::chrono::duration<f64, std::milli> render_time{};
+        std::chrono::duration<f64, std::milli> fence_wait_time{};
+        std::chrono::duration<f64, std::milli> acquire_time{};
+        std::chrono::duration<f64, std::milli> submit_time{};
+        std::chrono::duration<f64, std::milli> present_time{};
+        // The whole frame on the GPU, for the latest frame whose timestamps are in. 0 without timestamps.
+        std::chrono::duration<f64, std::milli> gpu_time{};
+        // Rolling averages of the GPU passes, a frame or two behind.
+        std::vector<VulkanGpuProfiler::ScopeTime> gpu_times;
+        std::vector<VulkanHeapStats> heaps;
+        usize frame_allocator_used = 0;
+        usize frame_allocator_capacity = 0;
+        usize descriptor_pools = 0;
+        bool record_benchmark_running = false;
+        std::vector<std::pair<u32, f64>> record_benchmark_results;
+    };
+
+    // Everything the render thread needs for a frame, filled in by the main thread.
+    // Packets are reused, so the vectors keep their memory from one frame to the next.
+    struct FramePacket {
+        // Tells the render thread to stop, nothing else in the packet is used.
+        bool quit = false;
+
+        u32 window_width = 0;
+        u32 window_height = 0;
+        bool window_resized = false;
+
+        Camera camera;
+        RenderSettings settings;
+        bool start_record_benchmark = false;
+
+        // Only what changed since the last packet: the scene's dirty objects and their new data.
+        usize object_count = 0;
+        std::vector<u32> dirty_objects;
+        std::vector<ObjectData> dirty_object_data;
+
+        ImGuiDrawSnapshot imgui;
+
+        // Written by the render thread once it's done with the packet, read back when the main thread reuses it.
+        RenderStats stats;
+    };
+
     void quit();
 
+    /// Handles pending window events. Returns whether the user asked to quit.
+    bool poll_events();
+
+    /// Fills in the next frame packet from the scene, camera and UI, waiting for a free one if the render thread is behind.
+    void submit_frame_packet();
+    /// Builds the UI and captures its draw data into `packet`.
+    void build_imgui(FramePacket& packet);
+    /// Sends the render thread a quit packet and waits for it to finish.
+    void stop_render_thread();
+
+    /// The render thread: renders every packet it gets until it gets a quit packet.
+    void render_loop();
+    /// Takes the camera, settings and dirty objects from m_frame_packet. Render thread only.
+    void apply_frame_packet();
+
     void init_window();
 
     void init_graphics();
@@ -36,47 +192,118 @@ private:
     void create_descriptor_set_layouts();
     void create_graphics_pipeline();
     void create_cubemap_pipeline();
+    void create_cull_pipeline();
     void create_depth_image();
 
     void create_texture_image();
+    void upload_compressed_texture(const Ktx2Texture& texture);
     void create_texture_image_view();
     void create_texture_sampler();
 
     void create_cubemap_image();
+    void upload_cubemap_faces(u32 face_size, std::span<const u8> face_data);
+    void convert_cubemap_on_gpu(const stb::Image& equirect);
     void create_cubemap_image_view();
     void create_cubemap_sampler();
 
-    void create_camera_ubos();
-
-    void create_descriptor_pool();
+    void create_descriptor_allocator();
     void create_descriptor_sets();
 
     void create_vertex_buffer();
     void create_index_buffer();
     void create_cubemap_buffers();
     void create_scene_objects();
+    void create_object_buffers();
+    void create_cull_resources();
     void create_command_buffers();
     void create_sync_objects();
 
 
-    u32 choose_memory_type(u32 memory_type_bits, VkMemoryPropertyFlags mem_flags);
-    void create_buffer(usize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_flags, VkBuffer& buffer, VkDeviceMemory& mem);
-    void create_image_2d(u32 width, u32 height, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags mem_flags, VkImage& image, VkDeviceMemory& mem);
-    void create_image_cube(u32 size, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags mem_flags, VkImage& image, VkDeviceMemory& mem);
+    void create_buffer(usize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_flags, VkBuffer& buffer, VulkanAllocation& mem, VulkanAllocationStrategy strategy = VulkanAllocationStrategy::FreeList);
+    /// Creates a device local buffer and queues `data` to be uploaded to it with the next batch of uploads.
+    void create_device_local_buffer(const void* data, usize size, VkBufferUsageFlags usage, VkBuffer& buffer, VulkanAllocation& mem);
+    void create_image_2d(u32 width, u32 height, u32 mip_levels, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags mem_flags, VkImage& image, VulkanAllocation& mem);
+    /// `view_formats` lists the formats views of the image can have, if they differ from `format`.
+    void create_image_cube(u32 size, u32 mip_levels, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags mem_flags, VkImage& image, VulkanAllocation& mem, std::span<const VkFormat> view_formats = {});
+
+    /// Makes sure the object buffer can hold `object_count` objects. When it has to be replaced, the old one is
+    /// destroyed once the frames using it are done and every object is uploaded again to fill the new one.
+    void reserve_object_buffer(usize object_count);
+
+    /// How many transforms upload_dirty_objects() copies this frame.
+    [[nodiscard]] usize pending_upload_count() const;
+
+    /// Starts the frame allocator on `frame` with room for its camera constants, instance indices and dirty transforms,
+    /// and rewrites the descriptors pointing at it if it had to grow or the object buffer was replaced. The frame must not
+    /// be in flight.
+    void begin_transient_frame(usize frame);
 
-    VkCommandBuffer begin_single_time_commands();
-    void end_single_time_commands(VkCommandBuffer command_buffer);
+    /// Points the object and cull descriptor sets for `frame` at the object buffer, and at the frame allocator for instances.
+    void update_object_descriptor_sets(usize frame);
 
-    void transition_image_layout(VkCommandBuffer command_buffer, VkImage image, VkAccessFlags src_access_mask, VkAccessFlags dst_access_mask, VkImageLayout src_layout, VkImageLayout dst_layout, VkPipelineStageFlags src_stage_mask, VkPipelineStageFlags dst_stage_mask, VkImageAspectFlags aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT, u32 layer_count = 1);
+    /// Records copies of the frame packet's dirty objects into the object buffer, staged through the frame allocator.
+    void upload_dirty_objects(VkCommandBuffer command_buffer);
+
+    /// Points the camera binding of `frame`'s descriptor set at the frame allocator.
+    void update_camera_descriptor(usize frame);
+
+    /// Points the texture bindings of `frame`'s descriptor set at the samplers picked by the use_mipmaps setting. The frame must not be in flight.
+    void update_texture_descriptors(usize frame);
+
+    /// Updates the bounding spheres used for CPU culling for the frame packet's dirty objects.
+    void update_cull_bounds();
+
+    /// Records the GPU culling dispatch, which fills in the frame's instance buffer and indirect draw commands.
+    void record_gpu_culling(VkCommandBuffer command_buffer);
+    /// Records the skybox if asked to, then the draws for items [first, first + count) of the main pass.
+    /// Binds everything it needs, so it works the same in a secondary command buffer.
+    void record_scene_draws(VkCommandBuffer command_buffer, usize first, usize count, bool draw_skybox);
+    /// How many items the main pass is split into: visible objects, or the single indirect draw with GPU culling.
+    [[nodiscard]] usize scene_draw_items() const;
+    /// Moves the recording benchmark on to its next thread count once it has enough frames.
+    void update_record_benchmark();
+
+    void transition_image_layout(VkCommandBuffer command_buffer, VkImage image, VkAccessFlags src_access_mask, VkAccessFlags dst_access_mask, VkImageLayout src_layout, VkImageLayout dst_layout, VkPipelineStageFlags src_stage_mask, VkPipelineStageFlags dst_stage_mask, VkImageAspectFlags aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT, u32 layer_count = 1, u32 level_count = 1);
+
+    /// Returns whether optimally tiled images of `format` support all of `features`.
+    bool format_supported(VkFormat format, VkFormatFeatureFlags features);
+
+    /// Fills in every mip level of `image` from level 0 by blitting. All levels must be in TRANSFER_DST_OPTIMAL,
+    /// and they are left in SHADER_READ_ONLY_OPTIMAL.
+    void generate_mipmaps(VkCommandBuffer command_buffer, VkImage image, VkFormat format, u32 width, u32 height, u32 mip_levels, u32 layer_count = 1);
 
     void recreate_swapchain();   
 
+    /// The size, format and images of what's rendered into: the swapchain's, or the offscreen target's when headless.
+    [[nodiscard]] VkExtent2D target_extent() const;
+    [[nodiscard]] VkFormat target_format() const;
+    [[nodiscard]] VkImage target_image(u32 index) const;
+    [[nodiscard]] VkImageView target_image_view(u32 index) const;
+
+    /// Runs as many simulation ticks as the time since the last call makes up for, and sets how far into the next
+    /// one to interpolate.
     void update();
+    /// Advances the simulation by one fixed tick.
+    void tick(f32 time_delta);
+    /// Moves the camera `time_delta` seconds further along the benchmark's camera path, looking at the middle of the scene.
+    void follow_camera_path(f32 time_delta);
+    /// Spawns and despawns cubes for the spawn stress test.
+    void update_spawn_stress(f32 time_delta);
     void update_graphics();
 
     void render_frame();
     void render_imgui(VkCommandBuffer command_buffer);
 
+    /// Reads back the GPU times of the frame that last used the `frame` slot, and adds its total to the benchmark samples
+    /// if it was measured. The frame must not be in flight.
+    void read_gpu_times(usize frame);
+    /// Writes a trace of the last frames' CPU profiling scopes, or turns profiling on if it's off.
+    void write_trace();
+    /// Draws the frame time graph, histogram and statistics into the Debug window.
+    void build_frame_stats_ui();
+    /// Logs the benchmark's frame time statistics and writes them to the output file.
+    void write_benchmark_results();
+
 private:
     auto physical_device() const { return m_device->physical_device(); }
     auto device() const { return m_device->device(); }
@@ -86,74 +313,182 @@ private:
 private:
     static constexpr u32 MAX_FRAMES_IN_FLIGHT = 2;
 
-    struct CubeObject {
-        glm::vec3 m_pos;
-        glm::quat m_rot;
+    // Declared first so it outlives everything that schedules jobs on it.
+    JobSystem m_jobs;
 
-        std::array<VkBuffer, MAX_FRAMES_IN_FLIGHT> m_ubos;
-        std::array<VkDeviceMemory, MAX_FRAMES_IN_FLIGHT> m_ubo_memory;
-        std::array<void*, MAX_FRAMES_IN_FLIGHT> m_ubo_data;
-        std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> m_descriptor_sets;
-    };
+    EngineConfig m_config;
+
+    // The main thread fills in one packet while the render thread renders the other, so at most one frame is queued up.
+    SpscRing<FramePacket, 2> m_frame_packets;
+    std::jthread m_render_thread;
+    // The packet the render thread is working on.
+    FramePacket* m_frame_packet = nullptr;
+    // ImGui's textures are updated by both NewFrame()/Render() on the main thread and the backend on the render thread.
+    std::mutex m_imgui_mutex;
+    // Set by the render thread when a frame throws, the main thread rethrows it.
+    std::exception_ptr m_render_error;
+    std::atomic<bool> m_render_failed = false;
 
     SDL_Window* m_window{};
     u32 m_window_width;
     u32 m_window_height;
 
     VkInstance m_instance;
-    VkSurfaceKHR m_window_surface;
+    VkSurfaceKHR m_window_surface = VK_NULL_HANDLE;
     
     std::unique_ptr<VulkanDevice> m_device;
+    std::unique_ptr<VulkanAllocator> m_allocator;
+    std::unique_ptr<VulkanPipelineCache> m_pipeline_cache;
+    std::unique_ptr<VulkanUploader> m_uploader;
+    std::unique_ptr<VulkanFrameAllocator> m_frame_allocator;
+    // Exactly one of these exists, depending on whether we're headless.
     std::unique_ptr<VulkanSwapchain> m_swapchain;
+    std::unique_ptr<VulkanOffscreenTarget> m_offscreen_target;
 
     VkDescriptorSetLayout m_descriptor_set_layout;
     VkDescriptorSetLayout m_scene_object_descriptor_set_layout;
 
     VkPipelineLayout m_pipeline_layout;
     VkPipeline m_pipeline;
+    // m_pipeline with instance indices turned off, for when nothing is culled.
+    VkPipeline m_unculled_pipeline;
 
     VkPipelineLayout m_cubemap_pipeline_layout;
     VkPipeline m_cubemap_pipeline;
 
+    VkDescriptorSetLayout m_cull_descriptor_set_layout;
+    VkPipelineLayout m_cull_pipeline_layout;
+    VkPipeline m_cull_pipeline;
+
     VkBuffer m_vertex_buffer;
-    VkDeviceMemory m_vertex_buffer_memory;
+    VulkanAllocation m_vertex_buffer_memory;
 
     VkBuffer m_index_buffer;
-    VkDeviceMemory m_index_buffer_memory;
+    VulkanAllocation m_index_buffer_memory;
 
     VkImage m_depth_image;
-    VkDeviceMemory m_depth_image_memory;
+    VulkanAllocation m_depth_image_memory;
     VkImageView m_depth_image_view;
 
     // Soggy cat texture
     VkImage m_texture_image;
-    VkDeviceMemory m_texture_image_memory;
+    VulkanAllocation m_texture_image_memory;
+    VkFormat m_texture_format = VK_FORMAT_R8G8B8A8_SRGB;
+    u32 m_texture_mip_levels = 1;
+    // Bytes used by the whole mip chain and by the top level alone.
+    u64 m_texture_size = 0;
+    u64 m_texture_top_level_size = 0;
     VkImageView m_texture_image_view;
     VkSampler m_texture_sampler;
+    VkSampler m_texture_sampler_no_mips;
 
     // Cubemap image
     VkImage m_cubemap_image;
-    VkDeviceMemory m_cubemap_memory;
+    u32 m_cubemap_face_size = 0;
+    u32 m_cubemap_mip_levels = 1;
+    VulkanAllocation m_cubemap_memory;
     VkImageView m_cubemap_image_view;
     VkSampler m_cubemap_sampler;
+    VkSampler m_cubemap_sampler_no_mips;
 
     VkBuffer m_cubemap_vertex_buffer;
-    VkDeviceMemory m_cubemap_vertex_buffer_memory;
+    VulkanAllocation m_cubemap_vertex_buffer_memory;
     VkBuffer m_cubemap_index_buffer;
-    VkDeviceMemory m_cubemap_index_buffer_memory;
+    VulkanAllocation m_cubemap_index_buffer_memory;
     
-    std::array<VkBuffer, MAX_FRAMES_IN_FLIGHT> m_camera_ubos;
-    std::array<VkDeviceMemory, MAX_FRAMES_IN_FLIGHT> m_camera_ubo_memory;
-    std::array<void*, MAX_FRAMES_IN_FLIGHT> m_camera_ubo_data;
-
-    VkDescriptorPool m_descriptor_pool;
+    std::unique_ptr<VulkanDescriptorAllocator> m_descriptor_allocator;
     std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> m_descriptor_sets;
 
-    std::vector<CubeObject> m_scene_objects;
+    Scene m_scene;
+
+    // Every object's model matrix lives in a single device local storage buffer, shared by all frames.
+    // Transforms are only copied into it when an object is created or moved, see Scene::dirty_objects().
+    // The vertex shader looks up objects through the instance indices, which are written by culling.
+    VkBuffer m_object_buffer = VK_NULL_HANDLE;
+    VulkanAllocation m_object_buffer_memory;
+    usize m_object_buffer_capacity = 0;
+    std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> m_object_descriptor_sets{};
+    // The object buffer each frame's descriptor sets point at, they are updated when the frame comes around again.
+    std::array<VkBuffer, MAX_FRAMES_IN_FLIGHT> m_object_descriptor_buffers{};
+    // Object buffers that were replaced while frames could still be using them, destroyed when the frame slot is reused.
+    std::array<std::vector<std::pair<VkBuffer, VulkanAllocation>>, MAX_FRAMES_IN_FLIGHT> m_retired_object_buffers;
+
+    // The render thread's copy of every object's data, kept up to date from the frame packets.
+    // Needed to fill a new object buffer, the scene itself is only touched by the main thread.
+    std::vector<ObjectData> m_render_objects;
+    // Set when the object buffer was replaced, so everything goes out with the next upload instead of the dirty objects.
+    bool m_upload_all_objects = false;
+
+    // What the scene's cubes were placed with, and how far from the middle they go.
+    u32 m_scene_seed = 0;
+    f32 m_scene_extent = 5;
+
+    // How many transforms the last frame copied.
+    usize m_transforms_written = 0;
+    bool m_animate_dynamic_objects = true;
+
+    // Spawn stress test: spawns m_spawn_rate cubes per second and despawns each of them m_spawn_lifetime seconds later.
+    struct SpawnedObject {
+        ObjectHandle handle;
+        f64 despawn_time;
+    };
+
+    bool m_spawn_stress = false;
+    f32 m_spawn_rate = 2000;
+    f32 m_spawn_lifetime = 2;
+    f64 m_spawn_clock = 0;
+    f64 m_spawn_debt = 0;
+    std::deque<SpawnedObject> m_spawned_objects;
+    std::mt19937 m_spawn_rng{ 1234 };
+
+    // Where the current frame's camera constants and instance indices are in the frame allocator.
+    // The descriptors cover a fixed range, these are passed as their dynamic offsets.
+    u32 m_camera_offset = 0;
+    u32 m_instance_offset = 0;
+
+    // GPU culling resources for a frame in flight.
+    struct CullFrame {
+        VkBuffer m_draw_commands;
+        VulkanAllocation m_draw_commands_memory;
+        VkBuffer m_draw_count;
+        VulkanAllocation m_draw_count_memory;
+        // Copy of the draw commands so we can show the visible object count once the frame is done.
+        VkBuffer m_readback;
+        VulkanAllocation m_readback_memory;
+
+        VkDescriptorSet m_descriptor_set;
+    };
+
+    std::array<CullFrame, MAX_FRAMES_IN_FLIGHT> m_cull_frames{};
 
     VkCommandPool m_command_pool;
-    VkCommandPool m_transient_command_pool;
     std::array<VkCommandBuffer, MAX_FRAMES_IN_FLIGHT> m_command_buffers;
+
+    // Records the main pass into secondary command buffers across threads when parallel recording is on.
+    std::unique_ptr<VulkanParallelRecorder> m_recorder;
+    std::chrono::duration<f64, std::milli> m_record_time{};
+
+    // Times the whole frame and its passes on the GPU.
+    std::unique_ptr<VulkanGpuProfiler> m_gpu_profiler;
+    // The current frame's skybox and cube pass scopes. Both start wherever the skybox is recorded, which can be in a
+    // secondary command buffer.
+    u32 m_skybox_gpu_scope = UINT32_MAX;
+    u32 m_cubes_gpu_scope = UINT32_MAX;
+
+    // Records the same frames with 1, 2, 4... threads and reports the recording time of each.
+    struct RecordBenchmark {
+        bool running = false;
+        std::vector<u32> thread_counts;
+        usize step = 0;
+        u32 frames = 0;
+        std::chrono::duration<f64, std::milli> total{};
+        // Average recording time for each thread count that has been measured.
+        std::vector<std::pair<u32, f64>> results;
+    };
+
+    RecordBenchmark m_record_benchmark;
+    // Set by the UI, the render thread starts the benchmark when it gets the packet.
+    bool m_start_record_benchmark = false;
     
     std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT> m_image_available_semaphores;
     std::array<VkFence, MAX_FRAMES_IN_FLIGHT> m_in_flight_fences;
@@ -164,9 +499,76 @@ private:
     bool m_need_swapchain_recreate = false;
     bool m_grab_mouse = true;
 
+    // The main thread's camera and settings, and the render thread's copies of them from the current frame packet.
     Camera m_camera;
+    RenderSettings m_settings;
+    Camera m_render_camera;
+    RenderSettings m_render_settings;
 
-    bool m_vsync = true;
+    // The stats of the last frame the render thread finished, as of the last packet.
+    RenderStats m_render_stats;
+    std::chrono::duration<f64, std::milli> m_update_time{};
+
+    // What each frame's descriptor set was last written with.
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> m_descriptor_set_mipmaps{};
+    // Average frame time in ms without and with mipmaps, indexed by the use_mipmaps setting.
+    std::array<f64, 2> m_mipmap_frame_time{};
+
+    std::chrono::duration<f64, std::milli> m_cpu_cull_time{};
+
+    // World space bounding spheres of the scene objects, for CPU culling.
+    std::vector<f32> m_cull_bounds_x;
+    std::vector<f32> m_cull_bounds_y;
+    std::vector<f32> m_cull_bounds_z;
+    std::vector<f32> m_cull_bounds_radius;
+
+    usize m_visible_objects = 0;
 
     std::chrono::steady_clock::time_point m_last_update;
+    // Frame packets handed to the render thread so far.
+    u64 m_frames_submitted = 0;
+
+    // The simulation runs in fixed ticks of 1 / m_tick_rate seconds. Time left over from a frame carries over to the
+    // next, and what's drawn is that fraction of the way from the previous tick's state to the current one.
+    static constexpr auto TICK_RATES = std::to_array<u32>({ 60, 120, 240 });
+    // Past this many ticks in a frame the simulation falls behind instead of taking even longer to catch up.
+    static constexpr u32 MAX_TICKS_PER_FRAME = 8;
+
+    u32 m_tick_rate = 60;
+    f64 m_tick_accumulator = 0;
+    f32 m_tick_alpha = 0;
+    u32 m_frame_ticks = 0;
+    // The camera position before the last tick, it moves in ticks like the objects do.
+    glm::vec3 m_previous_camera_pos{};
+
+    // Benchmark mode: the camera's scripted route and how far along it the simulation is.
+    CameraPath m_camera_path;
+    f64 m_camera_path_time = 0;
+
+    // Times in ms of every frame past the warm-up. Update times come from the main thread, the rest from the render thread,
+    // which is joined before they're read.
+    struct BenchmarkSamples {
+        // From the end of one frame on the render thread to the end of the next.
+        std::vector<f64> frame;
+        std::vector<f64> update;
+        // The render thread's time for the frame, minus waiting for the GPU.
+        std::vector<f64> render;
+        std::vector<f64> gpu;
+    };
+
+    BenchmarkSamples m_benchmark_samples;
+    // Frames the render thread has been through, and when it finished the last one.
+    u64 m_frames_rendered = 0;
+    std::chrono::steady_clock::time_point m_last_frame_end;
+
+    // How long the render thread's current frame spent in each of these calls.
+    std::chrono::duration<f64, std::milli> m_fence_wait_time{};
+    std::chrono::duration<f64, std::milli> m_acquire_time{};
+    std::chrono::duration<f64, std::milli> m_submit_time{};
+    std::chrono::duration<f64, std::milli> m_present_time{};
+
+    // Every frame's times, for the frame time graph, histogram and CSV export. Main thread only.
+    FrameStats m_frame_stats;
+    std::chrono::steady_clock::time_point m_last_frame_start;
+    std::chrono::duration<f64, std::milli> m_frame_time{};
 };
@@ -0,0 +1,68 @@
+#include "frame_stats.hpp"
+
+#include "util/paths.hpp"
+
+void FrameStats::push(const FrameSample& sample) {
+    m_samples[m_pushed % CAPACITY] = sample;
+    m_pushed++;
+}
+
+void FrameStats::clear() {
+    m_pushed = 0;
+}
+
+SampleSummary FrameStats::summarize(f32 FrameSample::* field) const {
+    return ::summarize(values(field));
+}
+
+usize FrameStats::stutter_count() const {
+    auto frames = values(&FrameSample::frame);
+    if (frames.empty())
+        return 0;
+
+    std::ranges::sort(frames);
+    const f64 threshold = percentile(frames, 50) * STUTTER_FACTOR;
+
+    return (usize) std::ranges::distance(std::ranges::upper_bound(frames, threshold), frames.end());
+}
+
+void FrameStats::histogram(f32 max_ms, std::span<f32> buckets) const {
+    std::ranges::fill(buckets, 0.f);
+    if (buckets.empty() || max_ms <= 0)
+        return;
+
+    const f32 bucket_ms = max_ms / buckets.size();
+    for (usize i = 0; i < size(); i++) {
+        const auto bucket = (usize) (sample(i).frame / bucket_ms);
+        buckets[std::min(bucket, buckets.size() - 1)]++;
+    }
+}
+
+bool FrameStats::write_csv(const std::filesystem::path& path) const {
+    auto out = fmt::memory_buffer();
+
+    fmt::format_to(std::back_inserter(out), "frame_index");
+    for (const auto& field : FRAME_SAMPLE_FIELDS)
+        fmt::format_to(std::back_inserter(out), ",{}_ms", field.name);
+    fmt::format_to(std::back_inserter(out), "\n");
+
+    // Frame indices count from the last clear(), so exports taken a while apart line up.
+    const u64 first_index = m_pushed - size();
+    for (usize i = 0; i < size(); i++) {
+        const auto& s = sample(i);
+
+        fmt::format_to(std::back_inserter(out), "{}", first_index + i);
+        for (const auto& field : FRAME_SAMPLE_FIELDS)
+            fmt::format_to(std::back_inserter(out), ",{:.4f}", s.*field.member);
+        fmt::format_to(std::back_inserter(out), "\n");
+    }
+
+    return write_file_atomic(path, std::span(reinterpret_cast<const u8*>(out.data()), out.size()));
+}
+
+std::vector<f64> FrameStats::values(f32 FrameSample::* field) const {
+    std::vector<f64> result(size());
+    for (usize i = 0; i < size(); i++)
+        result[i] = sample(i).*field;
+    return result;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "util/stats.hpp"
+
+#include <array>
+#include <filesystem>
+#include <span>
+
+/// Where one frame's time went, in ms. The main thread times come from the frame itself, the render thread and GPU times
+/// from the latest frame the render thread had finished by then.
+struct FrameSample {
+    /// From the start of the previous frame on the main thread to the start of this one.
+    f32 frame = 0;
+    f32 update = 0;
+    f32 record = 0;
+    f32 fence_wait = 0;
+    f32 acquire = 0;
+    f32 submit = 0;
+    f32 present = 0;
+    f32 gpu = 0;
+};
+
+struct FrameSampleField {
+    const char* name;
+    f32 FrameSample::* member;
+};
+
+/// Every field of FrameSample, in order, for tables and CSV columns.
+constexpr auto FRAME_SAMPLE_FIELDS = std::to_array<FrameSampleField>({
+    { "frame", &FrameSample::frame },
+    { "update", &FrameSample::update },
+    { "record", &FrameSample::record },
+    { "fence_wait", &FrameSample::fence_wait },
+    { "acquire", &FrameSample::acquire },
+    { "submit", &FrameSample::submit },
+    { "present", &FrameSample::present },
+    { "gpu", &FrameSample::gpu },
+});
+
+/// The last CAPACITY frames' samples, in a ring. Averages hide the odd long frame, this keeps every one of them so
+/// percentiles, stutters and the shape of the distribution can be looked at.
+class FrameStats {
+public:
+    static constexpr usize CAPACITY = 1024;
+
+    /// A frame counts as a stutter when it takes this many times as long as the median frame.
+    static constexpr f64 STUTTER_FACTOR = 2;
+
+    FrameStats() : m_samples(CAPACITY) {}
+
+    void push(const FrameSample& sample);
+    void clear();
+
+    /// Summary of one field over the samples kept.
+    [[nodiscard]] SampleSummary summarize(f32 FrameSample::* field) const;
+
+    /// Frames whose time took more than STUTTER_FACTOR times the median.
+    [[nodiscard]] usize stutter_count() const;
+
+    /// Counts how many frame times fall into each of `buckets.size()` equal buckets from 0 to `max_ms`.
+    /// Longer frames go into the last bucket.
+    void histogram(f32 max_ms, std::span<f32> buckets) const;
+
+    /// Writes the samples kept to `path` as CSV, oldest first. Returns whether it worked.
+    bool write_csv(const std::filesystem::path& path) const;
+
+public:     // Getters
+    [[nodiscard]] usize size() const { return (usize) std::min<u64>(m_pushed, CAPACITY); }
+    [[nodiscard]] bool empty() const { return m_pushed == 0; }
+    /// Samples pushed since the last clear(), including the ones that no longer fit.
+    [[nodiscard]] u64 pushed() const { return m_pushed; }
+
+    /// The `i`th oldest sample kept.
+    [[nodiscard]] const FrameSample& sample(usize i) const { return m_samples[(oldest() + i) % CAPACITY]; }
+
+    /// The ring in storage order, starting at `oldest()`. For plotting without copying.
+    [[nodiscard]] std::span<const FrameSample> ring() const { return std::span(m_samples).first(size()); }
+    [[nodiscard]] usize oldest() const { return m_pushed < CAPACITY ? 0 : (usize) (m_pushed % CAPACITY); }
+
+private:
+    [[nodiscard]] std::vector<f64> values(f32 FrameSample::* field) const;
+
+private:
+    std::vector<FrameSample> m_samples;
+    u64 m_pushed = 0;
+};
@@ -0,0 +1,234 @@
+#include "cubemap.hpp"
+
+#include "../job_system.hpp"
+
+std::optional<BakedCubemap> BakedCubemap::from_bytes(std::span<const u8> bytes) {
+    BakedCubemapHeader header;
+    if (bytes.size() < sizeof(header))
+        return std::nullopt;
+
+    memcpy(&header, bytes.data(), sizeof(header));
+
+    if (header.magic != BakedCubemapHeader::MAGIC || header.version != BakedCubemapHeader::VERSION)
+        return std::nullopt;
+
+    if (header.format != BakedCubemapHeader::RGBA8_SRGB)
+        return std::nullopt;
+
+    const usize data_size = (usize) header.face_size * header.face_size * 4 * 6;
+    if (header.face_size == 0 || bytes.size() - sizeof(header) != data_size)
+        return std::nullopt;
+
+    return BakedCubemap{
+        .face_size = header.face_size,
+        .format = header.format,
+        .data = bytes.subspan(sizeof(header))
+    };
+}
+
+CubemapFaces equirect_to_cubemap_reference(const u8* pixels, u32 width, u32 height) {
+    CubemapFaces faces;
+    faces.face_size = height;
+    faces.data.resize(faces.face_bytes() * 6);
+
+    const u32 face_size = faces.face_size;
+
+    auto get_direction = [](u8 face, f32 u, f32 v) -> glm::vec3 {
+        switch (face) {
+        case 0: return { 1, -v, -u };
+        case 1: return { -1, -v, u };
+        case 2: return { u, 1, v };
+        case 3: return { u, -1, -v };
+        case 4: return { u, -v, 1 };
+        case 5: return { -u, -v, -1 };
+        default: 
+            return {};
+        }
+    };
+
+    auto get_pixel = [&](u32 x, u32 y) -> glm::vec4 {
+        const u8* pixel = pixels + (y * width + x) * 4;
+        return glm::vec4(pixel[0], pixel[1], pixel[2], pixel[3]);
+    };
+
+    for (u8 face = 0; face < 6; face++) {
+        u8* data = faces.data.data() + faces.face_bytes() * face;
+
+        for (u32 y = 0; y < face_size; y++) {
+            for (u32 x = 0; x < face_size; x++) {
+                f32 face_u = 2 * ((f32) x / face_size) - 1;
+                f32 face_v = 2 * ((f32) y / face_size) - 1;
+
+                auto dir = glm::normalize(get_direction(face, face_u, face_v));
+
+                f32 theta = std::acos(dir.y);
+                f32 phi = std::atan2(dir.z, dir.x);
+
+                f32 u = phi / (2 * std::numbers::pi_v<f32>);
+                f32 v = theta / std::numbers::pi_v<f32>;
+
+                // phi ranges from [-pi, pi] so correct it after dividing.
+                if (u < 0)
+                    u += 1;
+
+                u = std::clamp(u * (f32) width, 0.f, (f32) width - 1);
+                v = std::clamp(v * (f32) height, 0.f, (f32) height - 1);
+
+                // Bilinear interpolation...
+                u32 u1 = std::floor(u);
+                u32 v1 = std::floor(v);
+                u32 u2 = std::min(u1 + 1, width - 1);
+                u32 v2 = std::min(v1 + 1, height - 1);
+
+                f32 s = u - u1;
+                f32 t = v - v1;
+
+                glm::vec4 tl = get_pixel(u1, v1);
+                glm::vec4 tr = get_pixel(u2, v1);
+                glm::vec4 bl = get_pixel(u1, v2);
+                glm::vec4 br = get_pixel(u2, v2);
+
+                glm::vec4 color = glm::mix(glm::mix(tl, tr, s), glm::mix(bl, br, s), t);
+
+                // Write pixel value.
+                u8* dst = data + (y * face_size + x) * 4;
+                dst[0] = color[0];
+                dst[1] = color[1];
+                dst[2] = color[2];
+                dst[3] = color[3];
+            }
+        }
+    }
+
+    return faces;
+}
+
+namespace {
+
+// Rows are converted this many texels at a time. The loops over a batch have a fixed trip count and no branches,
+// so the compiler turns them into SIMD for whatever instruction set we're building for.
+constexpr u32 BATCH = 8;
+
+// atan2 with a max error around 1e-5 radians, which is well under a texel even for an 8K skybox.
+// Written with selects instead of branches so it vectorizes.
+inline f32 fast_atan2(f32 y, f32 x) {
+    constexpr f32 PI = std::numbers::pi_v<f32>;
+
+    f32 abs_x = std::abs(x);
+    f32 abs_y = std::abs(y);
+    f32 max = std::max(abs_x, abs_y);
+    f32 min = std::min(abs_x, abs_y);
+    f32 a = min / std::max(max, 1e-30f);
+    f32 s = a * a;
+
+    // Minimax polynomial for atan on [0, 1] (Abramowitz & Stegun 4.4.49).
+    f32 r = a * (0.9998660f + s * (-0.3302995f + s * (0.1801410f + s * (-0.0851330f + s * 0.0208351f))));
+
+    r = abs_y > abs_x ? PI / 2 - r : r;
+    r = x < 0 ? PI - r : r;
+    return y < 0 ? -r : r;
+}
+
+// Texel coordinates are fixed point with this many bits of subtexel precision.
+constexpr u32 SUBTEXEL_BITS = 16;
+constexpr u32 SUBTEXEL_ONE = 1 << SUBTEXEL_BITS;
+
+// Bilinear filter of four RGBA8 texels with fixed point weights. Only the final value is truncated,
+// like the float conversion does.
+inline u32 filter_texels(u32 tl, u32 tr, u32 bl, u32 br, u64 s, u64 t) {
+    u32 result = 0;
+    for (u32 shift = 0; shift < 32; shift += 8) {
+        u64 top = ((tl >> shift) & 0xFF) * (SUBTEXEL_ONE - s) + ((tr >> shift) & 0xFF) * s;
+        u64 bottom = ((bl >> shift) & 0xFF) * (SUBTEXEL_ONE - s) + ((br >> shift) & 0xFF) * s;
+        result |= (u32) ((top * (SUBTEXEL_ONE - t) + bottom * t) >> (2 * SUBTEXEL_BITS)) << shift;
+    }
+    return result;
+}
+
+void convert_row(const u32* pixels, u32 width, u32 height, u32 face, u32 y, u32 face_size, u32* dst) {
+    const f32 inv_face_size = 1.f / face_size;
+    const f32 face_v = 2 * (y * inv_face_size) - 1;
+
+    // Scale from angles to fixed point texel coordinates.
+    const f32 u_scale = width / (2 * std::numbers::pi_v<f32>) * SUBTEXEL_ONE;
+    const f32 v_scale = height / std::numbers::pi_v<f32> * SUBTEXEL_ONE;
+    const i32 u_max = (i32) ((width - 1) * SUBTEXEL_ONE);
+    const i32 v_max = (i32) ((height - 1) * SUBTEXEL_ONE);
+
+    // The same face directions as the reference, written as a linear function of the face coordinates
+    // so there's no per texel switch. They don't need to be normalized for atan2.
+    static constexpr glm::vec3 FACE_CENTERS[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    static constexpr glm::vec3 FACE_U_AXES[6] = { { 0, 0, -1 }, { 0, 0, 1 }, { 1, 0, 0 }, { 1, 0, 0 }, { 1, 0, 0 }, { -1, 0, 0 } };
+    static constexpr glm::vec3 FACE_V_AXES[6] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+
+    const glm::vec3 row_dir = FACE_CENTERS[face] + face_v * FACE_V_AXES[face];
+    const glm::vec3 u_axis = FACE_U_AXES[face];
+
+    for (u32 x0 = 0; x0 < face_size; x0 += BATCH) {
+        std::array<i32, BATCH> fixed_u, fixed_v;
+
+        for (u32 i = 0; i < BATCH; i++) {
+            f32 face_u = 2 * ((x0 + i) * inv_face_size) - 1;
+
+            f32 dx = row_dir.x + face_u * u_axis.x;
+            f32 dy = row_dir.y + face_u * u_axis.y;
+            f32 dz = row_dir.z + face_u * u_axis.z;
+
+            // acos(dy / |d|) is the same as atan2(|d.xz|, dy).
+            f32 theta = fast_atan2(std::sqrt(dx * dx + dz * dz), dy);
+            f32 phi = fast_atan2(dz, dx);
+            phi = phi < 0 ? phi + 2 * std::numbers::pi_v<f32> : phi;
+
+            fixed_u[i] = std::clamp((i32) (phi * u_scale), 0, u_max);
+            fixed_v[i] = std::clamp((i32) (theta * v_scale), 0, v_max);
+        }
+
+        // Bilinear filtering in fixed point. The gathers stay scalar, there's nothing to vectorize about them.
+        const u32 count = std::min(BATCH, face_size - x0);
+        for (u32 i = 0; i < count; i++) {
+            u32 u1 = fixed_u[i] >> SUBTEXEL_BITS;
+            u32 v1 = fixed_v[i] >> SUBTEXEL_BITS;
+            u32 u2 = std::min(u1 + 1, width - 1);
+            u32 v2 = std::min(v1 + 1, height - 1);
+            u32 s = fixed_u[i] & (SUBTEXEL_ONE - 1);
+            u32 t = fixed_v[i] & (SUBTEXEL_ONE - 1);
+
+            const u32* row1 = pixels + (usize) v1 * width;
+            const u32* row2 = pixels + (usize) v2 * width;
+
+            dst[x0 + i] = filter_texels(row1[u1], row1[u2], row2[u1], row2[u2], s, t);
+        }
+    }
+}
+
+}
+
+CubemapFaces equirect_to_cubemap(const u8* pixels, u32 width, u32 height, JobSystem* jobs) {
+    CubemapFaces faces;
+    faces.face_size = height;
+    faces.data.resize(faces.face_bytes() * 6);
+
+    const u32 face_size = faces.face_size;
+    const u32 total_rows = face_size * 6;
+
+    // Texels are handled as whole u32s. stb_image's allocations are aligned well enough for that.
+    const auto* src = reinterpret_cast<const u32*>(pixels);
+    auto* dst = reinterpret_cast<u32*>(faces.data.data());
+
+    auto convert_rows = [&](usize first_row, usize last_row) {
+        for (usize row = first_row; row < last_row; row++) {
+            u32 face = (u32) row / face_size;
+            u32 y = (u32) row % face_size;
+            convert_row(src, width, height, face, y, face_size, dst + row * face_size);
+        }
+    };
+
+    // Chunks of rows are small enough that the threads finish at about the same time.
+    constexpr u32 ROWS_PER_CHUNK = 16;
+    if (jobs)
+        jobs->parallel_for(total_rows, ROWS_PER_CHUNK, convert_rows);
+    else
+        convert_rows(0, total_rows);
+
+    return faces;
+}
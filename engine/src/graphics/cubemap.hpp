@@ -0,0 +1,48 @@
+#pragma once
+
+#include <optional>
+#include <span>
+
+class JobSystem;
+
+/// Six RGBA8 cubemap faces stored back to back in Vulkan layer order (+X, -X, +Y, -Y, +Z, -Z).
+struct CubemapFaces {
+    u32 face_size = 0;
+    std::vector<u8> data;
+
+    [[nodiscard]] usize face_bytes() const { return (usize) face_size * face_size * 4; }
+};
+
+/// Header of a cubemap baked at build time by assets/cubemap_bake.py. The six faces follow it, laid out like CubemapFaces.
+struct BakedCubemapHeader {
+    static constexpr std::array<char, 4> MAGIC = { 'C', 'U', 'B', 'E' };
+    static constexpr u32 VERSION = 1;
+
+    enum Format : u32 {
+        RGBA8_SRGB = 0,
+    };
+
+    std::array<char, 4> magic;
+    u32 version;
+    u32 face_size;
+    Format format;
+};
+
+/// A baked cubemap pointing into the asset it was parsed from.
+struct BakedCubemap {
+    u32 face_size;
+    BakedCubemapHeader::Format format;
+    /// All six faces, back to back.
+    std::span<const u8> data;
+
+    /// Validates and parses a baked cubemap blob. Returns std::nullopt if it is malformed or from a different version.
+    static std::optional<BakedCubemap> from_bytes(std::span<const u8> bytes);
+};
+
+/// Converts an equirectangular RGBA8 image to six cubemap faces with bilinear filtering.
+/// Faces are as large as the image is tall. Rows are converted in parallel on `jobs`, or all on this thread if it's null.
+/// Uses approximate trig and fixed point filtering, so texels can be off by one from equirect_to_cubemap_reference.
+CubemapFaces equirect_to_cubemap(const u8* pixels, u32 width, u32 height, JobSystem* jobs = nullptr);
+
+/// The straightforward single threaded conversion. This is the same conversion cubemap_bake.py does at build time.
+CubemapFaces equirect_to_cubemap_reference(const u8* pixels, u32 width, u32 height);
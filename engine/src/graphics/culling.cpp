@@ -0,0 +1,299 @@
+#include "culling.hpp"
+
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CULLING_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC lets us use any intrinsic without enabling it for the whole translation unit.
+#define CULLING_TARGET_AVX2
+#else
+#define CULLING_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+Frustum Frustum::from_matrix(const glm::mat4x4& m) {
+    // glm matrices are column major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+    auto row = [&](int i) { return glm::vec4{ m[0][i], m[1][i], m[2][i], m[3][i] }; };
+
+    Frustum frustum;
+    frustum.planes[Left] = row(3) + row(0);
+    frustum.planes[Right] = row(3) - row(0);
+    frustum.planes[Bottom] = row(3) + row(1);
+    frustum.planes[Top] = row(3) - row(1);
+    // This is the near plane for a -1..1 depth range, for 0..1 it's slightly behind the real one, which is fine for culling.
+    frustum.planes[Near] = row(3) + row(2);
+    frustum.planes[Far] = row(3) - row(2);
+
+    // Normalize so plane distances are in world units and can be compared against sphere radii.
+    for (auto& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+
+    return frustum;
+}
+
+bool Frustum::sphere_visible(const glm::vec3& center, f32 radius) const {
+    for (const auto& plane : planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::aabb_visible(const glm::vec3& min, const glm::vec3& max) const {
+    for (const auto& plane : planes) {
+        // Test the corner furthest along the plane normal, if that's outside the whole box is.
+        glm::vec3 p{
+            plane.x >= 0 ? max.x : min.x,
+            plane.y >= 0 ? max.y : min.y,
+            plane.z >= 0 ? max.z : min.z,
+        };
+        if (glm::dot(glm::vec3(plane), p) + plane.w < 0)
+            return false;
+    }
+    return true;
+}
+
+namespace {
+
+// For every plane, the box coordinates holding the corner furthest along its normal.
+struct AabbCorners {
+    std::array<const f32*, 3> axes[Frustum::PlaneCount];
+
+    AabbCorners(const Frustum& frustum, const CullAabbs& aabbs) {
+        for (usize i = 0; i < Frustum::PlaneCount; i++) {
+            const auto& plane = frustum.planes[i];
+            axes[i] = {
+                plane.x >= 0 ? aabbs.max_x.data() : aabbs.min_x.data(),
+                plane.y >= 0 ? aabbs.max_y.data() : aabbs.min_y.data(),
+                plane.z >= 0 ? aabbs.max_z.data() : aabbs.min_z.data(),
+            };
+        }
+    }
+};
+
+usize cull_spheres_scalar(const Frustum& frustum, const CullSpheres& spheres, u32* visible, usize begin) {
+    usize count = 0;
+    for (usize i = begin; i < spheres.size(); i++) {
+        glm::vec3 center{ spheres.x[i], spheres.y[i], spheres.z[i] };
+        visible[count] = (u32) i;
+        count += frustum.sphere_visible(center, spheres.radius[i]);
+    }
+    return count;
+}
+
+usize cull_aabbs_scalar(const Frustum& frustum, const AabbCorners& corners, usize size, u32* visible, usize begin) {
+    usize count = 0;
+    for (usize i = begin; i < size; i++) {
+        bool inside = true;
+        for (usize p = 0; p < Frustum::PlaneCount; p++) {
+            const auto& plane = frustum.planes[p];
+            const auto& axes = corners.axes[p];
+            inside &= plane.x * axes[0][i] + plane.y * axes[1][i] + plane.z * axes[2][i] + plane.w >= 0;
+        }
+        visible[count] = (u32) i;
+        count += inside;
+    }
+    return count;
+}
+
+// Appends the indices of the set bits in `mask`, offset by `base`.
+inline usize write_visible(u32 mask, u32 base, u32* visible) {
+    usize count = 0;
+    while (mask != 0) {
+        visible[count++] = base + std::countr_zero(mask);
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+#ifdef CULLING_X86
+
+usize cull_spheres_sse(const Frustum& frustum, const CullSpheres& spheres, u32* visible) {
+    const usize batches = spheres.size() / 4 * 4;
+    usize count = 0;
+
+    for (usize i = 0; i < batches; i += 4) {
+        __m128 x = _mm_loadu_ps(&spheres.x[i]);
+        __m128 y = _mm_loadu_ps(&spheres.y[i]);
+        __m128 z = _mm_loadu_ps(&spheres.z[i]);
+        __m128 neg_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const auto& plane : frustum.planes) {
+            __m128 d = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+                _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w))
+            );
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, neg_radius));
+        }
+
+        count += write_visible((u32) _mm_movemask_ps(inside), (u32) i, visible + count);
+    }
+
+    return count + cull_spheres_scalar(frustum, spheres, visible + count, batches);
+}
+
+usize cull_aabbs_sse(const Frustum& frustum, const AabbCorners& corners, usize size, u32* visible) {
+    const usize batches = size / 4 * 4;
+    usize count = 0;
+
+    for (usize i = 0; i < batches; i += 4) {
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (usize p = 0; p < Frustum::PlaneCount; p++) {
+            const auto& plane = frustum.planes[p];
+            const auto& axes = corners.axes[p];
+
+            __m128 d = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&axes[0][i]), _mm_set1_ps(plane.x)), _mm_mul_ps(_mm_loadu_ps(&axes[1][i]), _mm_set1_ps(plane.y))),
+                _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&axes[2][i]), _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w))
+            );
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+        }
+
+        count += write_visible((u32) _mm_movemask_ps(inside), (u32) i, visible + count);
+    }
+
+    return count + cull_aabbs_scalar(frustum, corners, size, visible + count, batches);
+}
+
+CULLING_TARGET_AVX2
+usize cull_spheres_avx2(const Frustum& frustum, const CullSpheres& spheres, u32* visible) {
+    const usize batches = spheres.size() / 8 * 8;
+    usize count = 0;
+
+    // Broadcast the planes once instead of for every batch.
+    __m256 px[Frustum::PlaneCount], py[Frustum::PlaneCount], pz[Frustum::PlaneCount], pw[Frustum::PlaneCount];
+    for (usize p = 0; p < Frustum::PlaneCount; p++) {
+        px[p] = _mm256_set1_ps(frustum.planes[p].x);
+        py[p] = _mm256_set1_ps(frustum.planes[p].y);
+        pz[p] = _mm256_set1_ps(frustum.planes[p].z);
+        pw[p] = _mm256_set1_ps(frustum.planes[p].w);
+    }
+
+    for (usize i = 0; i < batches; i += 8) {
+        __m256 x = _mm256_loadu_ps(&spheres.x[i]);
+        __m256 y = _mm256_loadu_ps(&spheres.y[i]);
+        __m256 z = _mm256_loadu_ps(&spheres.z[i]);
+        __m256 neg_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[i]));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (usize p = 0; p < Frustum::PlaneCount; p++) {
+            __m256 d = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(x, px[p]), _mm256_mul_ps(y, py[p])),
+                _mm256_add_ps(_mm256_mul_ps(z, pz[p]), pw[p])
+            );
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, neg_radius, _CMP_GE_OQ));
+        }
+
+        count += write_visible((u32) _mm256_movemask_ps(inside), (u32) i, visible + count);
+    }
+
+    return count + cull_spheres_scalar(frustum, spheres, visible + count, batches);
+}
+
+CULLING_TARGET_AVX2
+usize cull_aabbs_avx2(const Frustum& frustum, const AabbCorners& corners, usize size, u32* visible) {
+    const usize batches = size / 8 * 8;
+    usize count = 0;
+
+    for (usize i = 0; i < batches; i += 8) {
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (usize p = 0; p < Frustum::PlaneCount; p++) {
+            const auto& plane = frustum.planes[p];
+            const auto& axes = corners.axes[p];
+
+            __m256 d = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&axes[0][i]), _mm256_set1_ps(plane.x)), _mm256_mul_ps(_mm256_loadu_ps(&axes[1][i]), _mm256_set1_ps(plane.y))),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&axes[2][i]), _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w))
+            );
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        count += write_visible((u32) _mm256_movemask_ps(inside), (u32) i, visible + count);
+    }
+
+    return count + cull_aabbs_scalar(frustum, corners, size, visible + count, batches);
+}
+
+bool cpu_has_avx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    // The OS has to save the AVX registers too.
+    bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 0x6) == 0x6;
+    __cpuidex(info, 7, 0);
+    return avx && (info[1] & (1 << 5));
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+}
+
+std::string_view cull_backend_name(CullBackend backend) {
+    switch (backend) {
+    case CullBackend::Scalar: return "scalar";
+    case CullBackend::Sse: return "SSE";
+    case CullBackend::Avx2: return "AVX2";
+    }
+    return "unknown";
+}
+
+bool cull_backend_supported(CullBackend backend) {
+    switch (backend) {
+    case CullBackend::Scalar:
+        return true;
+#ifdef CULLING_X86
+    case CullBackend::Sse:
+        return true;
+    case CullBackend::Avx2: {
+        static const bool supported = cpu_has_avx2();
+        return supported;
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+CullBackend best_cull_backend() {
+    if (cull_backend_supported(CullBackend::Avx2))
+        return CullBackend::Avx2;
+    if (cull_backend_supported(CullBackend::Sse))
+        return CullBackend::Sse;
+    return CullBackend::Scalar;
+}
+
+usize cull_spheres(const Frustum& frustum, const CullSpheres& spheres, u32* visible, CullBackend backend) {
+    switch (backend) {
+#ifdef CULLING_X86
+    case CullBackend::Avx2:
+        return cull_spheres_avx2(frustum, spheres, visible);
+    case CullBackend::Sse:
+        return cull_spheres_sse(frustum, spheres, visible);
+#endif
+    default:
+        return cull_spheres_scalar(frustum, spheres, visible, 0);
+    }
+}
+
+usize cull_aabbs(const Frustum& frustum, const CullAabbs& aabbs, u32* visible, CullBackend backend) {
+    AabbCorners corners(frustum, aabbs);
+
+    switch (backend) {
+#ifdef CULLING_X86
+    case CullBackend::Avx2:
+        return cull_aabbs_avx2(frustum, corners, aabbs.size(), visible);
+    case CullBackend::Sse:
+        return cull_aabbs_sse(frustum, corners, aabbs.size(), visible);
+#endif
+    default:
+        return cull_aabbs_scalar(frustum, corners, aabbs.size(), visible, 0);
+    }
+}
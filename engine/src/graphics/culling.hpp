@@ -0,0 +1,63 @@
+#pragma once
+
+#include <span>
+
+/// A view frustum as six inward facing planes (xyz = normal, w = distance).
+/// A point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0.
+struct Frustum {
+    enum Plane : u8 { Left, Right, Bottom, Top, Near, Far, PlaneCount };
+
+    std::array<glm::vec4, PlaneCount> planes;
+
+    /// Extracts normalized planes from a combined projection * view matrix (Gribb-Hartmann).
+    static Frustum from_matrix(const glm::mat4x4& view_proj);
+
+    [[nodiscard]] bool sphere_visible(const glm::vec3& center, f32 radius) const;
+    [[nodiscard]] bool aabb_visible(const glm::vec3& min, const glm::vec3& max) const;
+};
+
+/// Bounding spheres in structure-of-arrays layout so they can be tested several at a time.
+struct CullSpheres {
+    std::span<const f32> x;
+    std::span<const f32> y;
+    std::span<const f32> z;
+    std::span<const f32> radius;
+
+    [[nodiscard]] usize size() const { return x.size(); }
+};
+
+/// Axis aligned bounding boxes in structure-of-arrays layout.
+struct CullAabbs {
+    std::span<const f32> min_x;
+    std::span<const f32> min_y;
+    std::span<const f32> min_z;
+    std::span<const f32> max_x;
+    std::span<const f32> max_y;
+    std::span<const f32> max_z;
+
+    [[nodiscard]] usize size() const { return min_x.size(); }
+};
+
+/// Which instruction set the batch culling functions use.
+enum class CullBackend : u8 {
+    Scalar,
+    /// 4 objects at a time. Always available on x86-64.
+    Sse,
+    /// 8 objects at a time, picked at runtime if the CPU supports it.
+    Avx2,
+};
+
+[[nodiscard]] std::string_view cull_backend_name(CullBackend backend);
+
+/// Returns whether `backend` can run on this CPU.
+[[nodiscard]] bool cull_backend_supported(CullBackend backend);
+
+/// The fastest backend this CPU supports.
+[[nodiscard]] CullBackend best_cull_backend();
+
+/// Tests every sphere against the frustum and writes the indices of the visible ones to `visible`, in order.
+/// `visible` must have room for spheres.size() indices. Returns the number of visible spheres.
+usize cull_spheres(const Frustum& frustum, const CullSpheres& spheres, u32* visible, CullBackend backend = best_cull_backend());
+
+/// Same as cull_spheres, for boxes.
+usize cull_aabbs(const Frustum& frustum, const CullAabbs& aabbs, u32* visible, CullBackend backend = best_cull_backend());
@@ -0,0 +1,114 @@
+#include "ktx2.hpp"
+
+namespace {
+
+constexpr std::array<u8, 12> KTX2_IDENTIFIER = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct Ktx2Header {
+    std::array<u8, 12> identifier;
+    u32 vk_format;
+    u32 type_size;
+    u32 pixel_width;
+    u32 pixel_height;
+    u32 pixel_depth;
+    u32 layer_count;
+    u32 face_count;
+    u32 level_count;
+    u32 supercompression_scheme;
+
+    // Index
+    u32 dfd_byte_offset;
+    u32 dfd_byte_length;
+    u32 kvd_byte_offset;
+    u32 kvd_byte_length;
+    u64 sgd_byte_offset;
+    u64 sgd_byte_length;
+};
+static_assert(sizeof(Ktx2Header) == 80);
+
+struct Ktx2LevelIndex {
+    u64 byte_offset;
+    u64 byte_length;
+    u64 uncompressed_byte_length;
+};
+
+struct BlockInfo {
+    u32 width;
+    u32 height;
+    u32 bytes;
+};
+
+std::optional<BlockInfo> block_info(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        return BlockInfo{ 4, 4, 8 };
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return BlockInfo{ 4, 4, 16 };
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        return BlockInfo{ 1, 1, 4 };
+    default:
+        return std::nullopt;
+    }
+}
+
+}
+
+std::optional<Ktx2Texture> Ktx2Texture::from_bytes(std::span<const u8> bytes) {
+    Ktx2Header header;
+    if (bytes.size() < sizeof(header))
+        return std::nullopt;
+
+    memcpy(&header, bytes.data(), sizeof(header));
+
+    if (header.identifier != KTX2_IDENTIFIER)
+        return std::nullopt;
+
+    // A level count of 0 asks the loader to generate the mips, which we don't do for compressed formats.
+    if (header.pixel_width == 0 || header.pixel_height == 0 || header.pixel_depth != 0 || header.layer_count > 1 ||
+        header.face_count != 1 || header.level_count == 0 || header.supercompression_scheme != 0)
+        return std::nullopt;
+
+    const auto format = (VkFormat) header.vk_format;
+    const auto block = block_info(format);
+    if (!block)
+        return std::nullopt;
+
+    const usize level_index_offset = sizeof(header);
+    if (header.level_count > 32 || bytes.size() < level_index_offset + header.level_count * sizeof(Ktx2LevelIndex))
+        return std::nullopt;
+
+    Ktx2Texture texture{
+        .format = format,
+        .width = header.pixel_width,
+        .height = header.pixel_height,
+    };
+
+    for (u32 level = 0; level < header.level_count; level++) {
+        Ktx2LevelIndex index;
+        memcpy(&index, bytes.data() + level_index_offset + level * sizeof(index), sizeof(index));
+
+        const u32 width = std::max(header.pixel_width >> level, 1u);
+        const u32 height = std::max(header.pixel_height >> level, 1u);
+        const u64 expected_length = (u64) ((width + block->width - 1) / block->width) * ((height + block->height - 1) / block->height) * block->bytes;
+
+        if (index.byte_length != expected_length || index.byte_offset > bytes.size() || bytes.size() - index.byte_offset < index.byte_length)
+            return std::nullopt;
+
+        // The spec aligns every level to the block size, anything else is a broken file.
+        if (index.byte_offset % block->bytes != 0)
+            return std::nullopt;
+
+        texture.levels.push_back({
+            .width = width,
+            .height = height,
+            .data = bytes.subspan(index.byte_offset, index.byte_length)
+        });
+    }
+
+    return texture;
+}
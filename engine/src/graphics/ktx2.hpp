@@ -0,0 +1,26 @@
+#pragma once
+
+#include "../util/vulkan.hpp"
+
+#include <optional>
+#include <span>
+
+/// A KTX2 texture pointing into the asset it was parsed from, like the ones assets/texture_compress.py writes.
+/// Only what the engine can upload directly is accepted: one 2D image with no supercompression, in a block
+/// compressed or RGBA8 format, with every mip level present.
+struct Ktx2Texture {
+    struct Level {
+        u32 width;
+        u32 height;
+        std::span<const u8> data;
+    };
+
+    VkFormat format;
+    u32 width;
+    u32 height;
+    /// Mip levels, largest first.
+    std::vector<Level> levels;
+
+    /// Validates and parses a KTX2 file. Returns std::nullopt if it is malformed or uses something unsupported.
+    static std::optional<Ktx2Texture> from_bytes(std::span<const u8> bytes);
+};
@@ -0,0 +1,407 @@
+#include "allocator.hpp"
+
+namespace {
+
+constexpr VkDeviceSize MIB = 1024 * 1024;
+
+// Blocks for big heaps are this size. Small heaps (eg. the 256 MiB BAR heap) get proportionally smaller blocks.
+constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * MIB;
+
+VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Linear and optimal resources can't share a bufferImageGranularity page.
+bool kinds_conflict(VulkanResourceKind a, VulkanResourceKind b) {
+    return (a == VulkanResourceKind::ImageOptimal) != (b == VulkanResourceKind::ImageOptimal);
+}
+
+}
+
+VulkanAllocator::VulkanAllocator(VkPhysicalDevice physical_device, VkDevice device) :
+        m_physical_device(physical_device),
+        m_device(device) {
+    vkGetPhysicalDeviceMemoryProperties(m_physical_device, &m_memory_properties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physical_device, &properties);
+    m_buffer_image_granularity = properties.limits.bufferImageGranularity;
+    m_non_coherent_atom_size = properties.limits.nonCoherentAtomSize;
+    m_max_allocation_count = properties.limits.maxMemoryAllocationCount;
+}
+
+VulkanAllocator::~VulkanAllocator() {
+    for (u32 i = 0; i < m_blocks.size(); i++) {
+        if (m_blocks[i]) {
+            if (m_blocks[i]->allocation_count != 0)
+                spdlog::warn("destroying memory block {} with {} live allocations", i, m_blocks[i]->allocation_count);
+
+            destroy_block(i);
+        }
+    }
+}
+
+VulkanAllocation VulkanAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags mem_flags, VulkanResourceKind kind, VulkanAllocationStrategy strategy) {
+    const u32 memory_type = choose_memory_type(requirements.memoryTypeBits, mem_flags);
+    const auto type_flags = m_memory_properties.memoryTypes[memory_type].propertyFlags;
+
+    VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+    VkDeviceSize size = requirements.size;
+
+    // Non-coherent memory is flushed in units of nonCoherentAtomSize, so don't let allocations share an atom.
+    if ((type_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(type_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        alignment = std::max(alignment, m_non_coherent_atom_size);
+        size = align_up(size, m_non_coherent_atom_size);
+    }
+
+    const VkDeviceSize block_size = preferred_block_size(memory_type);
+
+    auto make_allocation = [&](u32 block_index, VkDeviceSize offset) {
+        auto& block = *m_blocks[block_index];
+        block.used += size;
+        block.allocation_count++;
+
+        return VulkanAllocation{
+            .memory = block.memory,
+            .offset = offset,
+            .size = size,
+            .mapped = block.mapped ? static_cast<u8*>(block.mapped) + offset : nullptr,
+            .memory_type = memory_type,
+            .block = block_index,
+        };
+    };
+
+    // Large resources get their own block, otherwise they'd just fragment the shared ones.
+    if (size > block_size / 2) {
+        u32 block_index = create_block(memory_type, size, strategy, true);
+        m_blocks[block_index]->suballocations.clear();
+        m_blocks[block_index]->free_ranges.clear();
+        m_blocks[block_index]->suballocations[0] = { .size = size, .kind = kind, .free = false };
+        m_blocks[block_index]->head = size;
+        m_blocks[block_index]->last_kind = kind;
+        return make_allocation(block_index, 0);
+    }
+
+    auto try_block = [&](u32 block_index, VkDeviceSize& offset) {
+        auto& block = *m_blocks[block_index];
+        if (block.strategy == VulkanAllocationStrategy::Linear)
+            return allocate_linear(block, size, alignment, kind, offset);
+        else
+            return allocate_free_list(block, size, alignment, kind, offset);
+    };
+
+    for (u32 i = 0; i < m_blocks.size(); i++) {
+        const auto& block = m_blocks[i];
+        if (!block || block->dedicated || block->memory_type != memory_type || block->strategy != strategy)
+            continue;
+
+        VkDeviceSize offset;
+        if (try_block(i, offset))
+            return make_allocation(i, offset);
+    }
+
+    // Nothing fits, so we need a new block.
+    u32 block_index = create_block(memory_type, block_size, strategy, false);
+
+    VkDeviceSize offset;
+    if (!try_block(block_index, offset))
+        throw std::runtime_error("failed to allocate from a fresh memory block");
+
+    return make_allocation(block_index, offset);
+}
+
+void VulkanAllocator::free(VulkanAllocation& allocation) {
+    if (!allocation)
+        return;
+
+    auto& block = *m_blocks[allocation.block];
+
+    if (block.dedicated) {
+        destroy_block(allocation.block);
+        allocation = {};
+        return;
+    }
+
+    if (block.strategy == VulkanAllocationStrategy::Linear) {
+        // Space in a linear block can only be reused once the whole block is empty.
+        if (block.allocation_count == 1)
+            block.head = 0;
+    } else {
+        free_free_list(block, allocation.offset);
+    }
+
+    block.used -= allocation.size;
+    block.allocation_count--;
+
+    // Keep one empty block around per memory type and strategy so that alloc/free patterns don't thrash vkAllocateMemory.
+    if (block.allocation_count == 0) {
+        for (u32 i = 0; i < m_blocks.size(); i++) {
+            const auto& other = m_blocks[i];
+            if (i != allocation.block && other && !other->dedicated && other->allocation_count == 0 &&
+                other->memory_type == block.memory_type && other->strategy == block.strategy) {
+                destroy_block(allocation.block);
+                break;
+            }
+        }
+    }
+
+    allocation = {};
+}
+
+void VulkanAllocator::create_buffer(const VkBufferCreateInfo& create_info, VkMemoryPropertyFlags mem_flags, VkBuffer& buffer, VulkanAllocation& allocation, VulkanAllocationStrategy strategy) {
+    vulkan_check_res(
+        vkCreateBuffer(m_device, &create_info, nullptr, &buffer),
+        "failed to create buffer"
+    );
+
+    VkMemoryRequirements mem_requirements;
+    vkGetBufferMemoryRequirements(m_device, buffer, &mem_requirements);
+
+    allocation = allocate(mem_requirements, mem_flags, VulkanResourceKind::Buffer, strategy);
+
+    vulkan_check_res(
+        vkBindBufferMemory(m_device, buffer, allocation.memory, allocation.offset),
+        "failed to bind buffer memory"
+    );
+}
+
+void VulkanAllocator::create_image(const VkImageCreateInfo& create_info, VkMemoryPropertyFlags mem_flags, VkImage& image, VulkanAllocation& allocation) {
+    vulkan_check_res(
+        vkCreateImage(m_device, &create_info, nullptr, &image),
+        "failed to create image"
+    );
+
+    VkMemoryRequirements mem_requirements;
+    vkGetImageMemoryRequirements(m_device, image, &mem_requirements);
+
+    const auto kind = create_info.tiling == VK_IMAGE_TILING_LINEAR ? VulkanResourceKind::ImageLinear : VulkanResourceKind::ImageOptimal;
+    allocation = allocate(mem_requirements, mem_flags, kind);
+
+    vulkan_check_res(
+        vkBindImageMemory(m_device, image, allocation.memory, allocation.offset),
+        "failed to bind image memory"
+    );
+}
+
+void VulkanAllocator::destroy_buffer(VkBuffer& buffer, VulkanAllocation& allocation) {
+    vkDestroyBuffer(m_device, buffer, nullptr);
+    buffer = VK_NULL_HANDLE;
+    free(allocation);
+}
+
+void VulkanAllocator::destroy_image(VkImage& image, VulkanAllocation& allocation) {
+    vkDestroyImage(m_device, image, nullptr);
+    image = VK_NULL_HANDLE;
+    free(allocation);
+}
+
+u32 VulkanAllocator::choose_memory_type(u32 memory_type_bits, VkMemoryPropertyFlags mem_flags) const {
+    for (u32 i = 0; i < m_memory_properties.memoryTypeCount; i++) {
+        if ((memory_type_bits & (1 << i)) &&
+            (m_memory_properties.memoryTypes[i].propertyFlags & mem_flags) == mem_flags) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("failed to find suitable memory type");
+}
+
+std::vector<VulkanHeapStats> VulkanAllocator::heap_stats() const {
+    std::vector<VulkanHeapStats> stats(m_memory_properties.memoryHeapCount);
+
+    for (u32 i = 0; i < m_memory_properties.memoryHeapCount; i++) {
+        stats[i].heap_size = m_memory_properties.memoryHeaps[i].size;
+        stats[i].flags = m_memory_properties.memoryHeaps[i].flags;
+    }
+
+    for (const auto& block : m_blocks) {
+        if (!block)
+            continue;
+
+        auto& heap = stats[m_memory_properties.memoryTypes[block->memory_type].heapIndex];
+        heap.block_bytes += block->size;
+        heap.used_bytes += block->used;
+        heap.block_count++;
+        heap.allocation_count += block->allocation_count;
+    }
+
+    return stats;
+}
+
+u32 VulkanAllocator::create_block(u32 memory_type, VkDeviceSize size, VulkanAllocationStrategy strategy, bool dedicated) {
+    if (m_device_allocation_count >= m_max_allocation_count)
+        throw std::runtime_error(fmt::format("exceeded maxMemoryAllocationCount ({})", m_max_allocation_count));
+
+    VkMemoryAllocateInfo alloc_info{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = memory_type
+    };
+
+    auto block = std::make_unique<Block>();
+    vulkan_check_res(
+        vkAllocateMemory(m_device, &alloc_info, nullptr, &block->memory),
+        "failed to allocate {} byte memory block from type {}", size, memory_type
+    );
+    m_device_allocation_count++;
+
+    block->size = size;
+    block->memory_type = memory_type;
+    block->strategy = strategy;
+    block->dedicated = dedicated;
+
+    // The whole block stays mapped for its lifetime since memory can't be mapped more than once at a time.
+    if (m_memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        vulkan_check_res(
+            vkMapMemory(m_device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped),
+            "failed to map memory block"
+        );
+    }
+
+    block->suballocations[0] = { .size = size, .kind = VulkanResourceKind::Buffer, .free = true };
+    block->free_ranges.emplace(size, 0);
+
+    // Reuse a hole left by a destroyed block if there is one.
+    for (u32 i = 0; i < m_blocks.size(); i++) {
+        if (!m_blocks[i]) {
+            m_blocks[i] = std::move(block);
+            return i;
+        }
+    }
+
+    m_blocks.push_back(std::move(block));
+    return m_blocks.size() - 1;
+}
+
+void VulkanAllocator::destroy_block(u32 index) {
+    auto& block = m_blocks[index];
+
+    if (block->mapped)
+        vkUnmapMemory(m_device, block->memory);
+    vkFreeMemory(m_device, block->memory, nullptr);
+    m_device_allocation_count--;
+
+    block.reset();
+}
+
+bool VulkanAllocator::allocate_free_list(Block& block, VkDeviceSize size, VkDeviceSize alignment, VulkanResourceKind kind, VkDeviceSize& offset) {
+    // Best fit: walk the free ranges from the smallest one that could possibly hold us.
+    for (auto it = block.free_ranges.lower_bound(size); it != block.free_ranges.end(); ++it) {
+        const VkDeviceSize range_offset = it->second;
+        const VkDeviceSize range_size = it->first;
+        const VkDeviceSize range_end = range_offset + range_size;
+
+        VkDeviceSize start = align_up(range_offset, alignment);
+
+        // Free ranges are always coalesced, so the ranges directly before and after this one are in use.
+        auto range_it = block.suballocations.find(range_offset);
+
+        if (range_it != block.suballocations.begin()) {
+            const auto prev = std::prev(range_it);
+            if (kinds_conflict(prev->second.kind, kind) && on_same_page(prev->first + prev->second.size, start))
+                start = align_up(start, m_buffer_image_granularity);
+        }
+
+        const VkDeviceSize end = start + size;
+        if (end > range_end)
+            continue;
+
+        const auto next = std::next(range_it);
+        if (next != block.suballocations.end() && kinds_conflict(next->second.kind, kind) && on_same_page(end, next->first))
+            continue;
+
+        // Split the free range into [padding][allocation][remainder].
+        erase_free_range(block, range_offset, range_size);
+        block.suballocations.erase(range_it);
+
+        if (start > range_offset)
+            insert_free_range(block, range_offset, start - range_offset);
+
+        block.suballocations[start] = { .size = size, .kind = kind, .free = false };
+
+        if (range_end > end)
+            insert_free_range(block, end, range_end - end);
+
+        offset = start;
+        return true;
+    }
+
+    return false;
+}
+
+bool VulkanAllocator::allocate_linear(Block& block, VkDeviceSize size, VkDeviceSize alignment, VulkanResourceKind kind, VkDeviceSize& offset) {
+    VkDeviceSize start = align_up(block.head, alignment);
+
+    if (block.allocation_count != 0 && kinds_conflict(block.last_kind, kind) && on_same_page(block.head, start))
+        start = align_up(start, m_buffer_image_granularity);
+
+    if (start + size > block.size)
+        return false;
+
+    block.head = start + size;
+    block.last_kind = kind;
+    offset = start;
+    return true;
+}
+
+void VulkanAllocator::free_free_list(Block& block, VkDeviceSize offset) {
+    auto it = block.suballocations.find(offset);
+    if (it == block.suballocations.end() || it->second.free)
+        throw std::runtime_error(fmt::format("double free or invalid offset {} in memory block", offset));
+
+    VkDeviceSize start = offset;
+    VkDeviceSize end = offset + it->second.size;
+    block.suballocations.erase(it);
+
+    // Merge with free neighbours.
+    auto next = block.suballocations.lower_bound(end);
+    if (next != block.suballocations.end() && next->first == end && next->second.free) {
+        end += next->second.size;
+        erase_free_range(block, next->first, next->second.size);
+        block.suballocations.erase(next);
+    }
+
+    auto after = block.suballocations.lower_bound(start);
+    if (after != block.suballocations.begin()) {
+        auto prev = std::prev(after);
+        if (prev->second.free && prev->first + prev->second.size == start) {
+            start = prev->first;
+            erase_free_range(block, prev->first, prev->second.size);
+            block.suballocations.erase(prev);
+        }
+    }
+
+    insert_free_range(block, start, end - start);
+}
+
+void VulkanAllocator::insert_free_range(Block& block, VkDeviceSize offset, VkDeviceSize size) {
+    block.suballocations[offset] = { .size = size, .kind = VulkanResourceKind::Buffer, .free = true };
+    block.free_ranges.emplace(size, offset);
+}
+
+void VulkanAllocator::erase_free_range(Block& block, VkDeviceSize offset, VkDeviceSize size) {
+    auto [begin, end] = block.free_ranges.equal_range(size);
+    for (auto it = begin; it != end; ++it) {
+        if (it->second == offset) {
+            block.free_ranges.erase(it);
+            return;
+        }
+    }
+}
+
+VkDeviceSize VulkanAllocator::preferred_block_size(u32 memory_type) const {
+    const auto heap_size = m_memory_properties.memoryHeaps[m_memory_properties.memoryTypes[memory_type].heapIndex].size;
+
+    if (heap_size <= 1024 * MIB)
+        return align_up(heap_size / 8, MIB);
+
+    return DEFAULT_BLOCK_SIZE;
+}
+
+bool VulkanAllocator::on_same_page(VkDeviceSize end_of_a, VkDeviceSize start_of_b) const {
+    if (m_buffer_image_granularity <= 1 || end_of_a == 0)
+        return false;
+
+    const VkDeviceSize page_mask = ~(m_buffer_image_granularity - 1);
+    return ((end_of_a - 1) & page_mask) == (start_of_b & page_mask);
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "../../util/vulkan.hpp"
+
+#include <map>
+
+/// How space is handed out inside a memory block.
+enum class VulkanAllocationStrategy : u8 {
+    /// General purpose best-fit free list. Allocations can be freed in any order.
+    FreeList,
+    /// Bump allocation. A block's space is only reclaimed once everything in it has been freed,
+    /// which makes it a good fit for short lived resources like staging buffers.
+    Linear,
+};
+
+/// The kind of resource that will be bound to an allocation.
+/// Linear resources (buffers, linear images) and optimal images have to be bufferImageGranularity apart
+/// if they would otherwise share a "page" of the same memory block.
+enum class VulkanResourceKind : u8 {
+    Buffer,
+    ImageLinear,
+    ImageOptimal,
+};
+
+/// A range of device memory owned by the VulkanAllocator.
+struct VulkanAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+
+    /// Host pointer to the start of the allocation if the memory is host visible, otherwise nullptr.
+    /// Blocks are persistently mapped, so never call vkMapMemory on `memory` yourself.
+    void* mapped = nullptr;
+
+    u32 memory_type = UINT32_MAX;
+    u32 block = UINT32_MAX;
+
+    explicit operator bool() const { return memory != VK_NULL_HANDLE; }
+};
+
+/// Usage statistics for a single memory heap.
+struct VulkanHeapStats {
+    VkDeviceSize heap_size = 0;
+    VkMemoryHeapFlags flags = 0;
+
+    /// Bytes reserved from the driver with vkAllocateMemory.
+    VkDeviceSize block_bytes = 0;
+    /// Bytes handed out to allocations, including alignment padding.
+    VkDeviceSize used_bytes = 0;
+
+    u32 block_count = 0;
+    u32 allocation_count = 0;
+};
+
+/// Sub-allocates resources out of large VkDeviceMemory blocks, one set of blocks per memory type.
+/// This keeps us far away from maxMemoryAllocationCount and avoids a driver call for every resource.
+class VulkanAllocator {
+public:
+    VulkanAllocator(VkPhysicalDevice physical_device, VkDevice device);
+    ~VulkanAllocator();
+
+    VulkanAllocator(const VulkanAllocator&) = delete;
+    VulkanAllocator& operator=(const VulkanAllocator&) = delete;
+
+    /// Allocates memory satisfying `requirements` from a memory type that has all of `mem_flags`.
+    /// Throws if no suitable memory type exists or the device is out of memory.
+    VulkanAllocation allocate(
+        const VkMemoryRequirements& requirements,
+        VkMemoryPropertyFlags mem_flags,
+        VulkanResourceKind kind,
+        VulkanAllocationStrategy strategy = VulkanAllocationStrategy::FreeList
+    );
+
+    /// Returns an allocation to its block and resets it. Freeing an empty allocation does nothing.
+    void free(VulkanAllocation& allocation);
+
+    /// Creates a buffer and binds it to a new allocation.
+    void create_buffer(
+        const VkBufferCreateInfo& create_info,
+        VkMemoryPropertyFlags mem_flags,
+        VkBuffer& buffer,
+        VulkanAllocation& allocation,
+        VulkanAllocationStrategy strategy = VulkanAllocationStrategy::FreeList
+    );
+
+    /// Creates an image and binds it to a new allocation.
+    void create_image(
+        const VkImageCreateInfo& create_info,
+        VkMemoryPropertyFlags mem_flags,
+        VkImage& image,
+        VulkanAllocation& allocation
+    );
+
+    void destroy_buffer(VkBuffer& buffer, VulkanAllocation& allocation);
+    void destroy_image(VkImage& image, VulkanAllocation& allocation);
+
+    /// Finds a memory type allowed by `memory_type_bits` that has all of `mem_flags`.
+    [[nodiscard]] u32 choose_memory_type(u32 memory_type_bits, VkMemoryPropertyFlags mem_flags) const;
+
+    /// Returns usage statistics indexed by heap.
+    [[nodiscard]] std::vector<VulkanHeapStats> heap_stats() const;
+
+    [[nodiscard]] const auto& memory_properties() const { return m_memory_properties; }
+
+private:
+    struct Suballocation {
+        VkDeviceSize size;
+        VulkanResourceKind kind;
+        bool free;
+    };
+
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;
+        u32 memory_type = 0;
+        VulkanAllocationStrategy strategy = VulkanAllocationStrategy::FreeList;
+        /// Dedicated blocks hold a single large allocation and are released with it.
+        bool dedicated = false;
+
+        VkDeviceSize used = 0;
+        u32 allocation_count = 0;
+
+        // FreeList: every range in the block keyed by offset, and the free ones keyed by size.
+        std::map<VkDeviceSize, Suballocation> suballocations;
+        std::multimap<VkDeviceSize, VkDeviceSize> free_ranges;
+
+        // Linear
+        VkDeviceSize head = 0;
+        VulkanResourceKind last_kind = VulkanResourceKind::Buffer;
+    };
+
+    u32 create_block(u32 memory_type, VkDeviceSize size, VulkanAllocationStrategy strategy, bool dedicated);
+    void destroy_block(u32 index);
+
+    bool allocate_free_list(Block& block, VkDeviceSize size, VkDeviceSize alignment, VulkanResourceKind kind, VkDeviceSize& offset);
+    bool allocate_linear(Block& block, VkDeviceSize size, VkDeviceSize alignment, VulkanResourceKind kind, VkDeviceSize& offset);
+    void free_free_list(Block& block, VkDeviceSize offset);
+
+    void insert_free_range(Block& block, VkDeviceSize offset, VkDeviceSize size);
+    void erase_free_range(Block& block, VkDeviceSize offset, VkDeviceSize size);
+
+    [[nodiscard]] VkDeviceSize preferred_block_size(u32 memory_type) const;
+    [[nodiscard]] bool on_same_page(VkDeviceSize end_of_a, VkDeviceSize start_of_b) const;
+
+private:
+    VkPhysicalDevice m_physical_device;
+    VkDevice m_device;
+
+    VkPhysicalDeviceMemoryProperties m_memory_properties;
+    VkDeviceSize m_buffer_image_granularity;
+    VkDeviceSize m_non_coherent_atom_size;
+    u32 m_max_allocation_count;
+
+    /// Blocks are addressed by index from VulkanAllocation, so destroyed blocks leave a nullptr hole to be reused.
+    std::vector<std::unique_ptr<Block>> m_blocks;
+    u32 m_device_allocation_count = 0;
+};
@@ -0,0 +1,91 @@
+#include "descriptor_allocator.hpp"
+
+VulkanDescriptorAllocator::VulkanDescriptorAllocator(VkDevice device, u32 initial_sets, std::span<const VulkanDescriptorRatio> ratios) :
+    m_device(device), m_ratios(ratios.begin(), ratios.end()), m_sets_per_pool(initial_sets) {
+    m_ready_pools.push_back(create_pool(m_sets_per_pool));
+}
+
+VulkanDescriptorAllocator::~VulkanDescriptorAllocator() {
+    for (auto pool : m_full_pools) {
+        vkDestroyDescriptorPool(m_device, pool, nullptr);
+    }
+    for (auto pool : m_ready_pools) {
+        vkDestroyDescriptorPool(m_device, pool, nullptr);
+    }
+}
+
+VkDescriptorSet VulkanDescriptorAllocator::allocate(VkDescriptorSetLayout layout) {
+    VkDescriptorSet set;
+    allocate({ &layout, 1 }, { &set, 1 });
+    return set;
+}
+
+void VulkanDescriptorAllocator::allocate(std::span<const VkDescriptorSetLayout> layouts, std::span<VkDescriptorSet> sets) {
+    VkDescriptorPool pool = get_pool();
+
+    VkDescriptorSetAllocateInfo alloc_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = pool,
+        .descriptorSetCount = (u32) layouts.size(),
+        .pSetLayouts = layouts.data()
+    };
+
+    VkResult res = vkAllocateDescriptorSets(m_device, &alloc_info, sets.data());
+
+    // The pool is used up, retire it and try again with a fresh one.
+    if (res == VK_ERROR_OUT_OF_POOL_MEMORY || res == VK_ERROR_FRAGMENTED_POOL) {
+        m_full_pools.push_back(pool);
+        m_ready_pools.pop_back();
+
+        alloc_info.descriptorPool = get_pool();
+        res = vkAllocateDescriptorSets(m_device, &alloc_info, sets.data());
+    }
+
+    vulkan_check_res(res, "failed to allocate descriptor sets");
+}
+
+void VulkanDescriptorAllocator::reset() {
+    for (auto pool : m_ready_pools) {
+        vkResetDescriptorPool(m_device, pool, 0);
+    }
+    for (auto pool : m_full_pools) {
+        vkResetDescriptorPool(m_device, pool, 0);
+        m_ready_pools.push_back(pool);
+    }
+    m_full_pools.clear();
+}
+
+VkDescriptorPool VulkanDescriptorAllocator::create_pool(u32 set_count) {
+    std::vector<VkDescriptorPoolSize> pool_sizes;
+    for (const auto& ratio : m_ratios) {
+        pool_sizes.push_back({
+            .type = ratio.type,
+            .descriptorCount = std::max(1u, (u32) (ratio.per_set * set_count))
+        });
+    }
+
+    VkDescriptorPoolCreateInfo pool_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = 0,
+        .maxSets = set_count,
+        .poolSizeCount = (u32) pool_sizes.size(),
+        .pPoolSizes = pool_sizes.data()
+    };
+
+    VkDescriptorPool pool;
+    vulkan_check_res(
+        vkCreateDescriptorPool(m_device, &pool_info, nullptr, &pool),
+        "failed to create descriptor pool"
+    );
+    return pool;
+}
+
+VkDescriptorPool VulkanDescriptorAllocator::get_pool() {
+    if (!m_ready_pools.empty())
+        return m_ready_pools.back();
+
+    // Grow geometrically so a steady stream of allocations creates fewer and fewer pools.
+    m_sets_per_pool = std::min(m_sets_per_pool * 2, MAX_SETS_PER_POOL);
+    m_ready_pools.push_back(create_pool(m_sets_per_pool));
+    return m_ready_pools.back();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../../util/vulkan.hpp"
+
+#include <span>
+
+/// How many descriptors of a type a pool gets for each set it can hold.
+struct VulkanDescriptorRatio {
+    VkDescriptorType type;
+    f32 per_set;
+};
+
+/// Hands out descriptor sets from a growing list of pools. When the current pool runs out, a new one twice as big
+/// (up to a limit) is created, so running out of descriptors never fails and pools are created in chunks rather than
+/// per set. Sets live until the allocator is reset or destroyed.
+class VulkanDescriptorAllocator {
+public:
+    static constexpr u32 MAX_SETS_PER_POOL = 4096;
+
+    VulkanDescriptorAllocator(VkDevice device, u32 initial_sets, std::span<const VulkanDescriptorRatio> ratios);
+    ~VulkanDescriptorAllocator();
+
+    VulkanDescriptorAllocator(const VulkanDescriptorAllocator&) = delete;
+    VulkanDescriptorAllocator& operator=(const VulkanDescriptorAllocator&) = delete;
+
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+
+    /// Allocates one set per layout into `sets`, all from the same pool.
+    void allocate(std::span<const VkDescriptorSetLayout> layouts, std::span<VkDescriptorSet> sets);
+
+    /// Frees every set allocated so far. None of them may still be in use by the GPU.
+    void reset();
+
+public:     // Getters
+    [[nodiscard]] usize pool_count() const { return m_full_pools.size() + m_ready_pools.size(); }
+
+private:
+    VkDescriptorPool create_pool(u32 set_count);
+    /// A pool with space left, creating one if there is none.
+    VkDescriptorPool get_pool();
+
+private:
+    VkDevice m_device;
+    std::vector<VulkanDescriptorRatio> m_ratios;
+
+    std::vector<VkDescriptorPool> m_full_pools;
+    std::vector<VkDescriptorPool> m_ready_pools;
+    /// Size of the next pool to be created.
+    u32 m_sets_per_pool;
+};
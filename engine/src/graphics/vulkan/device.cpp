@@ -1,11 +1,11 @@
 #include "device.hpp"
 
-VulkanDevice::VulkanDevice(VkInstance instance, VkSurfaceKHR surface) : m_instance(instance) {
-    choose_physical_device(surface);
-    create_device();
+VulkanDevice::VulkanDevice(VkInstance instance, VkSurfaceKHR surface, bool software) : m_instance(instance) {
+    choose_physical_device(surface, software);
+    create_device(surface != VK_NULL_HANDLE);
 }
 
-void VulkanDevice::choose_physical_device(VkSurfaceKHR surface) {
+void VulkanDevice::choose_physical_device(VkSurfaceKHR surface, bool software) {
     u32 device_count;
     vulkan_check_res(
         vkEnumeratePhysicalDevices(m_instance, &device_count, nullptr),
@@ -19,6 +19,13 @@ void VulkanDevice::choose_physical_device(VkSurfaceKHR surface) {
     u32 present_family = UINT32_MAX;
 
     for (const auto device : devices) {
+        if (software) {
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(device, &properties);
+            if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU)
+                continue;
+        }
+
         u32 queue_family_count = 0;
         vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, nullptr);
 
@@ -33,8 +40,12 @@ void VulkanDevice::choose_physical_device(VkSurfaceKHR surface) {
                 graphics_found = true;
             }
 
+            // Headless, nothing is presented. The graphics family stands in so there's no extra queue.
             VkBool32 present_support = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+            if (surface != VK_NULL_HANDLE)
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+            else
+                present_support = (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
             if (present_support) {
                 present_family = i;
                 present_found = true;
@@ -52,17 +63,51 @@ void VulkanDevice::choose_physical_device(VkSurfaceKHR surface) {
     }
 
     if (physical_device == VK_NULL_HANDLE) {
-        throw std::runtime_error("failed to find a suitable vulkan device");
+        throw std::runtime_error(software ? "failed to find a suitable software vulkan device (is lavapipe installed?)" : "failed to find a suitable vulkan device");
     }
 
     m_physical_device = physical_device;
     m_graphics_family = graphics_family;
     m_present_family = present_family;
 
+    // Look for a transfer only family, usually a DMA engine that can copy without getting in the way of rendering.
+    // It has to be able to copy whole texels anywhere, otherwise small mip levels couldn't be uploaded through it.
+    u32 queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physical_device, &queue_family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physical_device, &queue_family_count, queue_families.data());
+
+    m_timestamp_valid_bits = queue_families[m_graphics_family].timestampValidBits;
+
+    m_transfer_family = m_graphics_family;
+    for (u32 i = 0; i < queue_family_count; i++) {
+        const auto& family = queue_families[i];
+        const auto granularity = family.minImageTransferGranularity;
+
+        if ((family.queueFlags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == VK_QUEUE_TRANSFER_BIT &&
+            granularity.width == 1 && granularity.height == 1 && granularity.depth == 1) {
+            m_transfer_family = i;
+            break;
+        }
+    }
+
     vkGetPhysicalDeviceProperties(m_physical_device, &m_physical_device_properties);
+
+    // Query optional features.
+    VkPhysicalDeviceVulkan12Features vulkan_12_features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES
+    };
+    VkPhysicalDeviceFeatures2 features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &vulkan_12_features
+    };
+    vkGetPhysicalDeviceFeatures2(m_physical_device, &features);
+
+    m_draw_indirect_count = vulkan_12_features.drawIndirectCount;
+    m_texture_compression_bc = features.features.textureCompressionBC;
 }
 
-void VulkanDevice::create_device() {
+void VulkanDevice::create_device(bool swapchain) {
     f32 queue_priority = 1;
     std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
     queue_create_infos.push_back({
@@ -81,11 +126,23 @@ void VulkanDevice::create_device() {
         });
     }
 
+    if (dedicated_transfer_queue() && m_transfer_family != m_present_family) {
+        queue_create_infos.push_back({
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = m_transfer_family,
+            .queueCount = 1,
+            .pQueuePriorities = &queue_priority
+        });
+    }
+
     VkPhysicalDeviceFeatures device_features{
-        .samplerAnisotropy = VK_TRUE
+        .samplerAnisotropy = VK_TRUE,
+        .textureCompressionBC = m_texture_compression_bc
     };
 
-    std::vector<const char*> device_extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    std::vector<const char*> device_extensions;
+    if (swapchain)
+        device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
     u32 available_extension_count;
     vkEnumerateDeviceExtensionProperties(m_physical_device, nullptr, &available_extension_count, nullptr);
@@ -104,9 +161,17 @@ void VulkanDevice::create_device() {
         .dynamicRendering = true
     };
 
+    VkPhysicalDeviceVulkan12Features vulkan_12_features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .pNext = &dynamic_rendering_features,
+        .drawIndirectCount = m_draw_indirect_count,
+        // Core in 1.2 and required, used to track uploads.
+        .timelineSemaphore = true
+    };
+
     VkDeviceCreateInfo device_create_info{
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .pNext = &dynamic_rendering_features,
+        .pNext = &vulkan_12_features,
         .queueCreateInfoCount = (u32) queue_create_infos.size(),
         .pQueueCreateInfos = queue_create_infos.data(),
         .enabledExtensionCount = (u32) device_extensions.size(),
@@ -121,6 +186,7 @@ void VulkanDevice::create_device() {
 
     vkGetDeviceQueue(m_device, m_graphics_family, 0, &m_graphics_queue);
     vkGetDeviceQueue(m_device, m_present_family, 0, &m_present_queue);
+    vkGetDeviceQueue(m_device, m_transfer_family, 0, &m_transfer_queue);
 }
 
 void VulkanDevice::cleanup() {
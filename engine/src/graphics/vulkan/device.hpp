@@ -3,7 +3,9 @@
 /// Manages the VkDevice and associated queues
 class VulkanDevice {
 public:
-    VulkanDevice(VkInstance instance, VkSurfaceKHR surface);
+    /// Without a `surface` the device is only used headless: presenting isn't required and there's no swapchain support.
+    /// With `software`, only CPU implementations (like lavapipe) are considered.
+    VulkanDevice(VkInstance instance, VkSurfaceKHR surface, bool software = false);
     ~VulkanDevice() {
         cleanup();
     }
@@ -13,6 +15,8 @@ public: // Getters
     [[nodiscard]] auto device() const { return m_device; }
     [[nodiscard]] auto graphics_queue() const { return m_graphics_queue; }
     [[nodiscard]] auto present_queue() const { return m_present_queue; }
+    /// The dedicated transfer queue if there is one, otherwise the graphics queue.
+    [[nodiscard]] auto transfer_queue() const { return m_transfer_queue; }
 
     [[nodiscard]] const auto& physical_device_properties() const { return m_physical_device_properties; }
     [[nodiscard]] std::string_view device_name() const {
@@ -21,10 +25,21 @@ public: // Getters
 
     [[nodiscard]] u32 graphics_family() const { return m_graphics_family; }
     [[nodiscard]] u32 present_family() const { return m_present_family; }
+    [[nodiscard]] u32 transfer_family() const { return m_transfer_family; }
+
+public: // Optional features
+    /// Whether uploads can go through a transfer only queue family instead of the graphics queue.
+    [[nodiscard]] bool dedicated_transfer_queue() const { return m_transfer_family != m_graphics_family; }
+    /// Whether vkCmdDrawIndexedIndirectCount can be used.
+    [[nodiscard]] bool draw_indirect_count() const { return m_draw_indirect_count; }
+    /// Whether BC1-7 compressed formats can be sampled.
+    [[nodiscard]] bool texture_compression_bc() const { return m_texture_compression_bc; }
+    /// How many bits of the graphics queue's timestamps are meaningful, 0 if it can't write timestamps.
+    [[nodiscard]] u32 timestamp_valid_bits() const { return m_timestamp_valid_bits; }
 
 private:
-    void choose_physical_device(VkSurfaceKHR surface);
-    void create_device();
+    void choose_physical_device(VkSurfaceKHR surface, bool software);
+    void create_device(bool swapchain);
 
     void cleanup();
 
@@ -35,8 +50,14 @@ private:
     VkPhysicalDeviceProperties m_physical_device_properties;
     u32 m_graphics_family;
     u32 m_present_family;
+    u32 m_transfer_family;
+
+    bool m_draw_indirect_count = false;
+    bool m_texture_compression_bc = false;
+    u32 m_timestamp_valid_bits = 0;
 
     VkDevice m_device;
     VkQueue m_graphics_queue;
     VkQueue m_present_queue;
+    VkQueue m_transfer_queue;
 };
@@ -0,0 +1,70 @@
+#include "frame_allocator.hpp"
+
+VulkanFrameAllocator::VulkanFrameAllocator(VulkanAllocator& allocator, const VkPhysicalDeviceLimits& limits, u32 frame_count, VkDeviceSize capacity) :
+    m_allocator(allocator),
+    m_uniform_alignment(limits.minUniformBufferOffsetAlignment),
+    m_storage_alignment(limits.minStorageBufferOffsetAlignment),
+    m_frames(frame_count) {
+    for (auto& frame : m_frames) {
+        create_frame_buffer(frame, capacity);
+    }
+}
+
+VulkanFrameAllocator::~VulkanFrameAllocator() {
+    for (auto& frame : m_frames) {
+        m_allocator.destroy_buffer(frame.buffer, frame.memory);
+    }
+}
+
+bool VulkanFrameAllocator::begin_frame(u32 frame_index, VkDeviceSize min_capacity) {
+    m_current = frame_index;
+
+    auto& frame = m_frames[frame_index];
+    frame.head = 0;
+
+    if (min_capacity <= frame.capacity)
+        return false;
+
+    // Grow geometrically so a steadily growing scene doesn't reallocate every frame.
+    m_allocator.destroy_buffer(frame.buffer, frame.memory);
+    create_frame_buffer(frame, std::max(min_capacity, frame.capacity * 2));
+    return true;
+}
+
+VulkanTransientSpan VulkanFrameAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+    auto& frame = m_frames[m_current];
+
+    VkDeviceSize offset = (frame.head + alignment - 1) / alignment * alignment;
+    if (offset + size > frame.capacity)
+        throw std::runtime_error("frame allocator is out of space");
+
+    frame.head = offset + size;
+
+    return {
+        .buffer = frame.buffer,
+        .offset = (u32) offset,
+        .mapped = static_cast<u8*>(frame.memory.mapped) + offset
+    };
+}
+
+void VulkanFrameAllocator::create_frame_buffer(Frame& frame, VkDeviceSize capacity) {
+    // Dynamic offsets are 32 bits.
+    if (capacity > UINT32_MAX)
+        throw std::runtime_error("frame allocator capacity is too large");
+
+    VkBufferCreateInfo buffer_info{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = capacity,
+        .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+    m_allocator.create_buffer(
+        buffer_info,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        frame.buffer,
+        frame.memory
+    );
+
+    frame.capacity = capacity;
+    frame.head = 0;
+}
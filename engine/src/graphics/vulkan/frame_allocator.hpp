@@ -0,0 +1,72 @@
+#pragma once
+
+#include "allocator.hpp"
+
+/// Transient memory handed out by VulkanFrameAllocator, valid until its frame comes around again.
+struct VulkanTransientSpan {
+    VkBuffer buffer;
+    /// Offset into `buffer`, meant to be passed as a dynamic descriptor offset.
+    u32 offset;
+    /// Host pointer to the memory, write the data here.
+    u8* mapped;
+};
+
+/// Bump allocator for data that only lives for a single frame, like per-frame constants.
+/// Each frame in flight gets its own persistently mapped buffer, which descriptors can point at once and then
+/// reference allocations through dynamic offsets. Everything allocated for a frame is thrown away at once when the
+/// frame is started again, so there is nothing to free.
+class VulkanFrameAllocator {
+public:
+    static constexpr VkDeviceSize DEFAULT_CAPACITY = 1024 * 1024;
+
+    VulkanFrameAllocator(VulkanAllocator& allocator, const VkPhysicalDeviceLimits& limits, u32 frame_count, VkDeviceSize capacity = DEFAULT_CAPACITY);
+    ~VulkanFrameAllocator();
+
+    VulkanFrameAllocator(const VulkanFrameAllocator&) = delete;
+    VulkanFrameAllocator& operator=(const VulkanFrameAllocator&) = delete;
+
+    /// Starts allocating for `frame`, releasing everything allocated the last time it was used. The frame must not be in flight.
+    /// Grows the frame's buffer to at least `min_capacity` bytes first. Returns whether the buffer was replaced,
+    /// in which case descriptors pointing at it have to be rewritten.
+    bool begin_frame(u32 frame, VkDeviceSize min_capacity = 0);
+
+    /// Allocates `size` bytes for the current frame. Throws if the frame's buffer is full.
+    VulkanTransientSpan allocate(VkDeviceSize size, VkDeviceSize alignment);
+
+    /// Allocates memory that can be bound as a dynamic uniform buffer.
+    VulkanTransientSpan allocate_uniform(VkDeviceSize size) { return allocate(size, m_uniform_alignment); }
+    /// Allocates memory that can be bound as a dynamic storage buffer.
+    VulkanTransientSpan allocate_storage(VkDeviceSize size) { return allocate(size, m_storage_alignment); }
+
+public:     // Getters
+    [[nodiscard]] VkBuffer buffer(u32 frame) const { return m_frames[frame].buffer; }
+    [[nodiscard]] VkDeviceSize capacity(u32 frame) const { return m_frames[frame].capacity; }
+    /// The frame passed to the last begin_frame().
+    [[nodiscard]] u32 current_frame() const { return m_current; }
+    /// Bytes allocated for the current frame so far.
+    [[nodiscard]] VkDeviceSize used() const { return m_frames[m_current].head; }
+
+    /// Worst case size of an allocation of `size` bytes, including alignment padding. Useful to work out a min_capacity.
+    [[nodiscard]] VkDeviceSize uniform_footprint(VkDeviceSize size) const { return size + m_uniform_alignment - 1; }
+    [[nodiscard]] VkDeviceSize storage_footprint(VkDeviceSize size) const { return size + m_storage_alignment - 1; }
+    [[nodiscard]] static VkDeviceSize footprint(VkDeviceSize size, VkDeviceSize alignment) { return size + alignment - 1; }
+
+private:
+    struct Frame {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VulkanAllocation memory;
+        VkDeviceSize capacity = 0;
+        VkDeviceSize head = 0;
+    };
+
+    void create_frame_buffer(Frame& frame, VkDeviceSize capacity);
+
+private:
+    VulkanAllocator& m_allocator;
+
+    VkDeviceSize m_uniform_alignment;
+    VkDeviceSize m_storage_alignment;
+
+    std::vector<Frame> m_frames;
+    u32 m_current = 0;
+};
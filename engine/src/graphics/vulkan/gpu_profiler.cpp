@@ -0,0 +1,131 @@
+#include "gpu_profiler.hpp"
+
+#include <cmath>
+
+// How far each new time moves a scope's rolling average.
+constexpr f64 AVERAGE_WEIGHT = 0.05;
+
+VulkanGpuProfiler::VulkanGpuProfiler(VkDevice device, u32 timestamp_valid_bits, f32 timestamp_period, u32 frame_count, u32 max_scopes) :
+    m_device(device), m_valid_bits(timestamp_valid_bits), m_ns_per_tick(timestamp_period), m_max_scopes(max_scopes) {
+    m_frames.resize(frame_count);
+
+    if (!enabled())
+        return;
+
+    for (auto& frame : m_frames) {
+        VkQueryPoolCreateInfo pool_info{
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2 * m_max_scopes
+        };
+
+        vulkan_check_res(
+            vkCreateQueryPool(m_device, &pool_info, nullptr, &frame.pool),
+            "failed to create timestamp query pool"
+        );
+    }
+}
+
+VulkanGpuProfiler::~VulkanGpuProfiler() {
+    for (auto& frame : m_frames) {
+        if (frame.pool != VK_NULL_HANDLE)
+            vkDestroyQueryPool(m_device, frame.pool, nullptr);
+    }
+}
+
+bool VulkanGpuProfiler::read_results(u32 frame_index) {
+    auto& frame = m_frames[frame_index];
+    if (!enabled() || frame.frame_number == UINT64_MAX)
+        return false;
+
+    const u64 frame_number = frame.frame_number;
+    frame.frame_number = UINT64_MAX;
+
+    m_last_frame_number = frame_number;
+    m_last_frame.clear();
+
+    if (frame.scopes.empty())
+        return true;
+
+    // A value and an availability flag per query. Scopes that were added but never written just aren't available,
+    // and since the frame is done, the rest are.
+    const u32 query_count = 2 * (u32) frame.scopes.size();
+    m_results.resize(2 * query_count);
+
+    VkResult result = vkGetQueryPoolResults(m_device, frame.pool, 0, query_count, m_results.size() * sizeof(u64), m_results.data(),
+        2 * sizeof(u64), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result != VK_NOT_READY)
+        vulkan_check_res(result, "failed to get timestamps of frame {}", frame_number);
+
+    // Only the low bits count, so the difference is taken in that many bits in case they wrapped around.
+    const u64 mask = m_valid_bits >= 64 ? UINT64_MAX : (1ull << m_valid_bits) - 1;
+
+    for (usize i = 0; i < frame.scopes.size(); i++) {
+        const u64 begin = m_results[4 * i];
+        const u64 begin_available = m_results[4 * i + 1];
+        const u64 end = m_results[4 * i + 2];
+        const u64 end_available = m_results[4 * i + 3];
+        if (!begin_available || !end_available)
+            continue;
+
+        const ScopeTime time{ .name = frame.scopes[i], .ms = ((end - begin) & mask) * m_ns_per_tick / 1e6 };
+        m_last_frame.push_back(time);
+
+        // Names are compared by value, the same literal can have different addresses in different translation units.
+        auto it = std::ranges::find_if(m_averages, [&](const ScopeTime& average) {
+            return std::string_view(average.name) == time.name;
+        });
+
+        if (it == m_averages.end())
+            m_averages.push_back(time);
+        else
+            it->ms = std::lerp(it->ms, time.ms, AVERAGE_WEIGHT);
+    }
+
+    return true;
+}
+
+void VulkanGpuProfiler::begin_frame(VkCommandBuffer command_buffer, u32 frame_index, u64 frame_number) {
+    if (!enabled())
+        return;
+
+    read_results(frame_index);
+
+    auto& frame = m_frames[frame_index];
+    vkCmdResetQueryPool(command_buffer, frame.pool, 0, 2 * m_max_scopes);
+    frame.frame_number = frame_number;
+    frame.scopes.clear();
+
+    m_current_frame = frame_index;
+}
+
+u32 VulkanGpuProfiler::add_scope(const char* name) {
+    auto& frame = m_frames[m_current_frame];
+    if (!enabled() || frame.scopes.size() == m_max_scopes)
+        return UINT32_MAX;
+
+    frame.scopes.push_back(name);
+    return (u32) frame.scopes.size() - 1;
+}
+
+void VulkanGpuProfiler::write_begin(VkCommandBuffer command_buffer, u32 scope) const {
+    if (scope == UINT32_MAX)
+        return;
+
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_frames[m_current_frame].pool, 2 * scope);
+}
+
+void VulkanGpuProfiler::write_end(VkCommandBuffer command_buffer, u32 scope) const {
+    if (scope == UINT32_MAX)
+        return;
+
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_frames[m_current_frame].pool, 2 * scope + 1);
+}
+
+std::optional<f64> VulkanGpuProfiler::last_time(std::string_view name) const {
+    for (const auto& time : m_last_frame) {
+        if (name == time.name)
+            return time.ms;
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "../../util/vulkan.hpp"
+
+#include <optional>
+#include <span>
+
+/// Times parts of each frame on the GPU with timestamp queries.
+/// Every frame in flight has its own query pool, read back when the frame comes around again: its fence has been waited
+/// on by then, so nothing ever stalls for results, they just show up a frame or two late.
+/// Scopes are named with string literals, and each name keeps a rolling average of its time.
+///
+/// Scopes are added from the thread recording the frame, but their timestamps can be written into any of the frame's
+/// command buffers, including secondary ones recorded on other threads, as long as they run after begin_frame()'s.
+/// Does nothing if the queue can't write timestamps.
+class VulkanGpuProfiler {
+public:
+    struct ScopeTime {
+        const char* name;
+        f64 ms;
+    };
+
+    /// `timestamp_valid_bits` and `timestamp_period` are those of the queue family and device the frames run on.
+    /// Up to `max_scopes` scopes can be added per frame.
+    VulkanGpuProfiler(VkDevice device, u32 timestamp_valid_bits, f32 timestamp_period, u32 frame_count, u32 max_scopes = 32);
+    ~VulkanGpuProfiler();
+
+    VulkanGpuProfiler(const VulkanGpuProfiler&) = delete;
+    VulkanGpuProfiler& operator=(const VulkanGpuProfiler&) = delete;
+
+    /// Reads back what `frame` recorded the last time it was used, if that hasn't been done yet, and updates the averages.
+    /// Returns whether there was anything to read. The frame must not be in flight.
+    bool read_results(u32 frame);
+
+    /// Starts recording `frame`'s scopes: reads back its last results and resets its queries in `command_buffer`,
+    /// which has to be outside of any rendering. `frame_number` tells the results apart later.
+    void begin_frame(VkCommandBuffer command_buffer, u32 frame, u64 frame_number);
+
+    /// Adds a scope to the current frame, for its timestamps to be written with write_begin() and write_end().
+    /// Returns UINT32_MAX when the frame is out of scopes, which the write functions ignore.
+    u32 add_scope(const char* name);
+    void write_begin(VkCommandBuffer command_buffer, u32 scope) const;
+    void write_end(VkCommandBuffer command_buffer, u32 scope) const;
+
+    /// add_scope() and write_begin() in one, for scopes that start and end in the same command buffer.
+    u32 begin_scope(VkCommandBuffer command_buffer, const char* name) {
+        const u32 scope = add_scope(name);
+        write_begin(command_buffer, scope);
+        return scope;
+    }
+    void end_scope(VkCommandBuffer command_buffer, u32 scope) const { write_end(command_buffer, scope); }
+
+public:     // Getters
+    [[nodiscard]] bool enabled() const { return m_valid_bits > 0; }
+
+    /// The frame number of the last frame read back, UINT64_MAX before the first one.
+    [[nodiscard]] u64 last_frame_number() const { return m_last_frame_number; }
+    /// Times of the scopes in the last frame read back, leaving out any whose timestamps weren't both written.
+    [[nodiscard]] std::span<const ScopeTime> last_frame() const { return m_last_frame; }
+    /// Time of the scope called `name` in the last frame read back, if it had one.
+    [[nodiscard]] std::optional<f64> last_time(std::string_view name) const;
+    /// Rolling average time of every scope name seen so far, in the order they were first seen.
+    [[nodiscard]] std::span<const ScopeTime> averages() const { return m_averages; }
+
+private:
+    struct Frame {
+        VkQueryPool pool = VK_NULL_HANDLE;
+        // UINT64_MAX once the results have been read.
+        u64 frame_number = UINT64_MAX;
+        // Scope i writes queries 2i and 2i + 1.
+        std::vector<const char*> scopes;
+    };
+
+    VkDevice m_device;
+    u32 m_valid_bits;
+    f64 m_ns_per_tick;
+    u32 m_max_scopes;
+
+    std::vector<Frame> m_frames;
+    u32 m_current_frame = 0;
+
+    u64 m_last_frame_number = UINT64_MAX;
+    std::vector<ScopeTime> m_last_frame;
+    std::vector<ScopeTime> m_averages;
+    // Query values and availability, reused between reads.
+    std::vector<u64> m_results;
+};
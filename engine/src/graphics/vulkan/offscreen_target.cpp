@@ -0,0 +1,71 @@
+#include "offscreen_target.hpp"
+
+VulkanOffscreenTarget::VulkanOffscreenTarget(VkDevice device, VulkanAllocator& allocator, VkFormat format, u32 image_count) :
+    m_device(device), m_allocator(allocator), m_format(format), m_image_count(image_count) {}
+
+VulkanOffscreenTarget::~VulkanOffscreenTarget() {
+    reset();
+}
+
+void VulkanOffscreenTarget::create(u32 width, u32 height) {
+    m_extent = { width, height };
+
+    m_images.resize(m_image_count);
+    m_image_memory.resize(m_image_count);
+    m_image_views.resize(m_image_count);
+
+    for (u32 i = 0; i < m_image_count; i++) {
+        VkImageCreateInfo image_info{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = m_format,
+            .extent = { width, height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+        };
+
+        m_allocator.create_image(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_images[i], m_image_memory[i]);
+
+        VkImageViewCreateInfo view_info{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = m_images[i],
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = m_format,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            }
+        };
+
+        vulkan_check_res(
+            vkCreateImageView(m_device, &view_info, nullptr, &m_image_views[i]),
+            "failed to create offscreen image view {}", i
+        );
+    }
+}
+
+void VulkanOffscreenTarget::reset() {
+    for (usize i = 0; i < m_images.size(); i++) {
+        vkDestroyImageView(m_device, m_image_views[i], nullptr);
+        m_allocator.destroy_image(m_images[i], m_image_memory[i]);
+    }
+
+    m_images.clear();
+    m_image_memory.clear();
+    m_image_views.clear();
+    m_next_image = 0;
+}
+
+u32 VulkanOffscreenTarget::acquire() {
+    const u32 index = m_next_image;
+    m_next_image = (m_next_image + 1) % m_image_count;
+    return index;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../../util/vulkan.hpp"
+#include "allocator.hpp"
+
+/// Color images to render into in place of a swapchain's, for running without a window or display.
+/// Nothing is presented: images are handed out round robin, and with one image per frame in flight the frame's
+/// fence is all that keeps an image from being reused too early.
+class VulkanOffscreenTarget {
+public:
+    VulkanOffscreenTarget(VkDevice device, VulkanAllocator& allocator, VkFormat format, u32 image_count);
+    ~VulkanOffscreenTarget();
+
+    VulkanOffscreenTarget(const VulkanOffscreenTarget&) = delete;
+    VulkanOffscreenTarget& operator=(const VulkanOffscreenTarget&) = delete;
+
+    /// Creates the images. They can be used as color attachments and copied from, to read back what was rendered.
+    void create(u32 width, u32 height);
+
+    /// Destroys the images.
+    void reset();
+
+    /// Returns the index of the next image to render into.
+    u32 acquire();
+
+public:     // Getters
+    [[nodiscard]] VkFormat format() const { return m_format; }
+    [[nodiscard]] const auto& extent() const { return m_extent; }
+
+    [[nodiscard]] usize image_count() const { return m_images.size(); }
+    [[nodiscard]] auto image(usize index) const { return m_images[index]; }
+    [[nodiscard]] auto image_view(usize index) const { return m_image_views[index]; }
+
+private:
+    VkDevice m_device;
+    VulkanAllocator& m_allocator;
+    VkFormat m_format;
+    u32 m_image_count;
+
+    VkExtent2D m_extent{};
+    std::vector<VkImage> m_images;
+    std::vector<VulkanAllocation> m_image_memory;
+    std::vector<VkImageView> m_image_views;
+    u32 m_next_image = 0;
+};
@@ -0,0 +1,90 @@
+#include "parallel_recorder.hpp"
+
+#include "../../util/profiler.hpp"
+
+VulkanParallelRecorder::VulkanParallelRecorder(VkDevice device, u32 queue_family, u32 frame_count, JobSystem& jobs) :
+    m_device(device), m_jobs(jobs) {
+    m_pools.resize(frame_count);
+    m_command_buffers.resize(frame_count);
+
+    for (u32 frame = 0; frame < frame_count; frame++) {
+        for (u32 chunk = 0; chunk < max_chunks(); chunk++) {
+            // Command buffers are reset along with their whole pool, so they don't need the reset bit.
+            VkCommandPoolCreateInfo pool_info{
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                .queueFamilyIndex = queue_family,
+            };
+
+            VkCommandPool pool;
+            vulkan_check_res(
+                vkCreateCommandPool(m_device, &pool_info, nullptr, &pool),
+                "failed to create recording command pool"
+            );
+
+            VkCommandBufferAllocateInfo alloc_info{
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                .commandBufferCount = 1
+            };
+
+            VkCommandBuffer command_buffer;
+            vulkan_check_res(
+                vkAllocateCommandBuffers(m_device, &alloc_info, &command_buffer),
+                "failed to allocate secondary command buffer"
+            );
+
+            m_pools[frame].push_back(pool);
+            m_command_buffers[frame].push_back(command_buffer);
+        }
+    }
+}
+
+VulkanParallelRecorder::~VulkanParallelRecorder() {
+    for (const auto& pools : m_pools) {
+        for (auto pool : pools) {
+            vkDestroyCommandPool(m_device, pool, nullptr);
+        }
+    }
+}
+
+std::span<const VkCommandBuffer> VulkanParallelRecorder::record(u32 frame, const VkCommandBufferInheritanceInfo& inheritance, u32 chunk_count, usize item_count, const RecordFn& fn) {
+    chunk_count = std::clamp(chunk_count, 1u, max_chunks());
+
+    m_jobs.parallel_for(chunk_count, 1, [&](usize first_chunk, usize last_chunk) {
+        for (auto chunk = (u32) first_chunk; chunk < last_chunk; chunk++) {
+            PROFILE_SCOPE("record chunk");
+            VkCommandBuffer command_buffer = m_command_buffers[frame][chunk];
+
+            // The frame this pool belongs to is done on the GPU.
+            vulkan_check_res(
+                vkResetCommandPool(m_device, m_pools[frame][chunk], 0),
+                "failed to reset recording command pool"
+            );
+
+            VkCommandBufferBeginInfo begin_info{
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+                .pInheritanceInfo = &inheritance
+            };
+
+            vulkan_check_res(
+                vkBeginCommandBuffer(command_buffer, &begin_info),
+                "failed to begin secondary command buffer"
+            );
+
+            // Even split, the leftovers go to the later chunks one each.
+            const usize first = item_count * chunk / chunk_count;
+            const usize last = item_count * (chunk + 1) / chunk_count;
+            fn(command_buffer, chunk, first, last - first);
+
+            vulkan_check_res(
+                vkEndCommandBuffer(command_buffer),
+                "failed to end secondary command buffer"
+            );
+        }
+    });
+
+    return std::span(m_command_buffers[frame]).first(chunk_count);
+}
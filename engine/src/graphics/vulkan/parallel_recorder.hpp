@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../../util/vulkan.hpp"
+#include "../../job_system.hpp"
+
+#include <functional>
+#include <span>
+
+/// Records secondary command buffers in parallel on a JobSystem.
+/// Each chunk has its own command pool per frame in flight. Only one job at a time ever records a given chunk, so no
+/// pool is used by two threads at once, and a frame's pools can be reset as a whole once the frame is done.
+class VulkanParallelRecorder {
+public:
+    /// Records the items [first, first + count) of chunk `chunk` into `command_buffer`.
+    using RecordFn = std::function<void(VkCommandBuffer command_buffer, u32 chunk, usize first, usize count)>;
+
+    /// Allows up to one chunk per thread of `jobs`.
+    VulkanParallelRecorder(VkDevice device, u32 queue_family, u32 frame_count, JobSystem& jobs);
+    ~VulkanParallelRecorder();
+
+    VulkanParallelRecorder(const VulkanParallelRecorder&) = delete;
+    VulkanParallelRecorder& operator=(const VulkanParallelRecorder&) = delete;
+
+    /// Splits `item_count` items into `chunk_count` chunks and records them in parallel, continuing the render pass or
+    /// dynamic rendering described by `inheritance`. Returns the command buffers in item order, ready for
+    /// vkCmdExecuteCommands. `frame` must not be in flight.
+    std::span<const VkCommandBuffer> record(u32 frame, const VkCommandBufferInheritanceInfo& inheritance, u32 chunk_count, usize item_count, const RecordFn& fn);
+
+public:     // Getters
+    [[nodiscard]] u32 max_chunks() const { return m_jobs.thread_count(); }
+
+private:
+    VkDevice m_device;
+    JobSystem& m_jobs;
+
+    // Indexed by frame, then chunk.
+    std::vector<std::vector<VkCommandPool>> m_pools;
+    std::vector<std::vector<VkCommandBuffer>> m_command_buffers;
+};
@@ -0,0 +1,85 @@
+#include "pipeline_cache.hpp"
+
+#include "../../util/paths.hpp"
+
+VulkanPipelineCache::VulkanPipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, std::filesystem::path path) :
+    m_device(device), m_properties(properties), m_path(std::move(path)) {
+    std::vector<u8> initial_data;
+
+    if (!m_path.empty()) {
+        if (auto data = read_file(m_path)) {
+            if (validate(*data)) {
+                initial_data = std::move(*data);
+                m_loaded = true;
+            } else {
+                spdlog::info("pipeline cache {} is from a different device or driver, ignoring it", m_path.string());
+            }
+        }
+    }
+
+    VkPipelineCacheCreateInfo create_info{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = initial_data.size(),
+        .pInitialData = initial_data.data()
+    };
+
+    VkResult res = vkCreatePipelineCache(m_device, &create_info, nullptr, &m_cache);
+
+    if (res != VK_SUCCESS && m_loaded) {
+        // The header looked fine but the driver still didn't like it, try again without the data.
+        spdlog::warn("{}", vulkan_error_msg(res, "failed to create pipeline cache from {}", m_path.string()));
+        create_info.initialDataSize = 0;
+        create_info.pInitialData = nullptr;
+        m_loaded = false;
+        res = vkCreatePipelineCache(m_device, &create_info, nullptr, &m_cache);
+    }
+
+    vulkan_check_res(res, "failed to create pipeline cache");
+
+    if (m_loaded) {
+        spdlog::info("loaded pipeline cache from {} ({} bytes)", m_path.string(), initial_data.size());
+    }
+}
+
+VulkanPipelineCache::~VulkanPipelineCache() {
+    vkDestroyPipelineCache(m_device, m_cache, nullptr);
+}
+
+void VulkanPipelineCache::save() const {
+    if (m_path.empty())
+        return;
+
+    usize size = 0;
+    VkResult res = vkGetPipelineCacheData(m_device, m_cache, &size, nullptr);
+    if (res != VK_SUCCESS) {
+        spdlog::error("{}", vulkan_error_msg(res, "failed to get pipeline cache size"));
+        return;
+    }
+
+    std::vector<u8> data(size);
+    res = vkGetPipelineCacheData(m_device, m_cache, &size, data.data());
+    if (res != VK_SUCCESS) {
+        spdlog::error("{}", vulkan_error_msg(res, "failed to get pipeline cache data"));
+        return;
+    }
+    data.resize(size);
+
+    if (write_file_atomic(m_path, data)) {
+        spdlog::info("saved pipeline cache to {} ({} bytes)", m_path.string(), size);
+    }
+}
+
+bool VulkanPipelineCache::validate(std::span<const u8> data) const {
+    VkPipelineCacheHeaderVersionOne header;
+    if (data.size() < sizeof(header))
+        return false;
+
+    memcpy(&header, data.data(), sizeof(header));
+
+    return header.headerSize >= sizeof(header)
+        && header.headerSize <= data.size()
+        && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header.vendorID == m_properties.vendorID
+        && header.deviceID == m_properties.deviceID
+        && memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
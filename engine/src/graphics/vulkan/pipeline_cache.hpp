@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../../util/vulkan.hpp"
+
+#include <filesystem>
+
+/// A VkPipelineCache that persists across runs, so pipelines don't have to be compiled from scratch on every launch.
+/// Cache data from another driver, GPU or corrupted file is thrown away and we start with an empty cache.
+class VulkanPipelineCache {
+public:
+    /// Creates the cache, loading its initial data from `path` if it exists and is compatible with this device.
+    VulkanPipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, std::filesystem::path path);
+    ~VulkanPipelineCache();
+
+    VulkanPipelineCache(const VulkanPipelineCache&) = delete;
+    VulkanPipelineCache& operator=(const VulkanPipelineCache&) = delete;
+
+    /// Writes the cache back to its file. Failing to save is logged but not fatal.
+    void save() const;
+
+public:     // Getters
+    [[nodiscard]] auto cache() const { return m_cache; }
+    [[nodiscard]] const auto& path() const { return m_path; }
+
+    /// Whether compatible data was loaded from disk.
+    [[nodiscard]] bool loaded() const { return m_loaded; }
+
+private:
+    /// Checks the cache header written by the driver against our device.
+    bool validate(std::span<const u8> data) const;
+
+private:
+    VkDevice m_device;
+    VkPhysicalDeviceProperties m_properties;
+    std::filesystem::path m_path;
+
+    VkPipelineCache m_cache = VK_NULL_HANDLE;
+    bool m_loaded = false;
+};
@@ -0,0 +1,436 @@
+#include "uploader.hpp"
+
+namespace {
+
+VkSemaphore create_timeline(VkDevice device) {
+    VkSemaphoreTypeCreateInfo semaphore_type_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0
+    };
+    VkSemaphoreCreateInfo semaphore_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &semaphore_type_info
+    };
+
+    VkSemaphore semaphore;
+    vulkan_check_res(
+        vkCreateSemaphore(device, &semaphore_info, nullptr, &semaphore),
+        "failed to create upload timeline semaphore"
+    );
+    return semaphore;
+}
+
+u64 timeline_value(VkDevice device, VkSemaphore semaphore) {
+    u64 value;
+    vulkan_check_res(
+        vkGetSemaphoreCounterValue(device, semaphore, &value),
+        "failed to get upload timeline value"
+    );
+    return value;
+}
+
+void wait_timeline(VkDevice device, VkSemaphore semaphore, u64 value) {
+    VkSemaphoreWaitInfo wait_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &semaphore,
+        .pValues = &value
+    };
+    vulkan_check_res(
+        vkWaitSemaphores(device, &wait_info, UINT64_MAX),
+        "failed to wait for uploads"
+    );
+}
+
+VkCommandPool create_command_pool(VkDevice device, u32 queue_family) {
+    // Every batch gets short lived command buffers, which the transient flag lets the driver optimize for.
+    VkCommandPoolCreateInfo pool_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = queue_family
+    };
+
+    VkCommandPool pool;
+    vulkan_check_res(
+        vkCreateCommandPool(device, &pool_info, nullptr, &pool),
+        "failed to create upload command pool"
+    );
+    return pool;
+}
+
+}
+
+VulkanUploader::VulkanUploader(VkDevice device, VulkanAllocator& allocator, const VulkanUploadQueues& queues, VkDeviceSize capacity) :
+    m_device(device), m_allocator(allocator), m_queues(queues), m_capacity(capacity) {
+    m_graphics_command_pool = create_command_pool(m_device, m_queues.graphics_family);
+    m_timeline = create_timeline(m_device);
+
+    if (dedicated_transfer()) {
+        m_transfer_command_pool = create_command_pool(m_device, m_queues.transfer_family);
+        m_transfer_timeline = create_timeline(m_device);
+    }
+
+    VkBufferCreateInfo buffer_info{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = m_capacity,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+    m_allocator.create_buffer(
+        buffer_info,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        m_ring,
+        m_ring_memory
+    );
+}
+
+VulkanUploader::~VulkanUploader() {
+    wait(flush());
+
+    m_allocator.destroy_buffer(m_ring, m_ring_memory);
+
+    vkDestroySemaphore(m_device, m_timeline, nullptr);
+    vkDestroyCommandPool(m_device, m_graphics_command_pool, nullptr);
+
+    if (dedicated_transfer()) {
+        vkDestroySemaphore(m_device, m_transfer_timeline, nullptr);
+        vkDestroyCommandPool(m_device, m_transfer_command_pool, nullptr);
+    }
+}
+
+VulkanStagingSpan VulkanUploader::stage(VkDeviceSize size, VkDeviceSize alignment) {
+    collect();
+
+    auto& batch = current_batch();
+
+    VkDeviceSize offset = (m_head + alignment - 1) / alignment * alignment;
+    VkDeviceSize padding = offset - m_head;
+
+    // Don't split an allocation across the end of the ring, skip to the start instead.
+    if (offset + size > m_capacity) {
+        padding = m_capacity - m_head;
+        offset = 0;
+    }
+
+    // The free part of the ring starts at the head and wraps around to the oldest batch still in flight.
+    if (m_used + padding + size <= m_capacity) {
+        m_head = offset + size;
+        m_used += padding + size;
+        batch.ring_bytes += padding + size;
+
+        return VulkanStagingSpan{
+            .buffer = m_ring,
+            .offset = offset,
+            .mapped = static_cast<u8*>(m_ring_memory.mapped) + offset
+        };
+    }
+
+    // Out of room, use a one-off buffer that goes away with the batch.
+    VkBufferCreateInfo buffer_info{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+
+    VkBuffer buffer;
+    VulkanAllocation memory;
+    m_allocator.create_buffer(
+        buffer_info,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        buffer,
+        memory,
+        VulkanAllocationStrategy::Linear
+    );
+
+    batch.deferred.push_back([this, buffer, memory]() mutable {
+        m_allocator.destroy_buffer(buffer, memory);
+    });
+
+    return VulkanStagingSpan{
+        .buffer = buffer,
+        .offset = 0,
+        .mapped = static_cast<u8*>(memory.mapped)
+    };
+}
+
+VulkanStagingSpan VulkanUploader::stage(const void* data, VkDeviceSize size, VkDeviceSize alignment) {
+    auto staging = stage(size, alignment);
+    memcpy(staging.mapped, data, size);
+    return staging;
+}
+
+void VulkanUploader::upload_buffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size) {
+    auto staging = stage(data, size);
+
+    VkBufferCopy region{
+        .srcOffset = staging.offset,
+        .dstOffset = offset,
+        .size = size
+    };
+    vkCmdCopyBuffer(transfer_command_buffer(), staging.buffer, buffer, 1, &region);
+
+    release_buffer(buffer, offset, size);
+}
+
+VkCommandBuffer VulkanUploader::transfer_command_buffer() {
+    return current_batch().transfer_command_buffer;
+}
+
+VkCommandBuffer VulkanUploader::graphics_command_buffer() {
+    auto& batch = current_batch();
+    if (batch.graphics_command_buffer == VK_NULL_HANDLE)
+        batch.graphics_command_buffer = begin_command_buffer(m_graphics_command_pool);
+
+    return batch.graphics_command_buffer;
+}
+
+void VulkanUploader::release_buffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) {
+    // On a single queue the barrier at the end of the batch is enough.
+    if (!dedicated_transfer())
+        return;
+
+    VkBufferMemoryBarrier barrier{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = 0,
+        .srcQueueFamilyIndex = m_queues.transfer_family,
+        .dstQueueFamilyIndex = m_queues.graphics_family,
+        .buffer = buffer,
+        .offset = offset,
+        .size = size
+    };
+    vkCmdPipelineBarrier(transfer_command_buffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    // The acquire has to match the release, apart from the access masks.
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(graphics_command_buffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void VulkanUploader::release_image(VkImage image, const VkImageSubresourceRange& range, VkImageLayout layout, VkPipelineStageFlags dst_stage_mask, VkAccessFlags dst_access_mask) {
+    VkImageMemoryBarrier barrier{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = dst_access_mask,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout = layout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = range
+    };
+
+    if (!dedicated_transfer()) {
+        vkCmdPipelineBarrier(transfer_command_buffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage_mask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        return;
+    }
+
+    // Both halves do the same layout transition, which happens once between them.
+    barrier.dstAccessMask = 0;
+    barrier.srcQueueFamilyIndex = m_queues.transfer_family;
+    barrier.dstQueueFamilyIndex = m_queues.graphics_family;
+    vkCmdPipelineBarrier(transfer_command_buffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dst_access_mask;
+    vkCmdPipelineBarrier(graphics_command_buffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage_mask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void VulkanUploader::defer(std::function<void()> fn) {
+    current_batch().deferred.push_back(std::move(fn));
+}
+
+u64 VulkanUploader::flush() {
+    collect();
+
+    if (!m_current)
+        return m_last_value;
+
+    auto& batch = *m_current;
+    batch.value = ++m_last_value;
+
+    if (batch.graphics_command_buffer != VK_NULL_HANDLE) {
+        // Make the batch's writes visible to whatever comes after it on the graphics queue.
+        VkMemoryBarrier barrier{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT
+        };
+        vkCmdPipelineBarrier(
+            batch.graphics_command_buffer,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            0,
+            1, &barrier,
+            0, nullptr,
+            0, nullptr
+        );
+
+        vulkan_check_res(
+            vkEndCommandBuffer(batch.graphics_command_buffer),
+            "failed to end upload command buffer"
+        );
+    }
+
+    if (dedicated_transfer()) {
+        vulkan_check_res(
+            vkEndCommandBuffer(batch.transfer_command_buffer),
+            "failed to end upload command buffer"
+        );
+
+        VkTimelineSemaphoreSubmitInfo timeline_info{
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &batch.value
+        };
+        VkSubmitInfo submit_info{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &batch.transfer_command_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &m_transfer_timeline
+        };
+        vulkan_check_res(
+            vkQueueSubmit(m_queues.transfer_queue, 1, &submit_info, VK_NULL_HANDLE),
+            "failed to submit uploads"
+        );
+
+        batch.state = Batch::State::Transferring;
+    } else {
+        // Everything was recorded into the one command buffer.
+        submit_graphics(batch);
+    }
+
+    m_in_flight.push_back(std::move(batch));
+    m_current.reset();
+
+    return m_last_value;
+}
+
+void VulkanUploader::wait(u64 value) {
+    if (value == 0)
+        return;
+
+    // The graphics part of the batch only gets submitted once its transfers are done.
+    if (dedicated_transfer()) {
+        wait_timeline(m_device, m_transfer_timeline, value);
+        collect();
+    }
+
+    wait_timeline(m_device, m_timeline, value);
+    collect();
+}
+
+void VulkanUploader::collect() {
+    if (m_in_flight.empty())
+        return;
+
+    if (dedicated_transfer()) {
+        const u64 transferred = timeline_value(m_device, m_transfer_timeline);
+
+        // The copies are done so the staging memory can go, and the graphics queue can pick up the rest without waiting.
+        for (auto& batch : m_in_flight) {
+            if (batch.state != Batch::State::Transferring)
+                continue;
+            if (batch.value > transferred)
+                break;
+
+            m_used -= batch.ring_bytes;
+            batch.ring_bytes = 0;
+
+            submit_graphics(batch);
+        }
+    }
+
+    const u64 completed = timeline_value(m_device, m_timeline);
+
+    while (!m_in_flight.empty() && m_in_flight.front().state == Batch::State::Finishing && m_in_flight.front().value <= completed) {
+        auto& batch = m_in_flight.front();
+
+        for (auto& fn : batch.deferred) {
+            fn();
+        }
+
+        if (batch.graphics_command_buffer != VK_NULL_HANDLE && batch.graphics_command_buffer != batch.transfer_command_buffer)
+            vkFreeCommandBuffers(m_device, m_graphics_command_pool, 1, &batch.graphics_command_buffer);
+        vkFreeCommandBuffers(m_device, dedicated_transfer() ? m_transfer_command_pool : m_graphics_command_pool, 1, &batch.transfer_command_buffer);
+
+        m_used -= batch.ring_bytes;
+
+        m_in_flight.pop_front();
+    }
+
+    // Start from the beginning again when nothing is using the ring, so big uploads don't have to wrap.
+    if (m_used == 0)
+        m_head = 0;
+}
+
+bool VulkanUploader::completed(u64 value) const {
+    return timeline_value(m_device, m_timeline) >= value;
+}
+
+VulkanUploader::Batch& VulkanUploader::current_batch() {
+    if (m_current)
+        return *m_current;
+
+    auto& batch = m_current.emplace();
+
+    if (dedicated_transfer()) {
+        batch.transfer_command_buffer = begin_command_buffer(m_transfer_command_pool);
+    } else {
+        batch.transfer_command_buffer = begin_command_buffer(m_graphics_command_pool);
+        batch.graphics_command_buffer = batch.transfer_command_buffer;
+    }
+
+    return batch;
+}
+
+VkCommandBuffer VulkanUploader::begin_command_buffer(VkCommandPool pool) {
+    VkCommandBufferAllocateInfo alloc_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VkCommandBuffer command_buffer;
+    vulkan_check_res(
+        vkAllocateCommandBuffers(m_device, &alloc_info, &command_buffer),
+        "failed to allocate upload command buffer"
+    );
+
+    VkCommandBufferBeginInfo begin_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    vulkan_check_res(
+        vkBeginCommandBuffer(command_buffer, &begin_info),
+        "failed to begin upload command buffer"
+    );
+
+    return command_buffer;
+}
+
+void VulkanUploader::submit_graphics(Batch& batch) {
+    VkTimelineSemaphoreSubmitInfo timeline_info{
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &batch.value
+    };
+    VkSubmitInfo submit_info{
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .commandBufferCount = batch.graphics_command_buffer != VK_NULL_HANDLE ? 1u : 0u,
+        .pCommandBuffers = &batch.graphics_command_buffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &m_timeline
+    };
+    vulkan_check_res(
+        vkQueueSubmit(m_queues.graphics_queue, 1, &submit_info, VK_NULL_HANDLE),
+        "failed to submit uploads"
+    );
+
+    batch.state = Batch::State::Finishing;
+}
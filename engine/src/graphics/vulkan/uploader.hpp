@@ -0,0 +1,142 @@
+#pragma once
+
+#include "allocator.hpp"
+
+#include <deque>
+#include <functional>
+#include <optional>
+
+/// Staging memory handed out by VulkanUploader, valid until the batch it belongs to has finished executing.
+struct VulkanStagingSpan {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    /// Host pointer to the staging memory, write the data to upload here.
+    u8* mapped;
+};
+
+/// Queues used by VulkanUploader. The transfer queue can be the graphics queue if there's no dedicated one.
+struct VulkanUploadQueues {
+    VkQueue transfer_queue;
+    u32 transfer_family;
+    VkQueue graphics_queue;
+    u32 graphics_family;
+};
+
+/// Batches uploads to device local resources into as few queue submissions as possible.
+/// Data is staged in a persistently mapped ring buffer and copied on the transfer queue. Anything that needs the graphics
+/// queue afterwards (acquiring ownership, mip generation, ...) is recorded separately and only submitted once the copies
+/// are done, so the graphics queue never waits on a transfer. Timeline semaphores track the progress of each batch.
+/// Nothing here waits on the GPU unless asked to with wait().
+class VulkanUploader {
+public:
+    static constexpr VkDeviceSize DEFAULT_CAPACITY = 64ull * 1024 * 1024;
+
+    VulkanUploader(VkDevice device, VulkanAllocator& allocator, const VulkanUploadQueues& queues, VkDeviceSize capacity = DEFAULT_CAPACITY);
+    /// Flushes and waits for everything still in flight.
+    ~VulkanUploader();
+
+    VulkanUploader(const VulkanUploader&) = delete;
+    VulkanUploader& operator=(const VulkanUploader&) = delete;
+
+    /// Reserves `size` bytes of staging memory for the current batch.
+    /// When the ring is full of batches the GPU hasn't finished yet, the data gets a staging buffer of its own instead of waiting.
+    VulkanStagingSpan stage(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+    /// Stages a copy of `data`.
+    VulkanStagingSpan stage(const void* data, VkDeviceSize size, VkDeviceSize alignment = 16);
+
+    /// Copies `data` to `buffer` at `offset` as part of the current batch, and hands the range over to the graphics queue.
+    void upload_buffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+
+    /// Command buffer for copying out of staged memory, on the transfer queue.
+    /// Only transfer commands and barriers can be recorded into it.
+    VkCommandBuffer transfer_command_buffer();
+
+    /// Command buffer on the graphics queue that runs after the batch's transfers and handovers.
+    /// Writes are made visible to everything submitted after it, but image layouts are up to the caller.
+    VkCommandBuffer graphics_command_buffer();
+
+    /// Hands a range of a buffer written on the transfer command buffer over to the graphics queue.
+    void release_buffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+
+    /// Hands an image written on the transfer command buffer over to the graphics queue, transitioning it from
+    /// TRANSFER_DST_OPTIMAL to `layout` for use in `dst_stage_mask` with `dst_access_mask`.
+    void release_image(VkImage image, const VkImageSubresourceRange& range, VkImageLayout layout, VkPipelineStageFlags dst_stage_mask, VkAccessFlags dst_access_mask);
+
+    /// Runs `fn` once the current batch has finished executing, to clean up resources it uses.
+    void defer(std::function<void()> fn);
+
+    /// Submits the transfers of the current batch if anything was recorded into it.
+    /// Returns the timeline value signaled once the whole batch is done, or the value of the last batch if there was nothing to submit.
+    u64 flush();
+
+    /// Blocks until the batch that signals `value` is done.
+    void wait(u64 value);
+
+    /// Submits the graphics work of batches whose transfers are done, then reclaims the staging memory and runs
+    /// the deferred work of finished batches. Never blocks.
+    void collect();
+
+    /// Whether the batch that signals `value` is done.
+    [[nodiscard]] bool completed(u64 value) const;
+
+public:     // Getters
+    [[nodiscard]] auto timeline() const { return m_timeline; }
+    [[nodiscard]] auto capacity() const { return m_capacity; }
+    /// Whether transfers run on their own queue family.
+    [[nodiscard]] bool dedicated_transfer() const { return m_queues.transfer_family != m_queues.graphics_family; }
+    /// Number of batches submitted so far.
+    [[nodiscard]] auto submit_count() const { return m_last_value; }
+
+private:
+    struct Batch {
+        enum class State : u8 {
+            Recording,
+            /// The transfer part was submitted, the graphics part waits for it to finish.
+            Transferring,
+            /// Everything was submitted.
+            Finishing,
+        };
+
+        State state = State::Recording;
+        /// Without a dedicated transfer queue both parts share the graphics command buffer.
+        VkCommandBuffer transfer_command_buffer = VK_NULL_HANDLE;
+        VkCommandBuffer graphics_command_buffer = VK_NULL_HANDLE;
+        u64 value = 0;
+        /// Ring bytes used by the batch, including alignment and wrap-around padding.
+        VkDeviceSize ring_bytes = 0;
+        std::vector<std::function<void()>> deferred;
+    };
+
+    /// Starts recording the current batch if it hasn't been started yet.
+    Batch& current_batch();
+
+    VkCommandBuffer begin_command_buffer(VkCommandPool pool);
+
+    /// Submits the graphics part of `batch`, which signals the end of the batch.
+    void submit_graphics(Batch& batch);
+
+private:
+    VkDevice m_device;
+    VulkanAllocator& m_allocator;
+    VulkanUploadQueues m_queues;
+
+    VkCommandPool m_transfer_command_pool = VK_NULL_HANDLE;
+    VkCommandPool m_graphics_command_pool = VK_NULL_HANDLE;
+
+    /// Signaled by the transfer queue when a batch's copies are done, only used with a dedicated transfer queue.
+    VkSemaphore m_transfer_timeline = VK_NULL_HANDLE;
+    /// Signaled by the graphics queue when a batch is done.
+    VkSemaphore m_timeline = VK_NULL_HANDLE;
+    u64 m_last_value = 0;
+
+    VkBuffer m_ring = VK_NULL_HANDLE;
+    VulkanAllocation m_ring_memory;
+    VkDeviceSize m_capacity;
+    /// Where the next allocation starts, and how many bytes from there on back are in use.
+    VkDeviceSize m_head = 0;
+    VkDeviceSize m_used = 0;
+
+    std::optional<Batch> m_current;
+    std::deque<Batch> m_in_flight;
+};
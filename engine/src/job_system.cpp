@@ -0,0 +1,229 @@
+#include "job_system.hpp"
+
+#include "util/profiler.hpp"
+
+// Which JobSystem the current thread is a worker of, if any.
+static thread_local const JobSystem* t_job_system = nullptr;
+static thread_local u32 t_thread_index = UINT32_MAX;
+
+JobSystem::JobSystem(u32 thread_count) : m_main_thread(std::this_thread::get_id()) {
+    if (thread_count == 0)
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (u32 thread = 0; thread < thread_count; thread++) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+
+    // Only start the workers once all the queues exist, they steal from every one of them.
+    for (u32 thread = 1; thread < thread_count; thread++) {
+        m_workers.emplace_back([this, thread] { worker_main(thread); });
+    }
+}
+
+JobSystem::~JobSystem() {
+    m_stop.store(true);
+    m_epoch.fetch_add(1);
+    m_epoch.notify_all();
+
+    m_workers.clear();
+}
+
+JobHandle JobSystem::schedule(std::function<void()> fn, std::span<const JobHandle> dependencies, JobAffinity affinity) {
+    auto job = std::make_shared<Job>();
+    job->m_fn = std::move(fn);
+    job->m_affinity = affinity;
+
+    for (const auto& dependency : dependencies) {
+        if (!dependency)
+            continue;
+
+        std::lock_guard lock(dependency->m_mutex);
+        if (!dependency->m_finished) {
+            dependency->m_dependents.push_back(job);
+            job->m_pending.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Drop the reference held while setting up. If every dependency is already done, the job is ready right away.
+    if (job->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        enqueue(job);
+
+    return job;
+}
+
+JobHandle JobSystem::schedule_parallel_for(usize count, usize chunk_size, std::function<void(usize first, usize last)> fn, std::span<const JobHandle> dependencies) {
+    chunk_size = std::max(chunk_size, 1uz);
+
+    // Shared by every chunk instead of copied into each of them.
+    auto shared_fn = std::make_shared<std::function<void(usize, usize)>>(std::move(fn));
+
+    std::vector<JobHandle> chunks;
+    chunks.reserve((count + chunk_size - 1) / chunk_size);
+    for (usize first = 0; first < count; first += chunk_size) {
+        const usize last = std::min(first + chunk_size, count);
+        chunks.push_back(schedule([shared_fn, first, last] { (*shared_fn)(first, last); }, dependencies));
+    }
+
+    // Finishes with the chunks and passes on the first exception.
+    return schedule([chunks] {
+        for (const auto& chunk : chunks) {
+            if (chunk->m_error)
+                std::rethrow_exception(chunk->m_error);
+        }
+    }, chunks.empty() ? dependencies : chunks);
+}
+
+void JobSystem::wait(const JobHandle& job) {
+    const u32 thread = current_thread();
+
+    while (!job->done()) {
+        if (!run_one(thread))
+            std::this_thread::yield();
+    }
+
+    if (job->m_error)
+        std::rethrow_exception(job->m_error);
+}
+
+usize JobSystem::run_main_thread_jobs() {
+    usize count = 0;
+
+    while (true) {
+        JobHandle job;
+        {
+            std::lock_guard lock(m_main_thread_queue.mutex);
+            if (m_main_thread_queue.jobs.empty())
+                break;
+
+            job = std::move(m_main_thread_queue.jobs.front());
+            m_main_thread_queue.jobs.pop_front();
+        }
+
+        execute(job);
+        count++;
+    }
+
+    return count;
+}
+
+u32 JobSystem::current_thread() const {
+    if (t_job_system == this)
+        return t_thread_index;
+    if (std::this_thread::get_id() == m_main_thread)
+        return 0;
+    return UINT32_MAX;
+}
+
+void JobSystem::worker_main(u32 thread) {
+    t_job_system = this;
+    t_thread_index = thread;
+    profiler_set_thread_name(fmt::format("worker {}", thread));
+
+    while (!m_stop.load()) {
+        const u32 epoch = m_epoch.load();
+        if (run_one(thread))
+            continue;
+
+        // Anything queued after `epoch` was read bumps it, so this can't sleep through new work.
+        m_sleeping.fetch_add(1);
+        if (!m_stop.load())
+            m_epoch.wait(epoch);
+        m_sleeping.fetch_sub(1);
+    }
+}
+
+void JobSystem::enqueue(JobHandle job) {
+    if (job->m_affinity == JobAffinity::MainThread) {
+        std::lock_guard lock(m_main_thread_queue.mutex);
+        m_main_thread_queue.jobs.push_back(std::move(job));
+        return;
+    }
+
+    u32 thread = current_thread();
+    if (thread == UINT32_MAX)
+        thread = m_next_queue.fetch_add(1, std::memory_order_relaxed) % thread_count();
+
+    {
+        auto& queue = *m_queues[thread];
+        std::lock_guard lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+
+    m_epoch.fetch_add(1);
+    if (m_sleeping.load() > 0)
+        m_epoch.notify_one();
+}
+
+void JobSystem::execute(const JobHandle& job) {
+    try {
+        job->m_fn();
+    } catch (...) {
+        job->m_error = std::current_exception();
+    }
+
+    // Let go of whatever the function captured.
+    job->m_fn = nullptr;
+
+    std::vector<JobHandle> dependents;
+    {
+        std::lock_guard lock(job->m_mutex);
+        job->m_finished = true;
+        dependents.swap(job->m_dependents);
+    }
+    job->m_done.store(true, std::memory_order_release);
+
+    for (auto& dependent : dependents) {
+        if (dependent->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            enqueue(std::move(dependent));
+    }
+}
+
+bool JobSystem::run_one(u32 thread) {
+    JobHandle job;
+
+    if (thread == 0) {
+        std::lock_guard lock(m_main_thread_queue.mutex);
+        if (!m_main_thread_queue.jobs.empty()) {
+            job = std::move(m_main_thread_queue.jobs.front());
+            m_main_thread_queue.jobs.pop_front();
+        }
+    }
+
+    // Newest first from our own queue, it's the most likely to still be in cache.
+    if (!job && thread != UINT32_MAX) {
+        auto& queue = *m_queues[thread];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.jobs.empty()) {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+    }
+
+    if (!job)
+        job = steal(thread);
+
+    if (!job)
+        return false;
+
+    execute(job);
+    return true;
+}
+
+JobHandle JobSystem::steal(u32 thread) {
+    const u32 count = thread_count();
+    const u32 start = thread == UINT32_MAX ? 0 : thread + 1;
+
+    // Oldest first from everyone else, those tend to be the biggest pieces of work.
+    for (u32 i = 0; i < count; i++) {
+        auto& queue = *m_queues[(start + i) % count];
+
+        std::lock_guard lock(queue.mutex);
+        if (!queue.jobs.empty()) {
+            auto job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            return job;
+        }
+    }
+
+    return nullptr;
+}
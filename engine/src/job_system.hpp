@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+
+enum class JobAffinity : u8 {
+    /// Runs on whichever thread gets to it first.
+    Any,
+    /// Only runs on the thread that created the JobSystem, while it waits on a job or calls run_main_thread_jobs().
+    /// For anything that has to happen on the main thread, like talking to SDL.
+    MainThread,
+};
+
+/// A scheduled job. Only ever handled through a JobHandle.
+class Job {
+public:
+    /// Whether the job has run, successfully or not.
+    [[nodiscard]] bool done() const { return m_done.load(std::memory_order_acquire); }
+
+private:
+    friend class JobSystem;
+
+    std::function<void()> m_fn;
+    JobAffinity m_affinity = JobAffinity::Any;
+
+    // Dependencies that haven't finished yet, plus one held by schedule() while it sets the job up.
+    std::atomic<u32> m_pending = 1;
+    std::atomic<bool> m_done = false;
+    std::exception_ptr m_error;
+
+    // Guards the dependents against jobs being added as it finishes.
+    std::mutex m_mutex;
+    bool m_finished = false;
+    std::vector<std::shared_ptr<Job>> m_dependents;
+};
+
+using JobHandle = std::shared_ptr<Job>;
+
+/// Work-stealing job scheduler. Every thread has its own queue. New jobs go to the back of the scheduling thread's
+/// queue, threads take their own work from the back and steal from the front of other queues when they run out.
+/// The thread that creates the JobSystem is thread 0 and works through jobs whenever it waits on one.
+class JobSystem {
+public:
+    /// Starts `thread_count` - 1 worker threads, or one per core besides the main thread if 0.
+    explicit JobSystem(u32 thread_count = 0);
+    /// Jobs that haven't run yet are dropped, wait on anything that has to finish first.
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    /// Schedules `fn` to run once every job in `dependencies` is done. Null handles are ignored.
+    /// If a job throws, the exception is rethrown from wait(). Jobs depending on it still run.
+    JobHandle schedule(std::function<void()> fn, std::span<const JobHandle> dependencies = {}, JobAffinity affinity = JobAffinity::Any);
+
+    /// Splits [0, count) into chunks of `chunk_size` and calls `fn(first, last)` for each of them in parallel.
+    /// The returned job is done once every chunk is, and rethrows the first exception any of them threw.
+    JobHandle schedule_parallel_for(usize count, usize chunk_size, std::function<void(usize first, usize last)> fn, std::span<const JobHandle> dependencies = {});
+
+    /// schedule_parallel_for() and wait for it.
+    void parallel_for(usize count, usize chunk_size, std::function<void(usize first, usize last)> fn) {
+        wait(schedule_parallel_for(count, chunk_size, std::move(fn)));
+    }
+
+    /// Runs other jobs until `job` is done, then rethrows its exception if it threw.
+    void wait(const JobHandle& job);
+
+    /// Runs every main thread job that is ready. Call it regularly from the main thread if anything schedules them.
+    /// Returns how many ran.
+    usize run_main_thread_jobs();
+
+public:     // Getters
+    /// Worker threads plus the main thread.
+    [[nodiscard]] u32 thread_count() const { return (u32) m_queues.size(); }
+    /// 0 on the main thread, 1 and up on the workers, UINT32_MAX on threads that don't belong to this JobSystem.
+    [[nodiscard]] u32 current_thread() const;
+
+private:
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    void worker_main(u32 thread);
+
+    void enqueue(JobHandle job);
+    void execute(const JobHandle& job);
+    /// Runs one job that's ready if there is one, returns whether it did.
+    bool run_one(u32 thread);
+    JobHandle steal(u32 thread);
+
+private:
+    std::thread::id m_main_thread;
+
+    // Indexed by thread.
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    Queue m_main_thread_queue;
+
+    std::vector<std::jthread> m_workers;
+
+    // Bumped whenever a job is queued, workers sleep on it when there's nothing to do.
+    std::atomic<u32> m_epoch = 0;
+    std::atomic<u32> m_sleeping = 0;
+    std::atomic<bool> m_stop = false;
+
+    // Threads that aren't part of the JobSystem spread their jobs over the queues.
+    std::atomic<u32> m_next_queue = 0;
+};
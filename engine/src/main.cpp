@@ -1,23 +1,161 @@
 #include "engine.hpp"
 
+#include "bench/bench.hpp"
+
+#include "util/profiler.hpp"
+
+#include <charconv>
+
+// Exit codes, so scripts can tell a bad command line from a failed run.
+constexpr int EXIT_OK = 0;
+constexpr int EXIT_ERROR = 1;
+constexpr int EXIT_USAGE = 2;
+
+// Frames rendered headless or benchmarking when --frames isn't given. There's no window to close, or it shouldn't have to be.
+constexpr u32 DEFAULT_FRAME_COUNT = 1000;
+
+static void print_usage() {
+    fmt::println("usage: engine-main [options]");
+    fmt::println("       engine-main --bench [name]");
+    fmt::println("");
+    fmt::println("  --headless         render offscreen, without a window or display");
+    fmt::println("  --software         use a CPU Vulkan implementation, like lavapipe");
+    fmt::println("  --frames <n>       quit after n frames and log the frame time (headless and benchmark default {})", DEFAULT_FRAME_COUNT);
+    fmt::println("  --size <w>x<h>     window or offscreen size");
+    fmt::println("  --seed <n>         seed for placing the cubes");
+    fmt::println("  --objects <n>      number of cubes (default {})", EngineConfig{}.object_count);
+    fmt::println("  --benchmark        fly a scripted camera path with a fixed seed and write frame time statistics");
+    fmt::println("  --warmup <n>       frames rendered before the benchmark starts measuring (default {})", EngineConfig{}.warmup_frames);
+    fmt::println("  --output <file>    where the benchmark results go (default {})", EngineConfig{}.benchmark_output.string());
+    fmt::println("  --trace <file>     profile the CPU from the start and write a Chrome trace on quitting or with F9");
+    fmt::println("  --trace-frames <n> how many of the last frames a trace covers (default {})", EngineConfig{}.trace_frames);
+    fmt::println("  --bench [name]     run a micro-benchmark, or list them");
+}
+
+static bool parse_u32(std::string_view str, u32& value) {
+    auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    return ec == std::errc{} && end == str.data() + str.size();
+}
+
+// Fills in `config` from the engine's options. Returns false and logs why if they don't make sense.
+static bool parse_engine_args(std::span<const std::string_view> args, EngineConfig& config) {
+    for (usize i = 0; i < args.size(); i++) {
+        const auto arg = args[i];
+        const bool has_value = i + 1 < args.size();
+
+        if (arg == "--headless") {
+            config.headless = true;
+        } else if (arg == "--software") {
+            config.software_device = true;
+        } else if (arg == "--frames" && has_value) {
+            if (!parse_u32(args[++i], config.frame_count)) {
+                spdlog::critical("invalid frame count: {}", args[i]);
+                return false;
+            }
+        } else if (arg == "--seed" && has_value) {
+            u32 seed;
+            if (!parse_u32(args[++i], seed)) {
+                spdlog::critical("invalid seed: {}", args[i]);
+                return false;
+            }
+            config.seed = seed;
+        } else if (arg == "--objects" && has_value) {
+            if (!parse_u32(args[++i], config.object_count)) {
+                spdlog::critical("invalid object count: {}", args[i]);
+                return false;
+            }
+        } else if (arg == "--benchmark") {
+            config.benchmark = true;
+        } else if (arg == "--warmup" && has_value) {
+            if (!parse_u32(args[++i], config.warmup_frames)) {
+                spdlog::critical("invalid warm-up frame count: {}", args[i]);
+                return false;
+            }
+        } else if (arg == "--output" && has_value) {
+            config.benchmark_output = args[++i];
+        } else if (arg == "--trace" && has_value) {
+            config.trace_output = args[++i];
+        } else if (arg == "--trace-frames" && has_value) {
+            if (!parse_u32(args[++i], config.trace_frames) || config.trace_frames == 0) {
+                spdlog::critical("invalid trace frame count: {}", args[i]);
+                return false;
+            }
+        } else if (arg == "--size" && has_value) {
+            const auto size = args[++i];
+            const auto x = size.find('x');
+            if (x == std::string_view::npos || !parse_u32(size.substr(0, x), config.width) || !parse_u32(size.substr(x + 1), config.height) ||
+                config.width == 0 || config.height == 0) {
+                spdlog::critical("invalid size: {}", size);
+                return false;
+            }
+        } else {
+            spdlog::critical("unknown or incomplete option: {}", arg);
+            return false;
+        }
+    }
+
+    if ((config.headless || config.benchmark) && config.frame_count == 0)
+        config.frame_count = DEFAULT_FRAME_COUNT;
+
+    return true;
+}
+
 int main(int argc, char** argv) {
+    std::vector<std::string_view> args(argv + 1, argv + argc);
+
+    // `--bench <name>` runs a micro-benchmark instead of the engine, `--bench` lists them.
+    if (!args.empty() && args[0] == "--bench") {
+        if (args.size() < 2) {
+            for (const auto& benchmark : benchmarks()) {
+                fmt::println("{:<16} {}", benchmark.name, benchmark.description);
+            }
+            fmt::println("{:<16} {}", "all", "run every benchmark");
+            return EXIT_OK;
+        }
+
+        if (!run_benchmark(args[1])) {
+            spdlog::critical("no benchmark named {}", args[1]);
+            return EXIT_USAGE;
+        }
+        return EXIT_OK;
+    }
+
+    if (!args.empty() && (args[0] == "--help" || args[0] == "-h")) {
+        print_usage();
+        return EXIT_OK;
+    }
+
+    EngineConfig config;
+    if (!parse_engine_args(args, config)) {
+        print_usage();
+        return EXIT_USAGE;
+    }
+
+    // Turned on before anything starts up so startup is in the trace too.
+    profiler_set_thread_name("main");
+    if (!config.trace_output.empty())
+        profiler_set_enabled(true);
+
     try {
         Engine engine;
-        
+
         // Initialize everything.
         try {
-            engine.start();
+            engine.start(config);
         } catch (std::exception& e) {
             spdlog::critical("exception thrown during initialization: {}", e.what());
-            return -1;
+            return EXIT_ERROR;
         }
 
         // Run main loop.
         engine.run();
+
+        if (!config.trace_output.empty())
+            profiler_write_trace(config.trace_output, config.trace_frames);
     } catch(std::exception& e) {
         spdlog::critical("uncaught exception: {}", e.what());
-        return -1;
+        return EXIT_ERROR;
     }
 
-    return 0;
+    return EXIT_OK;
 }
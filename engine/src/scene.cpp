@@ -0,0 +1,296 @@
+#include "scene.hpp"
+
+#include "job_system.hpp"
+
+ObjectHandle Scene::add(const glm::vec3& pos, const glm::quat& rot, ObjectMobility mobility, const RenderProxy& proxy) {
+    const u32 index = (u32) size();
+
+    u32 slot;
+    if (!m_free_slots.empty()) {
+        slot = m_free_slots.back();
+        m_free_slots.pop_back();
+    } else {
+        slot = (u32) m_slots.size();
+        m_slots.push_back({ .index = UINT32_MAX, .generation = 0 });
+    }
+    m_slots[slot].index = index;
+
+    m_positions.push_back(pos);
+    m_rotations.push_back(rot);
+    m_matrices.push_back(model_matrix(pos, rot));
+    m_previous_positions.push_back(pos);
+    m_previous_rotations.push_back(rot);
+    m_proxies.push_back(proxy);
+    m_mobility.push_back(mobility);
+    m_dirty_positions.push_back(UINT32_MAX);
+    m_index_slots.push_back(slot);
+
+    const ObjectHandle handle{ .slot = slot, .generation = m_slots[slot].generation };
+    if (mobility == ObjectMobility::Dynamic) {
+        m_dynamic_positions.push_back((u32) m_dynamic_objects.size());
+        m_dynamic_objects.push_back(handle);
+    } else {
+        m_dynamic_positions.push_back(UINT32_MAX);
+    }
+
+    mark_dirty(index);
+    m_version++;
+
+    return handle;
+}
+
+void Scene::remove(ObjectHandle handle) {
+    if (!contains(handle))
+        return;
+
+    const u32 index = m_slots[handle.slot].index;
+    const u32 last = (u32) size() - 1;
+
+    if (m_mobility[index] == ObjectMobility::Dynamic) {
+        const u32 position = m_dynamic_positions[index];
+        const auto moved = m_dynamic_objects.back();
+        m_dynamic_objects[position] = moved;
+        m_dynamic_positions[m_slots[moved.slot].index] = position;
+        m_dynamic_objects.pop_back();
+    }
+
+    // The last object takes the removed one's place and has to be uploaded there.
+    // Make sure `index` ends up in the dirty list exactly once, and `last` not at all.
+    auto erase_dirty = [&](u32 dirty_index) {
+        const u32 position = m_dirty_positions[dirty_index];
+        const u32 moved = m_dirty.back();
+        m_dirty[position] = moved;
+        m_dirty_positions[moved] = position;
+        m_dirty.pop_back();
+        m_dirty_positions[dirty_index] = UINT32_MAX;
+    };
+
+    const bool index_dirty = m_dirty_positions[index] != UINT32_MAX;
+    const bool last_dirty = m_dirty_positions[last] != UINT32_MAX;
+    if (index == last) {
+        if (last_dirty)
+            erase_dirty(last);
+    } else if (last_dirty) {
+        if (index_dirty) {
+            erase_dirty(last);
+        } else {
+            m_dirty[m_dirty_positions[last]] = index;
+            m_dirty_positions[index] = m_dirty_positions[last];
+        }
+    } else if (!index_dirty) {
+        m_dirty_positions[index] = (u32) m_dirty.size();
+        m_dirty.push_back(index);
+    }
+
+    if (index != last) {
+        m_positions[index] = m_positions[last];
+        m_rotations[index] = m_rotations[last];
+        m_matrices[index] = m_matrices[last];
+        m_previous_positions[index] = m_previous_positions[last];
+        m_previous_rotations[index] = m_previous_rotations[last];
+        m_proxies[index] = m_proxies[last];
+        m_mobility[index] = m_mobility[last];
+        m_dynamic_positions[index] = m_dynamic_positions[last];
+        m_index_slots[index] = m_index_slots[last];
+        m_slots[m_index_slots[index]].index = index;
+    }
+
+    m_positions.pop_back();
+    m_rotations.pop_back();
+    m_matrices.pop_back();
+    m_previous_positions.pop_back();
+    m_previous_rotations.pop_back();
+    m_proxies.pop_back();
+    m_mobility.pop_back();
+    m_dynamic_positions.pop_back();
+    m_dirty_positions.pop_back();
+    m_index_slots.pop_back();
+
+    // Bumping the generation invalidates every handle to the slot.
+    m_slots[handle.slot].index = UINT32_MAX;
+    m_slots[handle.slot].generation++;
+    m_free_slots.push_back(handle.slot);
+
+    m_version++;
+}
+
+void Scene::clear() {
+    m_positions.clear();
+    m_rotations.clear();
+    m_matrices.clear();
+    m_previous_positions.clear();
+    m_previous_rotations.clear();
+    m_proxies.clear();
+    m_mobility.clear();
+    m_dynamic_positions.clear();
+    m_dirty_positions.clear();
+    m_index_slots.clear();
+
+    // Keep the slots around with bumped generations so old handles stay invalid.
+    m_free_slots.clear();
+    for (u32 slot = 0; slot < m_slots.size(); slot++) {
+        if (m_slots[slot].index != UINT32_MAX)
+            m_slots[slot].generation++;
+        m_slots[slot].index = UINT32_MAX;
+        m_free_slots.push_back(slot);
+    }
+
+    m_dynamic_objects.clear();
+    m_dirty.clear();
+    m_version++;
+}
+
+void Scene::reserve(usize count) {
+    m_positions.reserve(count);
+    m_rotations.reserve(count);
+    m_matrices.reserve(count);
+    m_previous_positions.reserve(count);
+    m_previous_rotations.reserve(count);
+    m_proxies.reserve(count);
+    m_mobility.reserve(count);
+    m_dynamic_positions.reserve(count);
+    m_dirty_positions.reserve(count);
+    m_index_slots.reserve(count);
+    m_slots.reserve(count);
+}
+
+bool Scene::contains(ObjectHandle handle) const {
+    return handle.slot < m_slots.size() &&
+        m_slots[handle.slot].generation == handle.generation &&
+        m_slots[handle.slot].index != UINT32_MAX;
+}
+
+ObjectHandle Scene::handle_of(u32 index) const {
+    const u32 slot = m_index_slots[index];
+    return { .slot = slot, .generation = m_slots[slot].generation };
+}
+
+void Scene::set_transform(ObjectHandle handle, const glm::vec3& pos, const glm::quat& rot) {
+    const u32 index = index_of(handle);
+    if (m_mobility[index] != ObjectMobility::Dynamic)
+        throw std::runtime_error("static objects can't be moved");
+
+    if (m_positions[index] != pos)
+        m_version++;
+
+    m_positions[index] = pos;
+    m_rotations[index] = rot;
+    mark_dirty(index);
+}
+
+void Scene::save_previous_transforms() {
+    for (auto handle : m_dynamic_objects) {
+        const u32 index = index_of(handle);
+
+        // Its matrix was somewhere in between, and is about to be built from the same transform twice.
+        if (in_motion(index))
+            mark_dirty(index);
+
+        m_previous_positions[index] = m_positions[index];
+        m_previous_rotations[index] = m_rotations[index];
+    }
+}
+
+void Scene::interpolate(f32 alpha) {
+    m_alpha = alpha;
+
+    for (auto handle : m_dynamic_objects) {
+        const u32 index = index_of(handle);
+        if (in_motion(index))
+            mark_dirty(index);
+    }
+}
+
+void Scene::mark_all_dirty() {
+    m_dirty.resize(size());
+    for (u32 i = 0; i < size(); i++) {
+        m_dirty[i] = i;
+        m_dirty_positions[i] = i;
+    }
+}
+
+void Scene::update_matrices(JobSystem* jobs) {
+    std::ranges::sort(m_dirty);
+    for (u32 i = 0; i < m_dirty.size(); i++) {
+        m_dirty_positions[m_dirty[i]] = i;
+    }
+
+    // With most of the scene dirty, going through everything in order beats jumping around.
+    if (m_dirty.size() > size() / 4) {
+        // Big enough chunks that scheduling them is noise next to the matrix math.
+        constexpr usize CHUNK_SIZE = 16 * 1024;
+
+        if (jobs && size() > CHUNK_SIZE) {
+            jobs->parallel_for(size(), CHUNK_SIZE, [&](usize first, usize last) {
+                const usize count = last - first;
+                compute_model_matrices(
+                    std::span(m_positions).subspan(first, count),
+                    std::span(m_rotations).subspan(first, count),
+                    std::span(m_matrices).subspan(first, count)
+                );
+            });
+        } else {
+            compute_model_matrices(m_positions, m_rotations, m_matrices);
+        }
+
+        // Few enough that they aren't worth folding into the loop above.
+        for (auto handle : m_dynamic_objects) {
+            const u32 index = index_of(handle);
+            if (in_motion(index))
+                m_matrices[index] = interpolated_matrix(index);
+        }
+        return;
+    }
+
+    for (u32 index : m_dirty) {
+        m_matrices[index] = in_motion(index) ? interpolated_matrix(index) : model_matrix(m_positions[index], m_rotations[index]);
+    }
+}
+
+void Scene::clear_dirty() {
+    for (u32 index : m_dirty) {
+        m_dirty_positions[index] = UINT32_MAX;
+    }
+    m_dirty.clear();
+}
+
+void Scene::mark_dirty(u32 index) {
+    if (m_dirty_positions[index] != UINT32_MAX)
+        return;
+
+    m_dirty_positions[index] = (u32) m_dirty.size();
+    m_dirty.push_back(index);
+}
+
+bool Scene::in_motion(u32 index) const {
+    return m_positions[index] != m_previous_positions[index] || m_rotations[index] != m_previous_rotations[index];
+}
+
+glm::mat4x4 Scene::interpolated_matrix(u32 index) const {
+    return model_matrix(
+        glm::mix(m_previous_positions[index], m_positions[index], m_alpha),
+        glm::slerp(m_previous_rotations[index], m_rotations[index], m_alpha)
+    );
+}
+
+glm::mat4x4 model_matrix(const glm::vec3& pos, const glm::quat& q) {
+    // Same as glm::translate(glm::identity<glm::mat4x4>(), pos) * glm::mat4_cast(q), without the full matrix multiply.
+    const f32 xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    const f32 xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    const f32 wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    // Column major
+    return glm::mat4x4(
+        1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy), 0.f,
+        2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx), 0.f,
+        2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy), 0.f,
+        pos.x, pos.y, pos.z, 1.f
+    );
+}
+
+void compute_model_matrices(std::span<const glm::vec3> positions, std::span<const glm::quat> rotations, std::span<glm::mat4x4> matrices) {
+    const usize count = matrices.size();
+    for (usize i = 0; i < count; i++) {
+        matrices[i] = model_matrix(positions[i], rotations[i]);
+    }
+}
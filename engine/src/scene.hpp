@@ -0,0 +1,136 @@
+#pragma once
+
+#include <span>
+
+class JobSystem;
+
+/// Stable reference to an object in a Scene. Handles of removed objects stay invalid, even once their slot is reused.
+struct ObjectHandle {
+    u32 slot = UINT32_MAX;
+    u32 generation = 0;
+
+    bool operator==(const ObjectHandle&) const = default;
+};
+
+enum class ObjectMobility : u8 {
+    /// Never moves once added.
+    Static,
+    /// Can be moved with Scene::set_transform.
+    Dynamic,
+};
+
+/// What the renderer needs to draw an object. Kept apart from the transforms, which get updated far more often.
+struct RenderProxy {
+    /// Object space bounding sphere (center, radius).
+    glm::vec4 bounds;
+};
+
+/// Objects in structure-of-arrays layout. Positions, rotations and cached model matrices each live in their own
+/// contiguous array indexed by the object's dense index, so a pass over one of them doesn't drag the others through the cache.
+/// Removing an object moves the last one into its place, which means dense indices change and handles don't.
+/// The dense index doubles as the object's slot in the GPU object buffer.
+/// Dynamic objects also remember their transform from before the last simulation tick, and their model matrices are
+/// built part of the way between the two, see interpolate().
+class Scene {
+public:
+    ObjectHandle add(const glm::vec3& pos, const glm::quat& rot, ObjectMobility mobility, const RenderProxy& proxy);
+
+    /// Removes an object. Does nothing if the object isn't in the scene.
+    void remove(ObjectHandle handle);
+
+    void clear();
+    void reserve(usize count);
+
+    [[nodiscard]] bool contains(ObjectHandle handle) const;
+
+    /// The dense index of an object that is in the scene.
+    [[nodiscard]] u32 index_of(ObjectHandle handle) const { return m_slots[handle.slot].index; }
+    [[nodiscard]] ObjectHandle handle_of(u32 index) const;
+
+    /// Moves a dynamic object. Throws if the object is static.
+    void set_transform(ObjectHandle handle, const glm::vec3& pos, const glm::quat& rot);
+
+    /// Remembers the dynamic objects' current transforms as their previous ones. Call before every simulation tick.
+    void save_previous_transforms();
+
+    /// Sets how far between their previous and current transforms the dynamic objects' matrices are built, from 0 to 1,
+    /// and marks the ones that are in between dirty.
+    void interpolate(f32 alpha);
+
+    /// Marks every object dirty, for when whatever they were uploaded to has been replaced.
+    void mark_all_dirty();
+
+    /// Recomputes the model matrices of the dirty objects and sorts dirty_objects().
+    /// Spreads the work over `jobs` when most of the scene is dirty.
+    void update_matrices(JobSystem* jobs = nullptr);
+
+    /// Forgets which objects are dirty, once their matrices have been uploaded.
+    void clear_dirty();
+
+public:     // Getters
+    [[nodiscard]] usize size() const { return m_positions.size(); }
+    [[nodiscard]] bool empty() const { return m_positions.empty(); }
+
+    [[nodiscard]] std::span<const glm::vec3> positions() const { return m_positions; }
+    [[nodiscard]] std::span<const glm::quat> rotations() const { return m_rotations; }
+    [[nodiscard]] std::span<const glm::vec3> previous_positions() const { return m_previous_positions; }
+    [[nodiscard]] std::span<const glm::quat> previous_rotations() const { return m_previous_rotations; }
+    /// Only up to date for objects that weren't dirty at the last update_matrices(). Interpolated for dynamic objects.
+    [[nodiscard]] std::span<const glm::mat4x4> matrices() const { return m_matrices; }
+    [[nodiscard]] std::span<const RenderProxy> proxies() const { return m_proxies; }
+    [[nodiscard]] ObjectMobility mobility(u32 index) const { return m_mobility[index]; }
+
+    [[nodiscard]] std::span<const ObjectHandle> dynamic_objects() const { return m_dynamic_objects; }
+    /// Dense indices of the objects added, moved or relocated by a removal since the last clear_dirty().
+    [[nodiscard]] std::span<const u32> dirty_objects() const { return m_dirty; }
+
+    /// Bumped whenever objects are added, removed or change position. Rotation doesn't count, so anything that only
+    /// depends on positions (like culling spheres) can be cached against it.
+    [[nodiscard]] u64 version() const { return m_version; }
+
+private:
+    void mark_dirty(u32 index);
+    /// Whether a dynamic object's matrix depends on the interpolation alpha.
+    [[nodiscard]] bool in_motion(u32 index) const;
+    [[nodiscard]] glm::mat4x4 interpolated_matrix(u32 index) const;
+
+private:
+    struct Slot {
+        /// Dense index of the object, UINT32_MAX while the slot is free.
+        u32 index;
+        u32 generation;
+    };
+
+    // Hot data, in dense order.
+    std::vector<glm::vec3> m_positions;
+    std::vector<glm::quat> m_rotations;
+    std::vector<glm::mat4x4> m_matrices;
+    // Transforms from before the last tick. Only ever differ from the current ones for dynamic objects.
+    std::vector<glm::vec3> m_previous_positions;
+    std::vector<glm::quat> m_previous_rotations;
+
+    // Cold data, in dense order.
+    std::vector<RenderProxy> m_proxies;
+    std::vector<ObjectMobility> m_mobility;
+    // Where dynamic objects are in m_dynamic_objects, UINT32_MAX for static ones.
+    std::vector<u32> m_dynamic_positions;
+    // Where objects are in m_dirty, UINT32_MAX for ones that aren't dirty. Lets removals fix up m_dirty without searching it.
+    std::vector<u32> m_dirty_positions;
+    std::vector<u32> m_index_slots;
+
+    std::vector<Slot> m_slots;
+    std::vector<u32> m_free_slots;
+
+    std::vector<ObjectHandle> m_dynamic_objects;
+    std::vector<u32> m_dirty;
+
+    u64 m_version = 1;
+    f32 m_alpha = 1;
+};
+
+/// translate(pos) * mat4_cast(rot), for a unit quaternion.
+glm::mat4x4 model_matrix(const glm::vec3& pos, const glm::quat& rot);
+
+/// model_matrix() for every element. The spans must be the same size.
+/// Written as a plain loop over contiguous arrays so the compiler can vectorize it.
+void compute_model_matrices(std::span<const glm::vec3> positions, std::span<const glm::quat> rotations, std::span<glm::mat4x4> matrices);
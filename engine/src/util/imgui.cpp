@@ -0,0 +1,37 @@
+#include "imgui.hpp"
+
+ImGuiDrawSnapshot::~ImGuiDrawSnapshot() {
+    for (auto* list : m_lists) {
+        IM_DELETE(list);
+    }
+}
+
+void ImGuiDrawSnapshot::capture(const ImDrawData* draw_data) {
+    m_draw_data.Clear();
+    m_draw_data.Valid = draw_data->Valid;
+    m_draw_data.CmdListsCount = draw_data->CmdListsCount;
+    m_draw_data.TotalIdxCount = draw_data->TotalIdxCount;
+    m_draw_data.TotalVtxCount = draw_data->TotalVtxCount;
+    m_draw_data.DisplayPos = draw_data->DisplayPos;
+    m_draw_data.DisplaySize = draw_data->DisplaySize;
+    m_draw_data.FramebufferScale = draw_data->FramebufferScale;
+    m_draw_data.OwnerViewport = draw_data->OwnerViewport;
+    m_draw_data.Textures = draw_data->Textures;
+
+    while (m_lists.Size < draw_data->CmdListsCount) {
+        // Only the output buffers get used, so the lists don't need ImGui's shared data.
+        m_lists.push_back(IM_NEW(ImDrawList)(nullptr));
+    }
+
+    for (int i = 0; i < draw_data->CmdListsCount; i++) {
+        const auto* src = draw_data->CmdLists[i];
+        auto* dst = m_lists[i];
+
+        dst->CmdBuffer = src->CmdBuffer;
+        dst->IdxBuffer = src->IdxBuffer;
+        dst->VtxBuffer = src->VtxBuffer;
+        dst->Flags = src->Flags;
+
+        m_draw_data.CmdLists.push_back(dst);
+    }
+}
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <imgui.h>
 
 template <class... Args>
@@ -10,3 +12,23 @@ void imgui_text(fmt::format_string<Args...> fmt, Args&&... args) {
 
     ImGui::TextUnformatted(buf.begin(), buf.end());
 }
+
+/// A copy of ImGui's draw data that stays valid after the next ImGui::NewFrame(), so it can be drawn on another thread.
+/// The draw lists are kept between captures and their buffers reused, so capturing doesn't allocate once warmed up.
+/// Textures aren't copied, the draw data still points at ImGui's.
+class ImGuiDrawSnapshot {
+public:
+    ImGuiDrawSnapshot() = default;
+    ~ImGuiDrawSnapshot();
+
+    ImGuiDrawSnapshot(const ImGuiDrawSnapshot&) = delete;
+    ImGuiDrawSnapshot& operator=(const ImGuiDrawSnapshot&) = delete;
+
+    void capture(const ImDrawData* draw_data);
+
+    [[nodiscard]] ImDrawData* draw_data() { return &m_draw_data; }
+
+private:
+    ImDrawData m_draw_data;
+    ImVector<ImDrawList*> m_lists;
+};
@@ -0,0 +1,104 @@
+#include "paths.hpp"
+
+#include "sdl3.hpp"
+
+#include <fstream>
+
+static constexpr auto APP_NAME = "brampling3D";
+
+static std::filesystem::path env_path(const char* name) {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0')
+        return {};
+    return value;
+}
+
+static std::filesystem::path platform_cache_dir() {
+#if defined(_WIN32)
+    return env_path("LOCALAPPDATA");
+#elif defined(__APPLE__)
+    auto home = env_path("HOME");
+    return home.empty() ? home : home / "Library" / "Caches";
+#else
+    auto xdg_cache_home = env_path("XDG_CACHE_HOME");
+    if (!xdg_cache_home.empty())
+        return xdg_cache_home;
+
+    auto home = env_path("HOME");
+    return home.empty() ? home : home / ".cache";
+#endif
+}
+
+std::filesystem::path user_cache_dir() {
+    static const std::filesystem::path cache_dir = [] {
+        std::filesystem::path dir = platform_cache_dir();
+
+        if (!dir.empty()) {
+            dir /= APP_NAME;
+        } else {
+            // SDL creates this one for us.
+            char* pref_path = SDL_GetPrefPath(nullptr, APP_NAME);
+            if (pref_path == nullptr) {
+                sdl3_perror("failed to find a cache directory");
+                return std::filesystem::path{};
+            }
+
+            dir = std::filesystem::path(pref_path) / "cache";
+            SDL_free(pref_path);
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        if (ec) {
+            spdlog::error("failed to create cache directory {}: {}", dir.string(), ec.message());
+            return std::filesystem::path{};
+        }
+
+        return dir;
+    }();
+
+    return cache_dir;
+}
+
+bool write_file_atomic(const std::filesystem::path& path, std::span<const u8> data) {
+    auto temp_path = path;
+    temp_path += ".tmp";
+
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(data.data()), (std::streamsize) data.size());
+        file.close();
+
+        if (!file) {
+            spdlog::error("failed to write {}", temp_path.string());
+            std::error_code ec;
+            std::filesystem::remove(temp_path, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        spdlog::error("failed to move {} to {}: {}", temp_path.string(), path.string(), ec.message());
+        std::filesystem::remove(temp_path, ec);
+        return false;
+    }
+
+    return true;
+}
+
+std::optional<std::vector<u8>> read_file(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return std::nullopt;
+
+    std::vector<u8> data((usize) file.tellg());
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(data.data()), (std::streamsize) data.size());
+
+    if (!file)
+        return std::nullopt;
+
+    return data;
+}
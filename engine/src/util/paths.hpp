@@ -0,0 +1,18 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <span>
+
+/// Returns the directory for cached data that can be thrown away at any time, creating it if needed.
+/// This is `$XDG_CACHE_HOME/brampling3D` (or `~/.cache/brampling3D`) on Linux, `~/Library/Caches/brampling3D` on macOS
+/// and `%LOCALAPPDATA%\brampling3D` on Windows, falling back to SDL's pref path.
+/// Returns an empty path if there is nowhere to put it.
+std::filesystem::path user_cache_dir();
+
+/// Writes `data` to `path` through a temporary file that is renamed over it,
+/// so the file is never left half written if we crash or run out of disk space.
+bool write_file_atomic(const std::filesystem::path& path, std::span<const u8> data);
+
+/// Reads a whole file. Returns std::nullopt if it can't be read.
+std::optional<std::vector<u8>> read_file(const std::filesystem::path& path);
@@ -0,0 +1,183 @@
+#include "profiler.hpp"
+
+#include "paths.hpp"
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// One thread's events, written only by that thread. A seqlock in all but name: the writer bumps `started` before
+// overwriting a slot and `finished` after, so a reader can tell which of the slots it copied may have been half written.
+// The slots are atomics (relaxed, so plain loads and stores in practice) to keep that race well defined.
+struct ThreadBuffer {
+    struct Slot {
+        std::atomic<const char*> name = nullptr;
+        std::atomic<u64> start = 0;
+        std::atomic<u64> end = 0;
+    };
+
+    // Only changed under the registry mutex.
+    std::string name;
+    u32 index = 0;
+
+    std::atomic<u64> started = 0;
+    std::atomic<u64> finished = 0;
+    std::array<Slot, PROFILER_THREAD_CAPACITY> slots;
+};
+
+struct Event {
+    const char* name;
+    u64 start;
+    u64 end;
+};
+
+struct Registry {
+    std::mutex mutex;
+    // Buffers stay around after their thread exits, so what it recorded still shows up in traces.
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+Registry& registry() {
+    static Registry registry;
+    return registry;
+}
+
+const auto EPOCH = std::chrono::steady_clock::now();
+
+thread_local ThreadBuffer* t_buffer = nullptr;
+thread_local std::string t_thread_name;
+
+// Ring of frame start times, only touched by the thread that marks frames and writes traces.
+std::array<u64, PROFILER_FRAME_CAPACITY> s_frame_starts{};
+u64 s_frame_count = 0;
+
+ThreadBuffer& thread_buffer() {
+    if (t_buffer)
+        return *t_buffer;
+
+    // Only happens once per thread, and only once it records something, so threads that never do don't use any memory.
+    auto buffer = std::make_unique<ThreadBuffer>();
+
+    auto& reg = registry();
+    std::lock_guard lock(reg.mutex);
+    buffer->index = (u32) reg.buffers.size();
+    buffer->name = t_thread_name.empty() ? fmt::format("thread {}", buffer->index) : t_thread_name;
+    t_buffer = reg.buffers.emplace_back(std::move(buffer)).get();
+    return *t_buffer;
+}
+
+// Copies out the buffer's events that ended at or after `since`, leaving out any that may have been overwritten meanwhile.
+void copy_events(const ThreadBuffer& buffer, u64 since, std::vector<Event>& events) {
+    const u64 finished = buffer.finished.load(std::memory_order_acquire);
+    const u64 first = finished > PROFILER_THREAD_CAPACITY ? finished - PROFILER_THREAD_CAPACITY : 0;
+
+    const usize old_size = events.size();
+    for (u64 i = first; i < finished; i++) {
+        const auto& slot = buffer.slots[i % PROFILER_THREAD_CAPACITY];
+        events.push_back({
+            .name = slot.name.load(std::memory_order_relaxed),
+            .start = slot.start.load(std::memory_order_relaxed),
+            .end = slot.end.load(std::memory_order_relaxed),
+        });
+    }
+
+    // Writes that started by now have overwritten the slots of everything older than `started` - capacity.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const u64 started = buffer.started.load(std::memory_order_relaxed);
+    const u64 first_intact = started > PROFILER_THREAD_CAPACITY ? started - PROFILER_THREAD_CAPACITY : 0;
+
+    const usize skip = (usize) (std::max(first, first_intact) - first);
+    events.erase(events.begin() + old_size, events.begin() + (usize) std::min<u64>(old_size + skip, events.size()));
+
+    std::erase_if(events, [&](const Event& event) { return event.end < since; });
+}
+
+}
+
+void profiler_set_enabled(bool enabled) {
+    g_profiler_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+u64 profiler_now() {
+    return (u64) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - EPOCH).count();
+}
+
+void profiler_set_thread_name(std::string_view name) {
+    t_thread_name = name;
+
+    if (t_buffer) {
+        std::lock_guard lock(registry().mutex);
+        t_buffer->name = t_thread_name;
+    }
+}
+
+void profiler_record(const char* name, u64 start, u64 end) {
+    auto& buffer = thread_buffer();
+
+    const u64 index = buffer.finished.load(std::memory_order_relaxed);
+    buffer.started.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    auto& slot = buffer.slots[index % PROFILER_THREAD_CAPACITY];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+
+    buffer.finished.store(index + 1, std::memory_order_release);
+}
+
+void profiler_mark_frame() {
+    s_frame_starts[s_frame_count % PROFILER_FRAME_CAPACITY] = profiler_now();
+    s_frame_count++;
+}
+
+bool profiler_write_trace(const std::filesystem::path& path, u32 frame_count) {
+    frame_count = (u32) std::min<u64>({ frame_count, s_frame_count, PROFILER_FRAME_CAPACITY });
+
+    // With fewer frames than asked for, everything since starting up.
+    u64 since = 0;
+    if (frame_count > 0 && frame_count < s_frame_count)
+        since = s_frame_starts[(s_frame_count - frame_count) % PROFILER_FRAME_CAPACITY];
+
+    auto out = fmt::memory_buffer();
+    fmt::format_to(std::back_inserter(out), "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    bool first_event = true;
+    auto separator = [&] {
+        const auto* sep = first_event ? "" : ",\n";
+        first_event = false;
+        return sep;
+    };
+
+    auto& reg = registry();
+    std::lock_guard lock(reg.mutex);
+
+    std::vector<Event> events;
+    for (const auto& buffer : reg.buffers) {
+        fmt::format_to(std::back_inserter(out), "{}{{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+            separator(), buffer->index, buffer->name);
+
+        events.clear();
+        copy_events(*buffer, since, events);
+
+        // Complete events in microseconds, which is what the format wants.
+        for (const auto& event : events) {
+            fmt::format_to(std::back_inserter(out), "{}{{\"ph\":\"X\",\"name\":\"{}\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                separator(), event.name, buffer->index, event.start / 1000.0, (event.end - event.start) / 1000.0);
+        }
+    }
+
+    fmt::format_to(std::back_inserter(out), "\n]}}\n");
+
+    if (!write_file_atomic(path, std::span(reinterpret_cast<const u8*>(out.data()), out.size()))) {
+        spdlog::error("failed to write trace to {}", path.string());
+        return false;
+    }
+
+    spdlog::info("wrote trace of the last {} frames to {}", frame_count, path.string());
+    return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+
+// CPU profiling: PROFILE_SCOPE records how long the enclosing scope took into a ring buffer owned by the current thread,
+// and profiler_write_trace() dumps the last few frames of every thread as Chrome trace JSON, which chrome://tracing and
+// https://ui.perfetto.dev can open. Recording doesn't lock anything, and while profiling is off a scope costs a
+// relaxed load and a branch.
+
+/// Events each thread keeps, older ones are overwritten.
+constexpr usize PROFILER_THREAD_CAPACITY = 32 * 1024;
+/// Frame starts remembered for profiler_write_trace().
+constexpr usize PROFILER_FRAME_CAPACITY = 1024;
+
+// Read by every scope, so it lives here to be inlined. Change it with profiler_set_enabled().
+inline std::atomic<bool> g_profiler_enabled = false;
+
+[[nodiscard]] inline bool profiler_enabled() { return g_profiler_enabled.load(std::memory_order_relaxed); }
+void profiler_set_enabled(bool enabled);
+
+/// Nanoseconds since the profiler's epoch.
+[[nodiscard]] u64 profiler_now();
+
+/// Names the current thread in traces. Threads that never call it are named after their index.
+void profiler_set_thread_name(std::string_view name);
+
+/// Records that `name` ran from `start` to `end` on the current thread. `name` has to outlive the profiler, like a string literal.
+void profiler_record(const char* name, u64 start, u64 end);
+
+/// Marks the start of a frame. Only call it from the thread that writes traces.
+void profiler_mark_frame();
+
+/// Writes everything recorded since the start of the last `frame_count` frames as Chrome trace JSON. Returns whether it worked.
+/// Events still being written by other threads while this runs are left out.
+bool profiler_write_trace(const std::filesystem::path& path, u32 frame_count);
+
+/// Records the time between its construction and destruction, if profiling was on when it was constructed.
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) {
+        if (profiler_enabled()) {
+            m_name = name;
+            m_start = profiler_now();
+        }
+    }
+
+    ~ProfileScope() {
+        if (m_name)
+            profiler_record(m_name, m_start, profiler_now());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* m_name = nullptr;
+    u64 m_start = 0;
+};
+
+#define PROFILE_CONCAT_IMPL(A, B) A##B
+#define PROFILE_CONCAT(A, B) PROFILE_CONCAT_IMPL(A, B)
+
+/// Profiles the rest of the enclosing scope under NAME, a string literal.
+#define PROFILE_SCOPE(NAME) const ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(NAME)
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+/// Ring of N reusable slots passed from one producer thread to one consumer thread without locks.
+/// Nothing is copied: the producer fills a slot in place and publishes it, the consumer reads it in place and hands it
+/// back. Each side only waits (on an atomic, not a mutex) when the ring is full or empty.
+template <class T, usize N>
+class SpscRing {
+public:
+    /// The next slot to fill, waiting until the consumer is done with one if they're all in use. Producer only.
+    /// The slot still holds whatever was in it last time, and the consumer may have left something there too.
+    T& begin_write() {
+        const u64 head = m_head.load(std::memory_order_relaxed);
+
+        u64 tail = m_tail.load(std::memory_order_acquire);
+        while (head - tail == N) {
+            m_tail.wait(tail, std::memory_order_acquire);
+            tail = m_tail.load(std::memory_order_acquire);
+        }
+
+        return m_slots[head % N];
+    }
+
+    /// Publishes the slot from begin_write().
+    void end_write() {
+        m_head.fetch_add(1, std::memory_order_release);
+        m_head.notify_one();
+    }
+
+    /// The oldest published slot, waiting for one if there is none. Consumer only.
+    T& begin_read() {
+        const u64 tail = m_tail.load(std::memory_order_relaxed);
+
+        u64 head = m_head.load(std::memory_order_acquire);
+        while (head == tail) {
+            m_head.wait(head, std::memory_order_acquire);
+            head = m_head.load(std::memory_order_acquire);
+        }
+
+        return m_slots[tail % N];
+    }
+
+    /// Hands the slot from begin_read() back to the producer.
+    void end_read() {
+        m_tail.fetch_add(1, std::memory_order_release);
+        m_tail.notify_one();
+    }
+
+private:
+    std::array<T, N> m_slots{};
+
+    // Slots published and slots handed back so far. Only ever increase, so they can't wrap in practice.
+    alignas(64) std::atomic<u64> m_head = 0;
+    alignas(64) std::atomic<u64> m_tail = 0;
+};
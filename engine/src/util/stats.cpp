@@ -0,0 +1,31 @@
+#include "stats.hpp"
+
+#include <cmath>
+#include <numeric>
+
+f64 percentile(std::span<const f64> sorted, f64 p) {
+    if (sorted.empty())
+        return 0;
+
+    // The smallest sample that at least p% of the samples are less than or equal to.
+    const auto rank = (usize) std::ceil(p / 100 * sorted.size());
+    return sorted[std::clamp<usize>(rank, 1, sorted.size()) - 1];
+}
+
+SampleSummary summarize(std::span<const f64> samples) {
+    if (samples.empty())
+        return {};
+
+    std::vector<f64> sorted(samples.begin(), samples.end());
+    std::ranges::sort(sorted);
+
+    return {
+        .count = sorted.size(),
+        .min = sorted.front(),
+        .avg = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size(),
+        .p50 = percentile(sorted, 50),
+        .p95 = percentile(sorted, 95),
+        .p99 = percentile(sorted, 99),
+        .max = sorted.back(),
+    };
+}
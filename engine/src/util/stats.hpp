@@ -0,0 +1,21 @@
+#pragma once
+
+#include <span>
+
+/// Order statistics of a set of samples, like frame times.
+struct SampleSummary {
+    usize count = 0;
+    f64 min = 0;
+    f64 avg = 0;
+    f64 p50 = 0;
+    f64 p95 = 0;
+    f64 p99 = 0;
+    f64 max = 0;
+};
+
+/// Nearest-rank percentile `p` (0 to 100) of samples sorted in ascending order, so it's always one of the samples.
+/// 0 if there are none.
+f64 percentile(std::span<const f64> sorted, f64 p);
+
+/// Summarizes `samples`, which don't need to be sorted. All zero if there are none.
+SampleSummary summarize(std::span<const f64> samples);